@@ -7,6 +7,23 @@ CPUwindow::CPUwindow(QWidget *parent) :
 {
     ui->setupUi(this);
     QWidget::setFixedSize(this->size());
+
+    datapath = {
+        ui->PClineD, ui->PClineS, ui->PClineR, ui->PCview,
+        ui->SPlineS, ui->SPview,
+        ui->DlineALU, ui->SlineALU, ui->ALUlineR,
+        ui->SBUSview, ui->DBUSview, ui->RBUSview,
+        ui->ADRlineR, ui->ADRview, ui->addressline, ui->dinline, ui->memoryLabel,
+        ui->doutlineIR, ui->IRview,
+        ui->TlineS, ui->TlineR, ui->Tview,
+        ui->MDRlineS, ui->MDRlineD, ui->MDRlineR, ui->doutlineMDR, ui->MDRview,
+        ui->GRlineS, ui->GRlineD, ui->GRlineR, ui->RGview,
+        ui->r0, ui->r1, ui->r2, ui->r3, ui->r4, ui->r5, ui->r6, ui->r7,
+        ui->r8, ui->r9, ui->r10, ui->r11, ui->r12, ui->r13, ui->r14, ui->r15,
+        ui->FLAGlineS, ui->FLAGlineR, ui->CONDline, ui->FLAGview,
+        ui->IVRlineS, ui->IVRview
+    };
+    showingFrames = false;
 }
 
 CPUwindow::~CPUwindow()
@@ -34,6 +51,8 @@ void CPUwindow::paintEvent(QPaintEvent *event)
 
 void CPUwindow::connectBackend()
 {
+    connect(this->cpu, &Cpu::frameReady, this, &CPUwindow::showFrame);
+
     // PdPCD
     connect(this->cpu, &Cpu::PdPCD, this, [=](bool active) {
         if(active) {
@@ -452,6 +471,42 @@ void CPUwindow::connectBackend()
     });
 }
 
+void CPUwindow::showFrame(const CpuSnapshot &snapshot)
+{
+    const CpuRegisters &registers = snapshot.registers;
+    QLabel *generalRegisters[16] = {
+        ui->r0, ui->r1, ui->r2, ui->r3, ui->r4, ui->r5, ui->r6, ui->r7,
+        ui->r8, ui->r9, ui->r10, ui->r11, ui->r12, ui->r13, ui->r14, ui->r15
+    };
+
+    setUpdatesEnabled(false);
+
+    if (!showingFrames) {
+        for (QWidget *widget : datapath)
+            widget->setStyleSheet("color: rgb(0, 0, 0);");
+
+        this->ui->ALUlabel->setText("ALU");
+        this->ui->memoryLabel->setText("MEMORY");
+    }
+
+    for (int index = 0; index < 16; index++)
+        generalRegisters[index]->setText("0x" + QString::number(registers.R[index], 16).toUpper());
+
+    this->ui->PCview->setText("0x" + QString::number(registers.PC, 16).toUpper());
+    this->ui->SPview->setText("0x" + QString::number(registers.SP, 16).toUpper());
+    this->ui->FLAGview->setText("0b" + QString::number(registers.FLAG, 2).toUpper());
+    this->ui->Tview->setText("0x" + QString::number(registers.T, 16).toUpper());
+    this->ui->IRview->setText("0x" + QString::number(registers.IR, 16).toUpper());
+    this->ui->MDRview->setText("0x" + QString::number(registers.MDR, 16).toUpper());
+    this->ui->ADRview->setText("0x" + QString::number(registers.ADR, 16).toUpper());
+    this->ui->IVRview->setText("0x" + QString::number(registers.IVR, 16).toUpper());
+
+    setUpdatesEnabled(true);
+
+    // The next run starts from whatever stepping highlighted
+    showingFrames = snapshot.status == CpuStatus::running || snapshot.status == CpuStatus::waiting;
+}
+
 void CPUwindow::resetRegisters()
 {
     this->ui->r0->setText(QString::number(0));
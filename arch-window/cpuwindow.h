@@ -3,6 +3,7 @@
 
 #include <QDialog>
 #include <QPainter>
+#include <QVector>
 #include <cpu/cpu.h>
 
 namespace Ui {
@@ -24,8 +25,16 @@ private:
     void connectBackend();
     void resetRegisters();
 
+    //// Shows a frame of a run in one pass. Only the first frame of a run
+    //// clears the highlighted datapath, the others only set texts
+    void showFrame(const CpuSnapshot &snapshot);
+
     Ui::CPUwindow *ui;
     Cpu *cpu;
+
+    // Everything the datapath signals highlight
+    QVector<QWidget *> datapath;
+    bool showingFrames;
 };
 
 #endif // CPUWINDOW_H
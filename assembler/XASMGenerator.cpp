@@ -27,6 +27,16 @@ void XASMGenerator::generate() {
         }
 }
 
+std::vector<u16> XASMGenerator::assemble() {
+        parse();
+
+        return data;
+}
+
+LineTable XASMGenerator::getLineTable() {
+        return lines;
+}
+
 void XASMGenerator::parse() {
         while (!checkCurrentToken(TokenType::XASMEOF)) {
                 if (checkCurrentToken(TokenType::Instruction))
@@ -38,9 +48,11 @@ void XASMGenerator::parse() {
 
 void XASMGenerator::generateObjectCode() {
         Token crtToken{getCurrentToken()};
+        lines[pc] = crtToken.line;
+
         switch (instructionType(crtToken.value)) {
                 case 1: {
-                        u16 instruction = instructions[crtToken.value];
+                        u16 instruction = instructions.at(crtToken.value);
                         getNextToken();
 
                         //note if destination operand needs an immediate value to be added after instruction in data vector
@@ -57,7 +69,7 @@ void XASMGenerator::generateObjectCode() {
                 }
 
                 case 2: {
-                        u16 instruction = instructions[crtToken.value];
+                        u16 instruction = instructions.at(crtToken.value);
 
                         //call and jmp can also have a label as offset
                         if (crtToken.value == "call" || crtToken.value == "jmp") {
@@ -89,7 +101,7 @@ void XASMGenerator::generateObjectCode() {
                 }
 
                 case 3: {
-                        u16 instruction = instructions[crtToken.value];
+                        u16 instruction = instructions.at(crtToken.value);
                         getNextToken();
 
                         checkLabelDefined(getCurrentToken().value);
@@ -105,7 +117,7 @@ void XASMGenerator::generateObjectCode() {
                 }
 
                 case 4: {
-                        u16 instruction = instructions[crtToken.value];
+                        u16 instruction = instructions.at(crtToken.value);
                         data.push_back(instruction);
                         getNextToken();
 
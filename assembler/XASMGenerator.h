@@ -23,6 +23,12 @@ public:
     ///Generates the binary file containing the object code
     void generate();
 
+    ///Generates the object code without writing the binary file
+    std::vector<u16> assemble();
+
+    ///Source line of every instruction by its address, once assembled
+    LineTable getLineTable();
+
 private:
     ///Parses operand extracting register number
     u16 getRegisterNumber(u16 &operand);
@@ -43,6 +49,7 @@ private:
     void checkLabelDefined(std::string label);
 
     std::vector<u16> data;
+    LineTable lines;
     u16 pc;
     u16 immediateValue;
     Labels labels;
@@ -12,10 +12,12 @@
 typedef unsigned char u8;
 typedef unsigned short u16;
 typedef unsigned int u32;
+typedef unsigned long long u64;
 typedef std::map<std::string, u16> Labels;
+typedef std::map<u16, u32> LineTable;
 
 
-static std::vector<std::string> instructionVector {"mov", "add", "sub", "cmp", "and", "or", "xor", "clr", "neg", "inc", "dec",
+static const std::vector<std::string> instructionVector {"mov", "add", "sub", "cmp", "and", "or", "xor", "clr", "neg", "inc", "dec",
                                                    "asl", "asr", "lsr", "rol", "ror", "rlc", "rrc", "jmp", "call", "push", "pop",
                                                    "br", "bne", "beq", "bpl", "bcs", "bcc", "bvs", "bvc", "clc", "clv", "clz",
                                                    "cls", "ccc", "sec", "sev", "sez", "ses", "scc", "nop", "ret", "reti","halt", "wait",
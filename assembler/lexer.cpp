@@ -14,6 +14,7 @@ Lexer::Lexer(std::string &source) {
         this->source = source;
         position = 0;
         currentChar = 0;
+        line = 1;
 
         // Convert source to lowercase
         for (char &c : this->source)
@@ -30,6 +31,7 @@ Token Lexer::nextToken() {
         skipSpaces();
 
         t.value += currentChar;
+        t.line = line;
 
         switch(currentChar) {
                 case '\r': case '\n': case '\f':
@@ -131,6 +133,10 @@ Token Lexer::nextToken() {
 }
 
 void Lexer::nextChar() {
+        // Leaving a \n, \r\n counts once
+        if (currentChar == '\n')
+                line++;
+
         if (position >= (int)source.size())
                 currentChar = XASMEOFConstant;
         else
@@ -162,5 +168,7 @@ void Lexer::skipSpaces() {
 
 void Lexer::rewind() {
         position = 0;
+        currentChar = 0;
+        line = 1;
         nextChar();
 }
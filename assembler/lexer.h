@@ -20,6 +20,7 @@ private:
     std::string source;
     char currentChar;
     int position;
+    int line;
 
     void nextChar();
     char peek();
@@ -10,18 +10,18 @@
 #include "parser.h"
 #include "verifier.h"
 
-std::vector<std::string> Verifier::classB1InstructionVector {"mov", "add", "sub", "cmp", "and", "or", "xor"};
+const std::vector<std::string> Verifier::classB1InstructionVector {"mov", "add", "sub", "cmp", "and", "or", "xor"};
 
-std::vector<std::string> Verifier::classB2InstructionVector {"clr", "neg", "inc", "dec", "asl", "asr", "lsr", "rol", "ror", "rlc", "rrc", "jmp",
+const std::vector<std::string> Verifier::classB2InstructionVector {"clr", "neg", "inc", "dec", "asl", "asr", "lsr", "rol", "ror", "rlc", "rrc", "jmp",
                                                              "call", "push", "pop"};
 
-std::vector<std::string> Verifier::classB3InstructionVector {"br", "bne", "beq", "bpl", "bcs", "bcc", "bvs", "bvc"};
+const std::vector<std::string> Verifier::classB3InstructionVector {"br", "bne", "beq", "bpl", "bcs", "bcc", "bvs", "bvc"};
 
-std::vector<std::string> Verifier::classB4InstructionVector {"clc", "clv", "clz", "cls", "ccc", "sec", "sev", "sez", "ses", "scc", "nop", "ret",
+const std::vector<std::string> Verifier::classB4InstructionVector {"clc", "clv", "clz", "cls", "ccc", "sec", "sev", "sez", "ses", "scc", "nop", "ret",
                                                              "reti","halt", "wait", "pushflag", "popflag", "pushpc", "poppc"};
 
 // TODO(Moldo): Find another solution for this
-std::vector<std::string> tokenTypeString {"Instruction", "Number", "Lparan", "Rparan", "Colon", "Dot",
+const std::vector<std::string> tokenTypeString {"Instruction", "Number", "Lparan", "Rparan", "Colon", "Dot",
                                           "Comma", "Register", "Label", "NewLine", "Comment", "XASMEOF"};
 
 XASMParser::XASMParser(Lexer &lexer) : pc{0} {
@@ -25,6 +25,7 @@ enum class TokenType {
 struct Token {
     TokenType type;
     std::string value;
+    int line; // of the source, from 1
 };
 
 #endif //XASM_TOKEN_H
@@ -9,13 +9,13 @@
 #include <string>
 
 class Verifier {
-    static std::vector<std::string> classB1InstructionVector;
+    static const std::vector<std::string> classB1InstructionVector;
 
-    static std::vector<std::string> classB2InstructionVector;
+    static const std::vector<std::string> classB2InstructionVector;
 
-    static std::vector<std::string> classB3InstructionVector;
+    static const std::vector<std::string> classB3InstructionVector;
 
-    static std::vector<std::string> classB4InstructionVector;
+    static const std::vector<std::string> classB4InstructionVector;
 public:
     Verifier() = default;
     static bool matchRegister(const std::string &reg);
@@ -1,6 +1,6 @@
 #include <cgb/cgb.h>
 
-CGB::CGB(QObject *parent) : QObject(parent)
+CGB::CGB()
 {
     crtPhase = Phase::IF;
     crtImpulse = 1;
@@ -1,17 +1,18 @@
 #ifndef CGB_H
 #define CGB_H
 
-#include <QObject>
-
 #include "assembler/defs.h"
 
 enum class Phase { IF = 1, OF = 2, EX = 3, INT = 4};
 
-class CGB : public QObject
+class CGB
 {
-    Q_OBJECT
 public:
-    explicit CGB(QObject *parent = nullptr);
+    //// Highest impulse of any phase, reached by the OF of an instruction
+    //// with both operands in memory
+    static const u8 maxImpulse = 9;
+
+    CGB();
 
     Phase getPhase();
     void setPhase(Phase phase);
@@ -19,8 +20,6 @@ public:
     u8 getImpulse();
     void setImpluse(u8 impluse);
 
-signals:
-
 private:
     Phase crtPhase;
     u8 crtImpulse;
@@ -0,0 +1,402 @@
+#include "breakpoint.h"
+
+#include <cctype>
+#include <stdexcept>
+
+namespace {
+
+typedef BreakpointCondition::Opcode Opcode;
+typedef BreakpointCondition::Instruction Instruction;
+
+// Register operands of Opcode::load after R0 to R15
+const u16 loadPC = 16;
+const u16 loadSP = 17;
+const u16 loadFLAG = 18;
+
+// Binary operators of one precedence level, from the loosest binding one
+struct BinaryOperator
+{
+    const char *symbol;
+    Opcode opcode;
+};
+
+const BinaryOperator logicalOrOperators[] = {{"||", Opcode::logicalOr}, {nullptr, Opcode::constant}};
+const BinaryOperator logicalAndOperators[] = {{"&&", Opcode::logicalAnd}, {nullptr, Opcode::constant}};
+const BinaryOperator bitOrOperators[] = {{"|", Opcode::bitOr}, {nullptr, Opcode::constant}};
+const BinaryOperator bitXorOperators[] = {{"^", Opcode::bitXor}, {nullptr, Opcode::constant}};
+const BinaryOperator bitAndOperators[] = {{"&", Opcode::bitAnd}, {nullptr, Opcode::constant}};
+const BinaryOperator equalityOperators[] = {
+    {"==", Opcode::equal}, {"!=", Opcode::notEqual}, {nullptr, Opcode::constant}
+};
+const BinaryOperator relationalOperators[] = {
+    {"<=", Opcode::lessEqual}, {">=", Opcode::greaterEqual}, {"<", Opcode::less}, {">", Opcode::greater},
+    {nullptr, Opcode::constant}
+};
+const BinaryOperator additiveOperators[] = {
+    {"+", Opcode::add}, {"-", Opcode::subtract}, {nullptr, Opcode::constant}
+};
+
+const BinaryOperator *const precedence[] = {
+    logicalOrOperators, logicalAndOperators, bitOrOperators, bitXorOperators, bitAndOperators,
+    equalityOperators, relationalOperators, additiveOperators
+};
+
+const size_t levels = sizeof(precedence) / sizeof(precedence[0]);
+
+// Recursive descent from the loosest binding operators down to the
+// operands, emitting postfix code
+class ConditionCompiler
+{
+public:
+    explicit ConditionCompiler(const std::string &text) : text(text), position(0), depth(0), nesting(0) {}
+
+    std::vector<Instruction> compile()
+    {
+        skipSpace();
+        expression(0);
+
+        if (position != text.size())
+            fail("unexpected " + std::string(1, text[position]));
+
+        return code;
+    }
+
+private:
+    void expression(size_t level)
+    {
+        if (level == levels) {
+            unary();
+            return;
+        }
+
+        expression(level + 1);
+
+        for (;;) {
+            const BinaryOperator *found = nullptr;
+
+            for (const BinaryOperator *op = precedence[level]; op->symbol && !found; op++) {
+                if (peekOperator(op->symbol))
+                    found = op;
+            }
+
+            if (!found)
+                return;
+
+            accept(found->symbol);
+            expression(level + 1);
+            emit(found->opcode, 0, -1);
+        }
+    }
+
+    void unary()
+    {
+        static const BinaryOperator unaryOperators[] = {
+            {"!", Opcode::logicalNot}, {"~", Opcode::complement}, {"-", Opcode::negate}
+        };
+
+        for (const BinaryOperator &op : unaryOperators) {
+            // != is no negation
+            if (peek(op.symbol) && !peek("!=")) {
+                accept(op.symbol);
+                nest();
+                unary();
+                nesting--;
+                emit(op.opcode, 0, 0);
+                return;
+            }
+        }
+
+        operand();
+    }
+
+    void operand()
+    {
+        if (accept("(")) {
+            nest();
+            expression(0);
+            nesting--;
+            expect(")");
+            return;
+        }
+
+        if (accept("[")) {
+            nest();
+            expression(0);
+            nesting--;
+            expect("]");
+            emit(Opcode::memory, 0, 0);
+            return;
+        }
+
+        if (position < text.size() && isdigit((unsigned char)text[position])) {
+            number();
+            return;
+        }
+
+        size_t start = position;
+        std::string name = word();
+
+        if (name.empty())
+            fail(position < text.size() ? "unexpected " + std::string(1, text[position]) : "unexpected end");
+
+        if (name == "pc") {
+            emit(Opcode::load, loadPC, 1);
+        }
+        else if (name == "sp") {
+            emit(Opcode::load, loadSP, 1);
+        }
+        else if (name == "flag") {
+            if (accept("."))
+                flagBit();
+            else
+                emit(Opcode::load, loadFLAG, 1);
+        }
+        else if (name[0] == 'r' || name.compare(0, 2, "$r") == 0) {
+            std::string digits = name.substr(name[0] == '$' ? 2 : 1);
+            bool valid = !digits.empty() && digits.size() <= 2 &&
+                         digits.find_first_not_of("0123456789") == std::string::npos;
+
+            if (!valid || std::stoul(digits) > 15) {
+                position = start;
+                fail("unknown register " + name);
+            }
+
+            emit(Opcode::load, (u16)std::stoul(digits), 1);
+        }
+        else {
+            position = start;
+            fail("unknown name " + name);
+        }
+    }
+
+    void flagBit()
+    {
+        static const char bits[] = "vszc";
+        size_t start = position;
+        std::string name = word();
+        size_t bit = std::string(bits).find(name);
+
+        if (name.size() != 1 || bit == std::string::npos) {
+            position = start;
+            fail("expected FLAG.C, FLAG.Z, FLAG.S or FLAG.V");
+        }
+
+        emit(Opcode::flag, 1 << bit, 1);
+    }
+
+    void number()
+    {
+        size_t start = position;
+        int base = 10;
+
+        if (text.compare(position, 2, "0x") == 0 || text.compare(position, 2, "0X") == 0) {
+            base = 16;
+            position += 2;
+        }
+
+        u32 value = 0;
+        size_t digits = 0;
+
+        while (position < text.size() && isalnum((unsigned char)text[position])) {
+            char c = tolower(text[position]);
+            int digit = isdigit((unsigned char)c) ? c - '0' : c - 'a' + 10;
+
+            if (digit >= base) {
+                position = start;
+                fail("invalid number");
+            }
+
+            value = value * base + digit;
+            if (value > 0xffff) {
+                position = start;
+                fail("number larger than 0xffff");
+            }
+
+            position++;
+            digits++;
+        }
+
+        if (!digits) {
+            position = start;
+            fail("invalid number");
+        }
+
+        skipSpace();
+        emit(Opcode::constant, (u16)value, 1);
+    }
+
+    // Name in lower case, $ and digits included
+    std::string word()
+    {
+        std::string name;
+
+        while (position < text.size() && (isalnum((unsigned char)text[position]) || text[position] == '$' ||
+                                          text[position] == '_')) {
+            name += tolower(text[position]);
+            position++;
+        }
+
+        skipSpace();
+        return name;
+    }
+
+    bool peek(const char *symbol) const
+    {
+        return text.compare(position, std::char_traits<char>::length(symbol), symbol) == 0;
+    }
+
+    // | and & are not the first half of || and &&
+    bool peekOperator(const char *symbol) const
+    {
+        bool doubled = (symbol[0] == '|' || symbol[0] == '&') && !symbol[1] && position + 1 < text.size() &&
+                       text[position + 1] == symbol[0];
+
+        return peek(symbol) && !doubled;
+    }
+
+    bool accept(const char *symbol)
+    {
+        if (!peek(symbol))
+            return false;
+
+        position += std::char_traits<char>::length(symbol);
+        skipSpace();
+        return true;
+    }
+
+    void expect(const char *symbol)
+    {
+        if (!accept(symbol))
+            fail(std::string("expected ") + symbol);
+    }
+
+    void skipSpace()
+    {
+        while (position < text.size() && isspace((unsigned char)text[position]))
+            position++;
+    }
+
+    // Appends an instruction that changes the stack depth by change
+    void emit(Opcode opcode, u16 operand, int change)
+    {
+        code.push_back({opcode, operand});
+        depth += change;
+
+        if (depth > BreakpointCondition::maxStack)
+            fail("condition nested too deeply");
+    }
+
+    // Bounds the recursion of parentheses, brackets and unary operators,
+    // which the stack depth does not
+    void nest()
+    {
+        if (++nesting > BreakpointCondition::maxNesting)
+            fail("condition nested too deeply");
+    }
+
+    void fail(const std::string &message) const
+    {
+        throw std::invalid_argument("column " + std::to_string(position + 1) + ": " + message);
+    }
+
+    const std::string &text;
+    size_t position;
+    std::vector<Instruction> code;
+    size_t depth;
+    size_t nesting;
+};
+
+}
+
+BreakpointCondition::BreakpointCondition(const std::string &text) : text(text)
+{
+    if (text.find_first_not_of(" \t\r\n") != std::string::npos)
+        code = ConditionCompiler(text).compile();
+}
+
+bool BreakpointCondition::evaluate(const u16 *R, u16 PC, u16 SP, u16 FLAG, const PagedMemory &memory) const
+{
+    u16 stack[maxStack];
+    size_t top = 0;
+
+    for (const Instruction &instruction : code) {
+        switch (instruction.opcode) {
+        case Opcode::constant:
+            stack[top++] = instruction.operand;
+            continue;
+        case Opcode::load:
+            stack[top++] = instruction.operand < 16 ? R[instruction.operand]
+                         : instruction.operand == loadPC ? PC
+                         : instruction.operand == loadSP ? SP
+                                                          : FLAG;
+            continue;
+        case Opcode::flag:
+            stack[top++] = (FLAG & instruction.operand) != 0;
+            continue;
+        case Opcode::memory:
+            stack[top - 1] = memory.readWord(stack[top - 1]);
+            continue;
+        case Opcode::logicalNot:
+            stack[top - 1] = !stack[top - 1];
+            continue;
+        case Opcode::negate:
+            stack[top - 1] = -stack[top - 1];
+            continue;
+        case Opcode::complement:
+            stack[top - 1] = ~stack[top - 1];
+            continue;
+        default:
+            break;
+        }
+
+        // Binary operators replace their two operands by the result
+        u16 b = stack[--top];
+        u16 &a = stack[top - 1];
+
+        switch (instruction.opcode) {
+        case Opcode::add:
+            a += b;
+            break;
+        case Opcode::subtract:
+            a -= b;
+            break;
+        case Opcode::bitAnd:
+            a &= b;
+            break;
+        case Opcode::bitXor:
+            a ^= b;
+            break;
+        case Opcode::bitOr:
+            a |= b;
+            break;
+        case Opcode::equal:
+            a = a == b;
+            break;
+        case Opcode::notEqual:
+            a = a != b;
+            break;
+        case Opcode::less:
+            a = a < b;
+            break;
+        case Opcode::lessEqual:
+            a = a <= b;
+            break;
+        case Opcode::greater:
+            a = a > b;
+            break;
+        case Opcode::greaterEqual:
+            a = a >= b;
+            break;
+        case Opcode::logicalAnd:
+            a = a && b;
+            break;
+        case Opcode::logicalOr:
+            a = a || b;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return stack[0] != 0;
+}
@@ -0,0 +1,83 @@
+#ifndef BREAKPOINT_H
+#define BREAKPOINT_H
+
+#include "assembler/defs.h"
+#include <cpu/pagedmemory.h>
+
+#include <string>
+#include <vector>
+
+//// Condition of a breakpoint, compiled once into the bytecode of a small
+//// stack machine. Conditions are C expressions over 16 bit unsigned
+//// values:
+////
+////     R0 to R15, also written $r0, PC, SP, FLAG
+////     FLAG.C, FLAG.Z, FLAG.S and FLAG.V, each 0 or 1
+////     [expression], the memory word at an address
+////     decimal and 0x hexadecimal numbers
+////     ( ) ! ~ - + & ^ | == != < <= > >= && ||
+////
+//// like R3 == 0 && FLAG.Z or [SP + 2] >= 0x8000. Names are not case
+//// sensitive
+class BreakpointCondition
+{
+public:
+    //// Holds every time
+    BreakpointCondition() {}
+
+    //// Throws std::invalid_argument, naming the column where text goes
+    //// wrong. Blank text holds every time
+    explicit BreakpointCondition(const std::string &text);
+
+    //// At the start of an instruction, with FLAG evaluated
+    bool holds(const u16 *R, u16 PC, u16 SP, u16 FLAG, const PagedMemory &memory) const
+    {
+        return code.empty() || evaluate(R, PC, SP, FLAG, memory);
+    }
+
+    const std::string &getText() const { return text; }
+
+    //// Bytecode, operators pop their operands and push the result
+    enum class Opcode : u8 {
+        constant,  // pushes operand
+        load,      // pushes register operand: R0 to R15, PC, SP, FLAG
+        flag,      // pushes whether the FLAG bits of operand are set
+        memory,    // replaces an address by the word there
+        logicalNot,
+        negate,
+        complement,
+        add,
+        subtract,
+        bitAnd,
+        bitXor,
+        bitOr,
+        equal,
+        notEqual,
+        less,
+        lessEqual,
+        greater,
+        greaterEqual,
+        logicalAnd,
+        logicalOr
+    };
+
+    struct Instruction
+    {
+        Opcode opcode;
+        u16 operand;
+    };
+
+    //// Deepest stack a condition may need
+    static const size_t maxStack = 32;
+
+    //// Deepest nesting of parentheses, brackets and unary operators
+    static const size_t maxNesting = 64;
+
+private:
+    bool evaluate(const u16 *R, u16 PC, u16 SP, u16 FLAG, const PagedMemory &memory) const;
+
+    std::vector<Instruction> code;
+    std::string text;
+};
+
+#endif // BREAKPOINT_H
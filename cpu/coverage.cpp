@@ -0,0 +1,92 @@
+#include "coverage.h"
+
+#include <bitset>
+#include <cstring>
+#include <map>
+
+namespace {
+
+// bne to bvc, br always goes
+bool isConditionalBranch(u16 word)
+{
+    return (word >> 8) >= 0xa1 && (word >> 8) <= 0xa7;
+}
+
+}
+
+Coverage::Coverage()
+{
+    clear();
+}
+
+u32 Coverage::getExecutedCount() const
+{
+    u32 count = 0;
+
+    for (size_t index = 0; index < words; index++)
+        count += std::bitset<64>(executed[index]).count();
+
+    return count;
+}
+
+void Coverage::merge(const Coverage &other)
+{
+    for (size_t index = 0; index < words; index++) {
+        executed[index] |= other.executed[index];
+        branchTaken[index] |= other.branchTaken[index];
+        branchNotTaken[index] |= other.branchNotTaken[index];
+    }
+}
+
+void Coverage::clear()
+{
+    memset(executed, 0, sizeof(executed));
+    memset(branchTaken, 0, sizeof(branchTaken));
+    memset(branchNotTaken, 0, sizeof(branchNotTaken));
+}
+
+void writeLcov(std::ostream &output, const Coverage &coverage, const std::string &path, const LineTable &lines,
+               const PagedMemory &program)
+{
+    // Lines in order, ran when any of their instructions did
+    std::map<u32, bool> executedLines;
+    u32 branches = 0;
+    u32 branchesHit = 0;
+
+    output << "TN:\nSF:" << path << "\n";
+
+    for (const auto &entry : lines) {
+        bool executed = coverage.wasExecuted(entry.first);
+        executedLines[entry.second] |= executed;
+
+        if (!isConditionalBranch(program.readWord(entry.first)))
+            continue;
+
+        // Branch 0 goes to the target, 1 falls through, - marks both while
+        // the branch never ran
+        bool ways[] = {coverage.wasTaken(entry.first), coverage.wasNotTaken(entry.first)};
+
+        for (int way = 0; way < 2; way++) {
+            output << "BRDA:" << entry.second << "," << entry.first << "," << way << ",";
+
+            if (executed)
+                output << ways[way] << "\n";
+            else
+                output << "-\n";
+
+            branches++;
+            branchesHit += ways[way];
+        }
+    }
+
+    output << "BRF:" << branches << "\nBRH:" << branchesHit << "\n";
+
+    u32 linesHit = 0;
+
+    for (const auto &line : executedLines) {
+        output << "DA:" << line.first << "," << line.second << "\n";
+        linesHit += line.second;
+    }
+
+    output << "LF:" << executedLines.size() << "\nLH:" << linesHit << "\nend_of_record\n";
+}
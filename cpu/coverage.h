@@ -0,0 +1,60 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include "assembler/defs.h"
+#include <cpu/pagedmemory.h>
+
+#include <ostream>
+#include <string>
+
+//// Which instructions ran and which ways the conditional branches went,
+//// one bit per word address each, instructions at odd addresses counting
+//// at the word address below. The core sets the bits while
+//// CpuCore::setCoverage() has it. Bits only ever get set, runs of a test
+//// suite can share one or be merged
+class Coverage
+{
+public:
+    Coverage();
+
+    //// An instruction at address ran
+    void instruction(u16 address) { executed[address >> 7] |= bit(address); }
+
+    //// The conditional branch at address went to its target or not
+    void branch(u16 address, bool taken)
+    {
+        (taken ? branchTaken : branchNotTaken)[address >> 7] |= bit(address);
+    }
+
+    bool wasExecuted(u16 address) const { return executed[address >> 7] & bit(address); }
+    bool wasTaken(u16 address) const { return branchTaken[address >> 7] & bit(address); }
+    bool wasNotTaken(u16 address) const { return branchNotTaken[address >> 7] & bit(address); }
+
+    //// Word addresses with an instruction that ran
+    u32 getExecutedCount() const;
+
+    //// Adds the bits of other
+    void merge(const Coverage &other);
+
+    void clear();
+
+private:
+    static u64 bit(u16 address) { return 1ull << (address >> 1 & 63); }
+
+    static const size_t words = 1 << 9;
+
+    u64 executed[words];
+    u64 branchTaken[words];
+    u64 branchNotTaken[words];
+};
+
+//// Writes an lcov tracefile record for the source at path, with a DA line
+//// per source line of lines and BRDA lines for both ways of the
+//// conditional branches among them, which program, the memory the source
+//// was assembled into, tells apart. Branches are numbered by their
+//// address. Bitmaps count every line and branch that ran once. Records of
+//// several sources can follow each other in one file
+void writeLcov(std::ostream &output, const Coverage &coverage, const std::string &path, const LineTable &lines,
+               const PagedMemory &program);
+
+#endif // COVERAGE_H
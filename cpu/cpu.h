@@ -2,47 +2,219 @@
 #define CPU_H
 
 #include <QObject>
+#include <QThread>
 #include "assembler/defs.h"
-#include <cgb/cgb.h>
-
-enum AddressingModes {
-       AM = 0x0,
-       AD = 0x1,
-       AI = 0x2,
-       AX = 0x3
-   };
-
-enum class InstructionClass {
-    b1,
-    b2,
-    b3,
-    b4
+#include <cpu/cpucore.h>
+
+class Cpu;
+class CpuWorker;
+
+enum class CpuStatus {
+    //// Waiting for a command, the only status in which Cpu::step() works
+    paused,
+    running,
+    //// Running, but stopped at wait until an interrupt arrives
+    waiting,
+    halted
+};
+
+//// State the execution thread hands to the GUI thread after a command
+//// and once per display frame while running
+struct CpuSnapshot
+{
+    CpuStatus status = CpuStatus::paused;
+    QString reason;
+    u64 impulseCount = 0;
+    JitStatistics jitStatistics = {};
+    CpuRegisters registers = {};
+
+    // Taken while running or when a run ended. No datapath signals led up
+    // to it, the views show it as a whole
+    bool frame = false;
+
+    // Memory written since the previous snapshot, bytes holds the contents
+    // of the ranges one after the other
+    std::vector<MemoryRange> ranges;
+    std::vector<u8> bytes;
+
+    // Interrupt requests logged since the previous snapshot, after the
+    // first interruptsKept entries of its log. Going back in the history
+    // keeps fewer of them than the previous snapshot had
+    size_t interruptsKept = 0;
+    std::vector<u64> interrupts;
+
+    // Paused by a breakpoint
+    bool breakpoint = false;
+
+    // The access that paused at a watchpoint, empty otherwise
+    QString watchpoint;
 };
 
+Q_DECLARE_METATYPE(CpuSnapshot)
+Q_DECLARE_METATYPE(JitMode)
+Q_DECLARE_METATYPE(std::vector<u64>)
+
+//// Forwards the datapath commands of the core as the signals of a Cpu
+class CpuSignalObserver
+{
+public:
+    static const bool showsFlags = true;
+    static const bool showsMemory = true;
+    static const bool recordsImpulses = false;
+
+    explicit CpuSignalObserver(Cpu *cpu = nullptr, CpuWorker *worker = nullptr);
+
+    void PdPCD(bool active);
+    void PdPCS(bool active);
+    void ALU(bool active, bool source, bool destination, const char *operation = "ALU");
+    void PdALU(bool active);
+    void PmADR(bool active, u16 value = 0);
+    void RD(bool active, const char *operation = "MEMORY");
+    void PmIR(bool active, u16 value = 0);
+    void PCchanged(bool active, u16 value = 0);
+    void PmT(bool active, u16 value = 0);
+    void PmMDR(bool active, u16 value = 0, bool fromBUS = false);
+    void PdRGS(bool active);
+    void PdRGD(bool active);
+    void PdMDRS(bool active);
+    void PdMDRD(bool active);
+    void PdTS(bool active);
+    void PmRG(bool active, u8 index = 17, u16 value = 0);
+    void WR(bool active, const char *operation = "MEMORY");
+    void PmFLAG(bool active, u16 value = 0, bool fromBUS = false);
+    void PmPC(bool active, u16 value = 0);
+    void PmMem(const std::vector<MemoryRange> &ranges);
+    void PmSBUS(bool active);
+    void PdSPS(bool active);
+    void SPchanged(bool active, u16 value = 0);
+    void PdFLAGS(bool active);
+    void PdIVRS(bool active);
+    void loadIVR(bool active, u16 value = 0);
+
+    void log(const char *message);
+    void impulseDone(const CpuImpulse &) {}
+
+private:
+    Cpu *cpu;
+    CpuWorker *worker;
+};
+
+extern template class CpuCore<CpuSignalObserver>;
+
+//// Runs a CpuCore on a thread of its own. The methods only queue commands
+//// for that thread and return at once, the GUI learns their outcome from
+//// the datapath signals and from statusChanged(). Everything else is read
+//// from the latest snapshot
+
 class Cpu : public QObject
 {
     Q_OBJECT
 public:
     explicit Cpu(QObject *parent = nullptr);
+    ~Cpu();
 
-    void initializeRegisters();
+    //// Memory as of the latest snapshot
     std::vector<u8> getMemory();
 
-    //// Executes next impulse
-    bool advance();
+    //// Read-only view of memory as of the latest snapshot, without a
+    //// copy. Stays valid for the lifetime of the Cpu, PmMem reports the
+    //// ranges that change
+    const std::vector<u8> &getMemoryView();
+
+    //// Executes next impulse while paused
+    void step();
+
+    //// Goes back one impulse while paused, or out of a halt the program
+    //// ran into
+    void stepBack();
+
+    //// Memory kept for stepBack(), 0 keeps none
+    void setHistorySize(int megabytes);
+
+    //// Executes whole instructions without CGB impulse bookkeeping until
+    //// the processor halts or pause() or stop() is called. Keeps running
+    //// through wait, interrupts are accepted at any time
+    void run();
+
+    //// Stops running at the next instruction boundary
+    void pause();
+
+    //// Ends the simulation, the processor halts
+    void stop();
+
+    //// Selects how run() executes. JitMode::on falls back to the
+    //// interpreter where translation is not available
+    void setJitMode(JitMode mode);
+
+    //// Frames shown per second while running. A frame the GUI has not
+    //// applied yet absorbs the ones after it
+    void setFrameRate(int framesPerSecond);
+
+    CpuStatus getStatus();
+
+    //// Instructions run since setJitMode(), and how many of them ran in
+    //// superblocks
+    JitStatistics getJitStatistics();
+
+    //// Impulses executed so far, by step() and run() alike
+    u64 getImpulseCount();
+
+    bool isHalted();
+
+    //// Emits the value of every register so that the views catch up
+    void publishState();
 
     //// Contains the reason for halting
     QString getReason();
 
     //// Resets all cpuwindow activated components
     void resetActivatedSignals();
+
+    //// Requests an interrupt. The core logs the impulse count at which
+    //// it arrives
     void setInterrupt();
 
+    //// Impulse counts of the interrupt requests as of the latest
+    //// snapshot, replayed ones included
+    std::vector<u64> getInterruptLog();
+
+    //// Requests interrupts at the impulse counts of a log, exactly where
+    //// they arrived in the run that logged it
+    void replayInterrupts(const std::vector<u64> &impulses);
+
+    //// Pauses run() before the instruction at address whenever condition
+    //// holds, see BreakpointCondition. Throws std::invalid_argument if
+    //// address is odd or the condition does not compile
+    void setBreakpoint(u16 address, const QString &condition);
+    void clearBreakpoints();
+
+    //// Whether run() paused at a breakpoint, as of the latest snapshot
+    bool atBreakpoint();
+
+    //// Pauses run() after the instruction that accesses any of length
+    //// bytes from address, as the WatchAccess bits of access say
+    void setWatchpoint(u16 address, u32 length, u8 access);
+    void clearWatchpoints();
+
+    //// The access run() paused at a watchpoint for, as of the latest
+    //// snapshot, empty if it did not
+    QString getWatchpoint();
+
+    //// Replaces the machine state with one written by
+    //// CpuCore::saveState(), unless running. Pauses, or halts if the
+    //// state is halted
+    void restoreState(const std::vector<u8> &state);
+
 public slots:
     void setMachineCodeInMemory(u8 *data, size_t size);
 
 signals:
     void memoryChanged();
+    void statusChanged(CpuStatus status);
+
+    //// State of a run, at most once per frame. Replaces the datapath
+    //// signals, which are only emitted while stepping
+    void frameReady(const CpuSnapshot &snapshot);
 
     // Commands
     void PdPCD(bool active);
@@ -64,7 +236,7 @@ signals:
     void WR(bool active, QString operation = "MEMORY");
     void PmFLAG(bool active, u16 value = 0, bool fromBUS = false);
     void PmPC(bool active, u16 value = 0);
-    void PmMem(std::vector<u8> mem);
+    void PmMem(const std::vector<MemoryRange> &ranges);
     void PmSBUS(bool active);
     void PdSPS(bool active);
     void SPchanged(bool active, u16 value = 0);
@@ -73,112 +245,16 @@ signals:
     void loadIVR(bool active, u16 value = 0);
 
 private:
-    // Phases
-    void instructionFetch();
-    void operandFetch();
-    void execute();
-    void interrupt();
-
-    /* instructions */
-    // b1 class
-    void mov();
-    void add();
-    void sub();
-    void cmp();
-    void AND();
-    void OR();
-    void XOR();
-
-    // b2 class
-    void clr();
-    void neg();
-    void inc();
-    void dec();
-    void asl();
-    void asr();
-    void lsr();
-    void rol();
-    void ror();
-    void rlc();
-    void rrc();
-    void jmp();
-    void call();
-    void pushRi();
-    void popRi();
-
-    // b3 class
-    void br();
-    void bne();
-    void beq();
-    void bpl();
-    void bcs();
-    void bcc();
-    void bvs();
-    void bvc();
-
-    // b4 class
-    void clc();
-    void clv();
-    void clz();
-    void cls();
-    void ccc();
-    void sec();
-    void sev();
-    void sez();
-    void ses();
-    void scc();
-    void nop();
-    void ret();
-    void reti();
-    void uhalt();
-    void wait();
-    void pushpc();
-    void poppc();
-    void pushflag();
-    void popflag();
-
-    /* Memory */
-    std::vector<u8> memory;
+    void applySnapshot(const CpuSnapshot &snapshot);
 
-    /* Buses */
-    u16 SBUS; // Source Bus
-    u16 DBUS; // Destination Bus
-    u16 RBUS; // Result Bus
-
-    /* Registers */
-    u16 FLAG; // Flag Register
-
-    u16 R[16]; // General Registers
-    u16 PC;    // Program Counter
-    u16 SP;    // Stack Pointer
-    u16 T;     // Tampon Register
-
-    u16 IR;  // Instruction Register
-    u16 MDR; // Memory Data Register
-    u16 ADR; // Address Register
-    u16 IVR; // Interrupt Vector Register
-
-    /* Command generator block */
-    CGB *cgb;
-
-    /* misc */
-    void decideNextPhase();
-    void setC(bool value);
-    void setZ();
-    void setS();
-    void setV(bool isAdding);
-    bool checkC(bool isAdding);
-    bool checkZ();
-    bool checkS();
-    bool checkV(bool isAdding);
-
-    int mas;
-    int mad;
-    InstructionClass instructionClass;
-    bool intr;
-
-    bool halt;
-    QString reason;
+    QThread thread;
+    CpuWorker *worker;
+
+    CpuSnapshot snapshot;
+    // Updated from the snapshots, the core's memory belongs to the
+    // execution thread
+    std::vector<u8> memory;
+    std::vector<u64> interruptLog;
 };
 
 #endif // CPU_H
@@ -0,0 +1,34 @@
+#include <cpu/cpucoreimpl.h>
+
+#include "assembler/encoding.h"
+
+template class CpuCore<NullCpuObserver>;
+
+namespace {
+
+constexpr void fillOperations(OperationTable &table, OpcodeField field, Operation first)
+{
+    for (int opcode = 0; opcode < field.count; opcode++) {
+        int begin = field.base + (opcode << field.shift);
+        int end = field.base + ((opcode + 1) << field.shift);
+
+        for (int ir = begin; ir < end; ir++)
+            table.operation[ir] = Operation(u8(first) + opcode);
+    }
+}
+
+constexpr OperationTable buildOperationTable()
+{
+    OperationTable table {};
+
+    fillOperations(table, b1Opcodes, Operation::mov);
+    fillOperations(table, b2Opcodes, Operation::clr);
+    fillOperations(table, b3Opcodes, Operation::br);
+    fillOperations(table, b4Opcodes, Operation::clc);
+
+    return table;
+}
+
+}
+
+constexpr OperationTable operationTable = buildOperationTable();
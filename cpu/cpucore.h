@@ -0,0 +1,668 @@
+#ifndef CPUCORE_H
+#define CPUCORE_H
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "assembler/defs.h"
+#include <cgb/cgb.h>
+#include <cpu/breakpoint.h>
+#include <cpu/coverage.h>
+#include <cpu/jit.h>
+#include <cpu/pagedmemory.h>
+#include <cpu/profiler.h>
+#include <cpu/statefile.h>
+#include <cpu/trace.h>
+
+enum AddressingModes {
+       AM = 0x0,
+       AD = 0x1,
+       AI = 0x2,
+       AX = 0x3
+   };
+
+enum class InstructionClass {
+    b1,
+    b2,
+    b3,
+    b4
+};
+
+//// Instruction handlers of the instruction granular engine, named after
+//// the impulse level methods of CpuCore
+enum class Operation : u8 {
+    illegal,
+    // b1 class
+    mov, add, sub, cmp, AND, OR, XOR,
+    // b2 class
+    clr, neg, inc, dec, asl, asr, lsr, rol, ror, rlc, rrc, jmp, call, pushRi, popRi,
+    // b3 class
+    br, bne, beq, bpl, bcs, bcc, bvs, bvc,
+    // b4 class
+    clc, clv, clz, cls, ccc, sec, sev, sez, ses, scc, nop, ret, reti, uhalt, wait,
+    pushpc, poppc, pushflag, popflag
+};
+
+//// Flag producing operation whose C, Z, S and V are only computed when
+//// FLAG is read
+enum class FlagOperation : u8 {
+    none,
+    add,
+    subtract, // sub and cmp
+    increment,
+    decrement
+};
+
+//// FLAG after a deferred operation. add, sub, cmp, inc and dec set every
+//// one of C, Z, S and V and always clear at least one of them, which
+//// clears bits 4 to 15 as well. So FLAG only depends on the operation
+inline u16 deferredFlagValue(FlagOperation operation, u16 source, u16 destination, u16 result)
+{
+    u16 sign = result >> 15;
+    u16 carry;
+    u16 overflow;
+
+    switch (operation) {
+    case FlagOperation::add:
+        carry = result < destination;
+        overflow = !(((u16)(source + 1) ^ destination) >> 15) && (sign ^ carry);
+        break;
+    case FlagOperation::subtract:
+        // C is bit 15 of the sum, which makes V always clear
+        carry = sign;
+        overflow = 0;
+        break;
+    case FlagOperation::increment:
+        // the carry of inc is computed without its Cin
+        carry = 0;
+        overflow = !(destination >> 15) && sign;
+        break;
+    default:
+        carry = destination >> 15;
+        overflow = carry && !sign;
+        break;
+    }
+
+    return (carry << 3) | ((result == 0) << 2) | (sign << 1) | overflow;
+}
+
+//// Bytes of memory written since the last PmMem notification
+struct MemoryRange
+{
+    u16 address;
+    u32 length;
+};
+
+//// Registers of the processor as the views show them
+struct CpuRegisters
+{
+    u16 R[16];
+    u16 PC;
+    u16 SP;
+    u16 FLAG;
+    u16 T;
+    u16 IR;
+    u16 MDR;
+    u16 ADR;
+    u16 IVR;
+};
+
+//// Predecoded instruction, cached per word address
+struct DecodedInstruction
+{
+    u16 IR;
+    u16 sourceWord;      // immediate or index word of mas, branch offset for b3
+    u16 destinationWord; // immediate or index word of mad
+    Operation operation;
+    u8 source;           // source register index
+    u8 destination;      // destination register index
+    u8 mas;
+    u8 mad;
+    u8 length;           // in words, 0 while the entry is not decoded
+    u8 impulses;         // IF + OF + EX impulses
+    u8 operandImpulses;  // IF + OF impulses
+};
+
+//// State of a core to step backwards from. The memory pages stay shared
+//// with the core and the other checkpoints until one of them writes
+struct CpuCheckpoint
+{
+    StateFileHeader state; // everything but memory
+    PagedMemory memory;
+    size_t interrupts;     // entries of the interrupt log made before
+};
+
+//// Operation of every IR value, illegal where IF raises CIL. Built at
+//// compile time from the opcode layout in encoding.h
+struct OperationTable
+{
+    Operation operation[1 << 16];
+};
+
+extern const OperationTable operationTable;
+
+//// An impulse as observers that record waveforms see it: the CGB phase
+//// and impulse it ran in, and the buses, ADR and MDR after it
+struct CpuImpulse
+{
+    u64 impulseCount; // after it
+    Phase phase;
+    u8 impulse;
+    u16 SBUS;
+    u16 DBUS;
+    u16 RBUS;
+    u16 ADR;
+    u16 MDR;
+};
+
+//// Accesses a watchpoint stops at, as bits
+enum WatchAccess : u8 {
+    watchRead = 1,
+    watchWrite = 2
+};
+
+//// Bytes of memory watched for the accesses in access
+struct Watchpoint
+{
+    u16 address;
+    u32 length;
+    u8 access;
+};
+
+//// Memory access that stopped a run at a watchpoint
+struct WatchpointHit
+{
+    u16 address;     // of the word accessed
+    bool write;
+    u16 oldValue;    // the value read, for reads
+    u16 newValue;
+    bool interrupt;  // made by an interrupt entry, not an instruction
+    u16 instruction; // its start, the return address for interrupt entries
+    u64 impulse;     // impulse count after the impulse that accessed memory
+};
+
+//// Observer that ignores every notification. CpuCore<NullCpuObserver>
+//// compiles all of them away, which is what headless runs use
+struct NullCpuObserver
+{
+    // Deferred flags are evaluated for the notifications of observers
+    // that show FLAG, written memory is only tracked for observers that
+    // show memory
+    static const bool showsFlags = false;
+    static const bool showsMemory = false;
+
+    // impulseDone() is only called for observers that record impulses
+    static const bool recordsImpulses = false;
+
+    // Commands
+    void PdPCD(bool) {}
+    void PdPCS(bool) {}
+    void ALU(bool, bool, bool, const char * = "ALU") {}
+    void PdALU(bool) {}
+    void PmADR(bool, u16 = 0) {}
+    void RD(bool, const char * = "MEMORY") {}
+    void PmIR(bool, u16 = 0) {}
+    void PCchanged(bool, u16 = 0) {}
+    void PmT(bool, u16 = 0) {}
+    void PmMDR(bool, u16 = 0, bool = false) {}
+    void PdRGS(bool) {}
+    void PdRGD(bool) {}
+    void PdMDRS(bool) {}
+    void PdMDRD(bool) {}
+    void PdTS(bool) {}
+    void PmRG(bool, u8 = 17, u16 = 0) {}
+    void WR(bool, const char * = "MEMORY") {}
+    void PmFLAG(bool, u16 = 0, bool = false) {}
+    void PmPC(bool, u16 = 0) {}
+    void PmMem(const std::vector<MemoryRange> &) {}
+    void PmSBUS(bool) {}
+    void PdSPS(bool) {}
+    void SPchanged(bool, u16 = 0) {}
+    void PdFLAGS(bool) {}
+    void PdIVRS(bool) {}
+    void loadIVR(bool, u16 = 0) {}
+
+    // Impulse level debug messages
+    void log(const char *) {}
+
+    // End of an impulse run by advance()
+    void impulseDone(const CpuImpulse &) {}
+};
+
+//// Registers, buses, memory and CGB state of the simulated processor.
+//// Every datapath command is reported to the Observer policy, which has
+//// the same interface as NullCpuObserver
+template <class Observer>
+class CpuCore
+{
+public:
+    //// More impulses than any instruction takes, the INT phase after it
+    //// included
+    static const u64 maxInstructionImpulses = 64;
+
+    explicit CpuCore(Observer observer = Observer());
+
+    //// Forks the core. Memory pages stay shared until one of the two
+    //// writes them, decoded and translated instructions are rebuilt as
+    //// the fork runs
+    CpuCore(const CpuCore &other);
+
+    CpuCore &operator=(const CpuCore &) = delete;
+
+    void initializeRegisters();
+    std::vector<u8> getMemory();
+
+    //// Read-only view of memory, without a copy. Stays valid for the
+    //// lifetime of the core, PmMem reports the ranges that change
+    const PagedMemory &getMemoryView();
+
+    //// Executes next impulse
+    bool advance();
+
+    //// Whether the last advance() completed an instruction, which the
+    //// impulses of interrupt entries and of halt do not
+    bool completedInstruction();
+
+    //// Runs advance() up to the next instruction boundary, from where a
+    //// replayed interrupt arrives at its exact impulse. A wait skips
+    //// ahead to the next replayed interrupt. Returns the number of
+    //// instructions completed, 0 for an interrupt entry and, without
+    //// running an impulse, for a wait with no interrupt to come
+    u64 stepInstruction();
+
+    //// Executes up to count whole instructions without CGB impulse
+    //// bookkeeping or notifications. Stops early on halt or on wait without
+    //// a pending interrupt. Returns the number of instructions completed.
+    //// Instructions close to a replayed interrupt run impulse by impulse
+    u64 runInstructions(u64 count);
+
+    //// Selects how runInstructions() executes. JitMode::on falls back to
+    //// the interpreter where translation is not available
+    void setJitMode(JitMode mode);
+
+    //// Instructions run by runInstructions() since setJitMode(), and how
+    //// many of them ran in superblocks
+    JitStatistics getJitStatistics();
+
+    //// Impulses executed so far, by advance() and runInstructions() alike
+    u64 getImpulseCount();
+
+    //// Current register values, FLAG included, without notifications
+    CpuRegisters getRegisters();
+
+    //// Replaces the register values, without notifications. Meant for
+    //// the boundary between two instructions, like the start of a run
+    void setRegisters(const CpuRegisters &registers);
+
+    //// Writes length bytes from address on, the way stores of the program
+    //// do, wrapping around at 0xffff
+    void writeMemory(u16 address, const u8 *data, u32 length);
+
+    //// Complete machine state in the state file format of statefile.h,
+    //// memory included. Decoded and translated code is left out
+    std::vector<u8> saveState();
+
+    //// Restores a state written by saveState(), straight from a mapped
+    //// file for example. Returns false, leaving the core as it was, if
+    //// data is not a state of a version this build reads
+    bool restoreState(const u8 *data, size_t size);
+
+    bool isHalted();
+
+    //// Contains the reason for halting
+    std::string getReason();
+
+    //// Resets all cpuwindow activated components
+    void resetActivatedSignals();
+
+    //// Reports the value of every register so that the views catch up
+    //// after runInstructions()
+    void publishState();
+
+    //// Reports the ranges written since the last PmMem, and nothing else
+    void publishMemory();
+
+    //// Keeps a checkpoint every interval instructions, the newest capacity
+    //// of them, starting with one of the current state. Steps backwards
+    //// go back to a checkpoint and run forward again, replaying the
+    //// interrupts that arrived meanwhile. A checkpoint costs at most the
+    //// 64 KiB of memory written since the one before it. A capacity of 0
+    //// keeps none
+    void setHistory(size_t capacity, u64 interval);
+
+    //// Returns to the impulse count impulse, which lies between the
+    //// oldest checkpoint and now. False if it does not
+    bool rewind(u64 impulse);
+
+    //// One impulse back
+    bool stepBack();
+
+    //// Back to the latest instruction boundary before now, the start of
+    //// the current instruction when stopped inside it
+    bool stepBackInstruction();
+
+    //// Back to the latest instruction start before now at which stop
+    //// holds, or to the oldest checkpoint if there is none. Returns
+    //// whether stop held
+    bool reverseContinue(const std::function<bool(const CpuRegisters &)> &stop);
+
+    //// Requests an interrupt and logs the impulse count it arrived at
+    void setInterrupt();
+
+    //// Impulse counts of the setInterrupt() calls so far, replayed ones
+    //// included, in order
+    const std::vector<u64> &getInterruptLog();
+
+    //// Calls setInterrupt() once the impulse count reaches each of
+    //// impulses, which are ascending, right before the next impulse runs.
+    //// A run that replays the log of another one from the same state
+    //// repeats it exactly. wait skips ahead to the next request instead of
+    //// stopping the run
+    void replayInterrupts(const std::vector<u64> &impulses);
+
+    //// Runs forward until the impulse count reaches impulse or the
+    //// processor halts, taking no checkpoints and recording nothing. A
+    //// wait without a replayed interrupt to come waits out the impulses
+    //// up to impulse. The requests replayed at impulse arrive after it
+    void runTo(u64 impulse);
+
+    //// Records every instruction and interrupt entry completed from now on
+    //// into writer, which stays with the caller, until setTrace(nullptr),
+    //// with the interrupt requests and a keyframe of the current state
+    //// and further ones whenever writer asks for them. runInstructions()
+    //// interprets while tracing, instead of running translated code. What
+    //// steps backwards run again is not recorded
+    void setTrace(TraceWriter *writer);
+
+    //// Counts every instruction and interrupt entry completed from now on
+    //// in profiler, which stays with the caller, until
+    //// setProfiler(nullptr). runInstructions() interprets while
+    //// profiling, instead of running translated code. What steps
+    //// backwards run again is not counted.
+    ////
+    //// Sampling profilers only get their samples and the calls, returns
+    //// and interrupt entries, and leave translated code on. Calls and
+    //// returns inside translated code go unseen, so while it runs the
+    //// samples only carry the interrupt handlers as call stack
+    void setProfiler(Profiler *profiler);
+
+    //// Sets the bits of every instruction that starts from now on and of
+    //// the ways its conditional branches go in coverage, which stays with
+    //// the caller, until setCoverage(nullptr). The interpreter notes an
+    //// instruction once when it decodes it and caches it, and runs
+    //// without coverage pay nothing for it. runInstructions() interprets
+    //// while covering, instead of running translated code
+    void setCoverage(Coverage *coverage);
+
+    //// Stops runInstructions() before the instruction at address, which
+    //// is even like every instruction start, whenever condition holds
+    //// there, replacing the breakpoint the address had.
+    //// The interpreter tests one bit per word address, and only for
+    //// instructions it has not cached, which breakpoints never are.
+    //// Translated code leaves the instructions at breakpoints to it
+    void setBreakpoint(u16 address, const BreakpointCondition &condition = BreakpointCondition());
+    void clearBreakpoint(u16 address);
+    void clearBreakpoints();
+
+    //// Whether the last runInstructions() stopped at a breakpoint, before
+    //// the instruction at PC. The next run starts with that instruction
+    bool atBreakpoint();
+
+    //// Stops runInstructions() after the instruction or interrupt entry
+    //// that reads or writes, as the WatchAccess bits of access say, any of
+    //// the length bytes from address on. Operands and the stack are
+    //// watched, instruction words are not. Accesses to pages without
+    //// watchpoints only pay a test of the page. While reads are watched
+    //// runInstructions() interprets, translated stores into watched bytes
+    //// leave to the interpreter
+    void setWatchpoint(u16 address, u32 length, u8 access);
+    void clearWatchpoints();
+
+    //// Whether the last runInstructions() stopped at a watchpoint, and the
+    //// first access to watched memory it made
+    bool atWatchpoint();
+    WatchpointHit getWatchpointHit();
+
+    void setMachineCodeInMemory(u8 *data, size_t size);
+
+private:
+    // Phases
+    void instructionFetch();
+    void operandFetch();
+    void execute();
+    void interrupt();
+
+    // Instruction granular engine
+    u64 runUnscheduled(u64 count);
+    u64 runEngine(u64 count);
+    u64 interpret(u64 count);
+    template <bool watched, bool covered> u64 interpretInstructions(u64 count);
+    bool atInstructionBoundary();
+    bool isWaiting();
+    void interruptInstruction();
+    void profile(u16 address, Operation operation, u64 impulses);
+    template <bool covered> void takeBranch(u16 address, bool taken, u16 offset);
+    bool branchCondition(Operation operation);
+    bool followsCalls();
+    bool hasBreakpoint(u16 address);
+    bool breakpointAt(u16 address);
+    DecodedInstruction decode(u16 address);
+    void invalidateDecoded(u16 address);
+    u16 readWord(u16 address);
+    // Data accesses, which watchpoints see unless watched is false.
+    // impulse counts from the start of the instruction or interrupt entry
+    // to the one that makes the access, the impulse engine passes 0 as its
+    // count already includes it
+    template <bool watched = true> u16 readData(u16 address, u8 impulse = 0);
+    template <bool watched = true> void writeWord(u16 address, u16 value, u8 impulse = 0);
+    void watchAccess(u16 address, bool write, u16 oldValue, u16 newValue, u8 impulse);
+    void watchPages();
+    void protectWatchpoints();
+    void latchResult(const DecodedInstruction &d, u16 result);
+    void markDirty(u16 address, u32 length);
+    void applyFlag(u16 bit, bool value);
+
+    // State as in a state file
+    void saveRegisters(StateFileHeader &state);
+    void restoreRegisters(const StateFileHeader &state);
+    void memoryReplaced();
+
+    // Reverse execution
+    void resetHistory();
+    void takeCheckpoint();
+    void restoreCheckpoint(size_t index);
+    void replayTo(u64 impulse);
+    bool findInHistory(u64 before, const std::function<bool(const CpuRegisters &)> &stop, u64 &found);
+
+    // Translated execution
+    u64 runTranslated(u64 count);
+    const u8 *translate(u16 address, bool superblock);
+    void flushTranslations();
+    bool checkTranslation(u16 block, const JitState &state, const std::vector<u8> &translatedMemory);
+
+    /* instructions */
+    void undefined();
+
+    // b1 class
+    void mov();
+    void add();
+    void sub();
+    void cmp();
+    void AND();
+    void OR();
+    void XOR();
+
+    // b2 class
+    void clr();
+    void neg();
+    void inc();
+    void dec();
+    void asl();
+    void asr();
+    void lsr();
+    void rol();
+    void ror();
+    void rlc();
+    void rrc();
+    void jmp();
+    void call();
+    void pushRi();
+    void popRi();
+
+    // b3 class
+    void br();
+    void bne();
+    void beq();
+    void bpl();
+    void bcs();
+    void bcc();
+    void bvs();
+    void bvc();
+
+    // b4 class
+    void clc();
+    void clv();
+    void clz();
+    void cls();
+    void ccc();
+    void sec();
+    void sev();
+    void sez();
+    void ses();
+    void scc();
+    void nop();
+    void ret();
+    void reti();
+    void uhalt();
+    void wait();
+    void pushpc();
+    void poppc();
+    void pushflag();
+    void popflag();
+
+    Observer observer;
+
+    /* Memory */
+    PagedMemory memory;
+
+    // Written since the last PmMem notification, sent once per impulse
+    // or publishState()
+    static const size_t maxDirtyRanges = 32;
+    std::vector<MemoryRange> dirtyRanges;
+
+    // Filled lazily by runInstructions(), one entry per word address
+    std::vector<DecodedInstruction> decoded;
+    // 256 byte pages holding decoded instructions, stores elsewhere skip
+    // the invalidation
+    bool codePages[256];
+
+    std::unique_ptr<Jit> jit;
+    JitMode jitMode;
+    JitStatistics jitStatistics;
+
+    /* Buses */
+    u16 SBUS; // Source Bus
+    u16 DBUS; // Destination Bus
+    u16 RBUS; // Result Bus
+
+    /* Registers */
+    u16 FLAG; // Flag Register
+
+    FlagOperation flagOperation;
+    u16 flagSource;      // T, or the constant of inc and dec
+    u16 flagDestination; // MDR before the operation
+    u16 flagResult;
+
+    u16 R[16]; // General Registers
+    u16 PC;    // Program Counter
+    u16 SP;    // Stack Pointer
+    u16 T;     // Tampon Register
+
+    u16 IR;  // Instruction Register
+    u16 MDR; // Memory Data Register
+    u16 ADR; // Address Register
+    u16 IVR; // Interrupt Vector Register
+
+    /* Command generator block */
+    CGB cgb;
+
+    /* misc */
+    void decideNextPhase();
+    void setC(bool value);
+    void setZ();
+    void setS();
+    bool checkZ();
+    bool checkS();
+
+    // Deferred flags. FLAG is stale while flagOperation is not none, every
+    // read goes through evaluateFlags() or testFlag()
+    void deferFlags(FlagOperation operation, u16 source, u16 destination, u16 result);
+    u16 deferredFlags();
+    u16 evaluateFlags();
+    void setFlags(u16 value);
+    bool testFlag(u16 bit);
+    u16 observedFlags();
+
+    int mas;
+    int mad;
+    InstructionClass instructionClass;
+    bool intr;
+
+    // Interrupt record and replay
+    static const u64 noInterrupt = ~0ull;
+    void requestScheduledInterrupts();
+    std::vector<u64> interruptLog;
+    std::vector<u64> scheduledInterrupts;
+    size_t nextInterrupt;
+    u64 interruptDue; // scheduledInterrupts[nextInterrupt], or noInterrupt
+
+    // Oldest first, empty while historyCapacity is 0
+    std::deque<CpuCheckpoint> checkpoints;
+    size_t historyCapacity;
+    u64 historyInterval;
+    u64 historyInstructions; // completed since the newest checkpoint
+    bool instructionCompleted; // by the last advance()
+    // Running forward from a checkpoint, which takes no checkpoints and
+    // leaves blocking wait instructions to the caller
+    bool replaying;
+
+    // Tracing, off while null
+    TraceWriter *trace;
+    u16 tracePC; // start of the instruction advance() is in
+
+    // Profiling, off while null
+    Profiler *profiler;
+    bool sampling;        // profiler samples
+    u64 instructionStart; // impulse count at tracePC
+
+    // Coverage, off while null
+    Coverage *coverage;
+
+    // Breakpoints, with one bit per word address set while there is one at
+    // either of its bytes
+    std::map<u16, BreakpointCondition> breakpoints;
+    u64 breakpointWords[1 << 9];
+    bool breakpointHit;
+    u64 resumeImpulse; // of the last stop, which the next run passes
+
+    // Watchpoints, with the WatchAccess bits of those a word access at each
+    // page can touch
+    std::vector<Watchpoint> watchpoints;
+    u8 watchedPages[256];
+    bool watchesReads;
+    bool watchpointHit;
+    WatchpointHit watchedAccess; // the first one, while watchpointHit
+
+    bool halt;
+    std::string reason;
+
+    u64 impulseCount;
+};
+
+extern template class CpuCore<NullCpuObserver>;
+
+#endif // CPUCORE_H
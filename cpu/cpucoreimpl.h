@@ -0,0 +1,4596 @@
+#ifndef CPUCOREIMPL_H
+#define CPUCOREIMPL_H
+
+//// Member definitions of CpuCore. Only included by the translation units
+//// that explicitly instantiate CpuCore for an observer
+
+#include <cpu/cpucore.h>
+#include <cpu/statefile.h>
+
+#include <algorithm>
+#include <bitset>
+#include <cstdio>
+#include <cstring>
+
+
+template <class Observer>
+CpuCore<Observer>::CpuCore(Observer observer) : observer(observer)
+{
+    // Set RETI
+    memory.write(1000, 0x0c);
+    memory.write(1001, 0xc0);
+
+    // Clear buses
+    SBUS = 0;
+    DBUS = 0;
+    RBUS = 0;
+
+    initializeRegisters();
+
+    impulseCount = 0;
+
+    nextInterrupt = 0;
+    interruptDue = noInterrupt;
+
+    historyCapacity = 0;
+    historyInterval = 0;
+    historyInstructions = 0;
+    instructionCompleted = false;
+    replaying = false;
+
+    trace = nullptr;
+    tracePC = 0;
+
+    profiler = nullptr;
+    sampling = false;
+    instructionStart = 0;
+
+    coverage = nullptr;
+
+    memset(breakpointWords, 0, sizeof(breakpointWords));
+    breakpointHit = false;
+    resumeImpulse = ~0ull;
+
+    memset(watchedPages, 0, sizeof(watchedPages));
+    watchesReads = false;
+    watchpointHit = false;
+    watchedAccess = WatchpointHit();
+
+    memset(codePages, 0, sizeof(codePages));
+
+    jitMode = JitMode::off;
+}
+
+template <class Observer>
+CpuCore<Observer>::CpuCore(const CpuCore &other)
+    : observer(other.observer),
+      memory(other.memory),
+      dirtyRanges(other.dirtyRanges),
+      jitMode(other.jitMode),
+      jitStatistics(other.jitStatistics),
+      SBUS(other.SBUS),
+      DBUS(other.DBUS),
+      RBUS(other.RBUS),
+      FLAG(other.FLAG),
+      flagOperation(other.flagOperation),
+      flagSource(other.flagSource),
+      flagDestination(other.flagDestination),
+      flagResult(other.flagResult),
+      PC(other.PC),
+      SP(other.SP),
+      T(other.T),
+      IR(other.IR),
+      MDR(other.MDR),
+      ADR(other.ADR),
+      IVR(other.IVR),
+      cgb(other.cgb),
+      mas(other.mas),
+      mad(other.mad),
+      instructionClass(other.instructionClass),
+      intr(other.intr),
+      interruptLog(other.interruptLog),
+      scheduledInterrupts(other.scheduledInterrupts),
+      nextInterrupt(other.nextInterrupt),
+      interruptDue(other.interruptDue),
+      checkpoints(other.checkpoints),
+      historyCapacity(other.historyCapacity),
+      historyInterval(other.historyInterval),
+      historyInstructions(other.historyInstructions),
+      instructionCompleted(other.instructionCompleted),
+      replaying(false),
+      trace(nullptr),
+      tracePC(other.tracePC),
+      profiler(nullptr),
+      sampling(false),
+      instructionStart(other.instructionStart),
+      coverage(nullptr),
+      breakpoints(other.breakpoints),
+      breakpointHit(false),
+      resumeImpulse(other.resumeImpulse),
+      watchpoints(other.watchpoints),
+      watchesReads(other.watchesReads),
+      watchpointHit(false),
+      watchedAccess(other.watchedAccess),
+      halt(other.halt),
+      reason(other.reason),
+      impulseCount(other.impulseCount)
+{
+    memcpy(R, other.R, sizeof(R));
+    memcpy(breakpointWords, other.breakpointWords, sizeof(breakpointWords));
+    memcpy(watchedPages, other.watchedPages, sizeof(watchedPages));
+    memset(codePages, 0, sizeof(codePages));
+
+    // Code buffers are not shared, the fork translates again
+    if (other.jit) {
+        jit.reset(new Jit(jitMode == JitMode::on));
+        protectWatchpoints();
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::initializeRegisters()
+{
+    PC = 0;
+    IR = 0;
+    SP = 0;
+
+    T = 0;
+
+    FLAG = 0;
+    flagOperation = FlagOperation::none;
+
+    ADR = 0;
+    MDR = 0;
+    IVR = 0;
+
+    memset(R, 0, sizeof(R));
+
+    // Set by IF, but saved with every state
+    mas = 0;
+    mad = 0;
+    instructionClass = InstructionClass::b1;
+
+    // condition initialisation
+    halt = false;
+    reason = "Simulation finished!";
+
+    intr = false;
+}
+
+template <class Observer>
+bool CpuCore<Observer>::advance()
+{
+    if (impulseCount >= interruptDue)
+        requestScheduledInterrupts();
+
+    Phase phase = cgb.getPhase();
+    u8 impulse = Observer::recordsImpulses ? cgb.getImpulse() : 0;
+
+    if ((trace || profiler || coverage || !watchpoints.empty()) && atInstructionBoundary()) {
+        tracePC = PC;
+        instructionStart = impulseCount;
+
+        if (coverage && phase == Phase::IF)
+            coverage->instruction(PC);
+    }
+
+    impulseCount++;
+    resetActivatedSignals();
+    switch(phase) {
+    case Phase::IF:
+        instructionFetch();
+        break;
+
+    case Phase::OF:
+        operandFetch();
+        break;
+
+    case Phase::EX:
+        execute();
+        break;
+
+    case Phase::INT:
+        interrupt();
+        break;
+
+    default:
+        break;
+    }
+
+    publishMemory();
+
+    if (Observer::recordsImpulses)
+        observer.impulseDone({impulseCount, phase, impulse, SBUS, DBUS, RBUS, ADR, MDR});
+
+    if (trace && (phase == Phase::EX || phase == Phase::INT) && atInstructionBoundary()) {
+        trace->record(phase == Phase::INT, tracePC, IR, impulseCount, R, SP, evaluateFlags());
+
+        if (trace->keyframeDue())
+            trace->keyframe(saveState(), impulseCount);
+    }
+
+    if (profiler && (phase == Phase::EX || phase == Phase::INT) && atInstructionBoundary()) {
+        // Interrupt entries count in the handler, instructions in the
+        // frame they started in
+        u32 frame = profiler->getCurrentFrame();
+
+        if (phase == Phase::INT) {
+            profiler->interrupt(PC, impulseCount - instructionStart);
+            frame = profiler->getCurrentFrame();
+        } else {
+            profile(tracePC, operationTable.operation[IR], impulseCount - instructionStart);
+        }
+
+        if (sampling && !profiler->impulsesToSample(impulseCount))
+            profiler->sample(tracePC, impulseCount, frame);
+    }
+
+    if (coverage && phase == Phase::EX && atInstructionBoundary()) {
+        Operation operation = operationTable.operation[IR];
+
+        if (operation >= Operation::bne && operation <= Operation::bvc)
+            coverage->branch(tracePC, branchCondition(operation));
+    }
+
+    // An EX impulse that ends the instruction
+    instructionCompleted = phase == Phase::EX && atInstructionBoundary();
+
+    if (historyCapacity && instructionCompleted && ++historyInstructions >= historyInterval && !replaying)
+        takeCheckpoint();
+
+    return !halt;
+}
+
+template <class Observer>
+bool CpuCore<Observer>::completedInstruction()
+{
+    return instructionCompleted;
+}
+
+template <class Observer>
+std::string CpuCore<Observer>::getReason()
+{
+    return reason;
+}
+
+template <class Observer>
+u64 CpuCore<Observer>::getImpulseCount()
+{
+    return impulseCount;
+}
+
+template <class Observer>
+CpuRegisters CpuCore<Observer>::getRegisters()
+{
+    CpuRegisters registers;
+
+    memcpy(registers.R, R, sizeof(R));
+    registers.PC = PC;
+    registers.SP = SP;
+    registers.FLAG = evaluateFlags();
+    registers.T = T;
+    registers.IR = IR;
+    registers.MDR = MDR;
+    registers.ADR = ADR;
+    registers.IVR = IVR;
+
+    return registers;
+}
+
+template <class Observer>
+void CpuCore<Observer>::setRegisters(const CpuRegisters &registers)
+{
+    memcpy(R, registers.R, sizeof(R));
+    PC = registers.PC;
+    SP = registers.SP;
+    setFlags(registers.FLAG);
+    T = registers.T;
+    IR = registers.IR;
+    MDR = registers.MDR;
+    ADR = registers.ADR;
+    IVR = registers.IVR;
+
+    resetHistory();
+}
+
+template <class Observer>
+void CpuCore<Observer>::writeMemory(u16 address, const u8 *data, u32 length)
+{
+    for (u32 offset = 0; offset < length; offset++) {
+        u16 byteAddress = address + offset;
+
+        memory.write(byteAddress, data[offset]);
+
+        if (codePages[byteAddress >> 8])
+            invalidateDecoded(byteAddress);
+    }
+
+    markDirty(address, length);
+    resetHistory();
+}
+
+template <class Observer>
+void CpuCore<Observer>::saveRegisters(StateFileHeader &state)
+{
+    memset(&state, 0, sizeof(state));
+
+    memcpy(state.magic, stateFileMagic, sizeof(state.magic));
+    state.version = StateFileHeader::currentVersion;
+    state.pageOffset = sizeof(state);
+    state.impulseCount = impulseCount;
+
+    memcpy(state.R, R, sizeof(R));
+    state.PC = PC;
+    state.SP = SP;
+    state.FLAG = evaluateFlags();
+    state.T = T;
+    state.IR = IR;
+    state.MDR = MDR;
+    state.ADR = ADR;
+    state.IVR = IVR;
+
+    state.SBUS = SBUS;
+    state.DBUS = DBUS;
+    state.RBUS = RBUS;
+
+    state.phase = (u8)cgb.getPhase();
+    state.impulse = cgb.getImpulse();
+    state.mas = mas;
+    state.mad = mad;
+    state.instructionClass = (u8)instructionClass;
+    state.intr = intr;
+    state.halt = halt;
+    strncpy(state.reason, reason.c_str(), sizeof(state.reason) - 1);
+}
+
+template <class Observer>
+void CpuCore<Observer>::restoreRegisters(const StateFileHeader &state)
+{
+    impulseCount = state.impulseCount;
+
+    memcpy(R, state.R, sizeof(R));
+    PC = state.PC;
+    SP = state.SP;
+    setFlags(state.FLAG);
+    T = state.T;
+    IR = state.IR;
+    MDR = state.MDR;
+    ADR = state.ADR;
+    IVR = state.IVR;
+
+    SBUS = state.SBUS;
+    DBUS = state.DBUS;
+    RBUS = state.RBUS;
+
+    cgb.setPhase((Phase)state.phase);
+    cgb.setImpluse(state.impulse);
+    mas = state.mas;
+    mad = state.mad;
+    instructionClass = (InstructionClass)state.instructionClass;
+    intr = state.intr;
+    halt = state.halt;
+    reason.assign(state.reason, strnlen(state.reason, sizeof(state.reason)));
+}
+
+template <class Observer>
+void CpuCore<Observer>::memoryReplaced()
+{
+    markDirty(0, 1 << 16);
+
+    decoded.clear();
+    memset(codePages, 0, sizeof(codePages));
+
+    if (jit)
+        jit->flush();
+
+    protectWatchpoints();
+}
+
+template <class Observer>
+std::vector<u8> CpuCore<Observer>::saveState()
+{
+    StateFileHeader header;
+    saveRegisters(header);
+
+    std::vector<u8> state(sizeof(header));
+
+    for (u32 index = 0; index < PagedMemory::pageCount; index++) {
+        const u8 *page = memory.page(index);
+
+        // Zero pages are left out
+        if (std::all_of(page, page + MemoryPage::size, [](u8 byte) { return byte == 0; }))
+            continue;
+
+        header.pages[index / 8] |= 1 << (index % 8);
+        state.insert(state.end(), page, page + MemoryPage::size);
+    }
+
+    memcpy(state.data(), &header, sizeof(header));
+
+    return state;
+}
+
+template <class Observer>
+bool CpuCore<Observer>::restoreState(const u8 *data, size_t size)
+{
+    StateFileHeader header;
+
+    if (size < sizeof(header))
+        return false;
+
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, stateFileMagic, sizeof(header.magic)) != 0 ||
+        header.version != StateFileHeader::currentVersion || header.pageOffset < sizeof(header) ||
+        header.phase < (u8)Phase::IF || header.phase > (u8)Phase::INT ||
+        header.instructionClass > (u8)InstructionClass::b4)
+        return false;
+
+    size_t pageCount = 0;
+    for (u8 bits : header.pages)
+        pageCount += std::bitset<8>(bits).count();
+
+    if (size < header.pageOffset || (size - header.pageOffset) / MemoryPage::size < pageCount)
+        return false;
+
+    const u8 *page = data + header.pageOffset;
+
+    for (u32 index = 0; index < PagedMemory::pageCount; index++) {
+        if (header.pages[index / 8] & (1 << (index % 8))) {
+            memory.writePage(index, page);
+            page += MemoryPage::size;
+        }
+        else {
+            memory.clearPage(index);
+        }
+    }
+
+    restoreRegisters(header);
+    memoryReplaced();
+    resetHistory();
+
+    return true;
+}
+
+template <class Observer>
+bool CpuCore<Observer>::isHalted()
+{
+    return halt;
+}
+
+template <class Observer>
+std::vector<u8> CpuCore<Observer>::getMemory() {
+    return memory.toVector();
+}
+
+template <class Observer>
+const PagedMemory &CpuCore<Observer>::getMemoryView()
+{
+    return memory;
+}
+
+template <class Observer>
+void CpuCore<Observer>::setMachineCodeInMemory(u8 *data, size_t size) {
+    // Loaded in place, getMemoryView() stays valid
+    memory.load(data, size);
+
+    // Set RETI
+    memory.write(1000, 0x0c);
+    memory.write(1001, 0xc0);
+
+    memoryReplaced();
+    resetHistory();
+}
+
+template <class Observer>
+void CpuCore<Observer>::setJitMode(JitMode mode)
+{
+    jitMode = mode;
+    jit.reset();
+
+    if (mode != JitMode::off) {
+        jit.reset(new Jit(mode == JitMode::on));
+
+        if (!jit->isAvailable()) {
+            observer.log("JIT not available, interpreting");
+            jit.reset();
+        }
+    }
+
+    protectWatchpoints();
+
+    jitStatistics = JitStatistics();
+
+    // Instructions decoded so far are not protected from translated stores
+    decoded.clear();
+    memset(codePages, 0, sizeof(codePages));
+}
+
+template <class Observer>
+JitStatistics CpuCore<Observer>::getJitStatistics()
+{
+    return jitStatistics;
+}
+
+// Handlers are entered through a table of label addresses where the
+// compiler supports it, through a switch elsewhere. Every handler has both
+// a case label and a label of its own.
+#if defined(__GNUC__)
+#define DISPATCH(operation) goto *handlers[u8(operation)]
+#else
+#define DISPATCH(operation) goto dispatch
+#endif
+#define HANDLER(name) case Operation::name: name##Handler
+
+template <class Observer>
+u64 CpuCore<Observer>::runInstructions(u64 count)
+{
+    breakpointHit = false;
+    watchpointHit = false;
+
+    if (interruptDue == noInterrupt && !historyCapacity)
+        return runUnscheduled(count);
+
+    // Whole instructions while far from the next replayed interrupt, so
+    // that none of them runs past its impulse, and up to the next
+    // checkpoint
+    u64 executed = 0;
+
+    while (executed < count && !halt && !breakpointHit && !watchpointHit) {
+        bool blocked = isWaiting() && !intr && interruptDue > impulseCount;
+
+        if (blocked && (interruptDue == noInterrupt || replaying))
+            break;
+
+        if (historyCapacity && !replaying && historyInstructions >= historyInterval)
+            takeCheckpoint();
+
+        u64 budget = count - executed;
+
+        if (interruptDue != noInterrupt) {
+            u64 ahead = interruptDue > impulseCount ? interruptDue - impulseCount : 0;
+            budget = std::min(budget, ahead / maxInstructionImpulses);
+        }
+
+        if (historyCapacity && !replaying)
+            budget = std::min(budget, historyInterval - historyInstructions);
+
+        if (budget && !blocked) {
+            u64 completed = runUnscheduled(budget);
+            executed += completed;
+            historyInstructions += completed;
+            continue;
+        }
+
+        // Instructions run impulse by impulse stop at breakpoints as well
+        if (cgb.getPhase() == Phase::IF && atInstructionBoundary() && breakpointAt(PC))
+            break;
+
+        executed += stepInstruction();
+
+        // The instruction granular engine stops after the interrupt
+        // entry that follows the access
+        if (watchpointHit && cgb.getPhase() == Phase::INT && atInstructionBoundary())
+            stepInstruction();
+    }
+
+    return executed;
+}
+
+template <class Observer>
+u64 CpuCore<Observer>::stepInstruction()
+{
+    bool instruction = cgb.getPhase() != Phase::INT || !atInstructionBoundary();
+
+    do {
+        // wait repeats its first impulse until the request arrives
+        if (isWaiting() && !intr && interruptDue > impulseCount) {
+            if (interruptDue == noInterrupt || replaying)
+                return 0;
+
+            impulseCount = interruptDue;
+        }
+
+        advance();
+    } while (!halt && !atInstructionBoundary());
+
+    return instruction && !halt ? 1 : 0;
+}
+
+template <class Observer>
+u64 CpuCore<Observer>::runUnscheduled(u64 count)
+{
+    // Finish an instruction started by advance()
+    while (!halt && !atInstructionBoundary()) {
+        // wait only leaves its first impulse when an interrupt arrives
+        if (isWaiting() && !intr)
+            return 0;
+
+        advance();
+    }
+
+    if (halt)
+        return 0;
+
+    if (decoded.empty())
+        decoded.resize(1 << 15);
+
+    if (cgb.getPhase() == Phase::INT)
+        interruptInstruction();
+
+    if (watchpointHit)
+        return 0;
+
+    if (!sampling)
+        return runEngine(count);
+
+    // Runs of instructions that end before the next sample, and the one
+    // that reaches it on its own. No instruction takes more than 14
+    // impulses, 22 with the interrupt entry after it
+    const u64 longestImpulses = 22;
+    u64 executed = 0;
+
+    while (executed < count) {
+        if (!profiler->impulsesToSample(impulseCount))
+            profiler->sample(PC, impulseCount, profiler->getCurrentFrame());
+
+        u64 ahead = profiler->impulsesToSample(impulseCount);
+        u64 budget = std::min(count - executed, std::max<u64>((ahead - 1) / longestImpulses, 1));
+        u16 start = PC;
+
+        // Only a run of one instruction reaches the sample, which counts
+        // in the frame it started in, not in the one its call or ret
+        // leads to
+        u32 frame = profiler->getCurrentFrame();
+
+        // Entering translated code does not pay off for a few instructions
+        u64 completed = budget < 16 && !trace ? interpret(budget) : runEngine(budget);
+        executed += completed;
+
+        // Like advance(), which never completes halt
+        if (!halt && !profiler->impulsesToSample(impulseCount))
+            profiler->sample(start, impulseCount, frame);
+
+        if (completed < budget || watchpointHit)
+            break;
+    }
+
+    return executed;
+}
+
+// Translated code, the interpreter, or the interpreter up to each keyframe
+// of the trace
+template <class Observer>
+u64 CpuCore<Observer>::runEngine(u64 count)
+{
+    if (jit && !trace && (!profiler || sampling) && !coverage && !watchesReads) {
+        u64 executed = runTranslated(count);
+        jitStatistics.instructions += executed;
+        return executed;
+    }
+
+    if (!trace)
+        return interpret(count);
+
+    // The interpreter stops where a keyframe of the trace is due
+    u64 executed = 0;
+
+    while (executed < count) {
+        if (trace->keyframeDue())
+            trace->keyframe(saveState(), impulseCount);
+
+        u64 budget = std::min(count - executed, trace->instructionsToKeyframe());
+        u64 completed = interpret(budget);
+        executed += completed;
+
+        if (completed < budget || watchpointHit)
+            break;
+    }
+
+    return executed;
+}
+
+// Instantiated for watchpoints and for coverage, whose tests cost nothing
+// while they are off
+template <class Observer>
+u64 CpuCore<Observer>::interpret(u64 count)
+{
+    if (watchpoints.empty())
+        return coverage ? interpretInstructions<false, true>(count) : interpretInstructions<false, false>(count);
+
+    return coverage ? interpretInstructions<true, true>(count) : interpretInstructions<true, false>(count);
+}
+
+template <class Observer>
+template <bool watched, bool covered>
+u64 CpuCore<Observer>::interpretInstructions(u64 count)
+{
+#if defined(__GNUC__)
+    // Same order as Operation
+    static void *const handlers[] = {
+        &&illegalHandler,
+        &&movHandler, &&addHandler, &&subHandler, &&cmpHandler, &&ANDHandler, &&ORHandler, &&XORHandler,
+        &&clrHandler, &&negHandler, &&incHandler, &&decHandler, &&aslHandler, &&asrHandler, &&lsrHandler,
+        &&rolHandler, &&rorHandler, &&rlcHandler, &&rrcHandler, &&jmpHandler, &&callHandler,
+        &&pushRiHandler, &&popRiHandler,
+        &&brHandler, &&bneHandler, &&beqHandler, &&bplHandler, &&bcsHandler, &&bccHandler, &&bvsHandler,
+        &&bvcHandler,
+        &&clcHandler, &&clvHandler, &&clzHandler, &&clsHandler, &&cccHandler, &&secHandler, &&sevHandler,
+        &&sezHandler, &&sesHandler, &&sccHandler, &&nopHandler, &&retHandler, &&retiHandler,
+        &&uhaltHandler, &&waitHandler, &&pushpcHandler, &&poppcHandler, &&pushflagHandler, &&popflagHandler
+    };
+#endif
+
+    u64 executed = 0;
+    DecodedInstruction d;
+    u16 result = 0;
+    u16 operand = 0;
+    u16 start = 0;
+
+next:
+    // Runs stop after the instruction that reached a watchpoint and the
+    // interrupt entry after it
+    if (watched && watchpointHit) {
+        if (!watchedAccess.interrupt)
+            watchedAccess.instruction = start;
+
+        return executed;
+    }
+
+    if (executed == count)
+        return executed;
+
+    // Instructions at odd addresses are rare enough to be decoded every time
+    if (PC & 1) {
+        if (breakpointAt(PC))
+            return executed;
+
+        d = decode(PC);
+
+        if (covered)
+            coverage->instruction(PC);
+    }
+    else {
+        DecodedInstruction &entry = decoded[PC >> 1];
+
+        if (entry.length == 0) {
+            if (breakpointAt(PC))
+                return executed;
+
+            entry = decode(PC);
+
+            codePages[PC >> 8] = true;
+            codePages[(u16)(PC + 2 * entry.length - 1) >> 8] = true;
+
+            if (jit)
+                jit->protect(PC, 2 * entry.length);
+
+            if (covered)
+                coverage->instruction(PC);
+
+            // Instructions at breakpoints stay undecoded, which keeps the
+            // test for breakpoints off the path of cached ones. Nothing
+            // after decoding needs the length
+            if (hasBreakpoint(PC))
+                entry.length = 0;
+        }
+
+        d = entry;
+    }
+
+    // IF
+    start = PC;
+    ADR = PC;
+    IR = d.IR;
+    PC += 2;
+
+    // OF, the words following the instruction come from the decoded entry
+    if (d.operation <= Operation::popRi && d.operation != Operation::illegal) {
+        if (d.operation <= Operation::XOR) {
+            switch (d.mas) {
+            case AM:
+                ADR = PC;
+                PC += 2;
+                MDR = d.sourceWord;
+                T = MDR;
+                break;
+            case AD:
+                T = R[d.source];
+                break;
+            case AI:
+                ADR = R[d.source];
+                MDR = readData<watched>(ADR, 5);
+                T = MDR;
+                break;
+            case AX:
+                PC += 2;
+                ADR = R[d.source] + d.sourceWord;
+                MDR = readData<watched>(ADR, 7);
+                T = MDR;
+                break;
+            }
+        }
+
+        switch (d.mad) {
+        case AM:
+            ADR = PC;
+            PC += 2;
+            MDR = d.destinationWord;
+            break;
+        case AD:
+            MDR = R[d.destination];
+            break;
+        case AI:
+            ADR = R[d.destination];
+            MDR = readData<watched>(ADR, d.operandImpulses);
+            break;
+        case AX:
+            PC += 2;
+            ADR = R[d.destination] + d.destinationWord;
+            MDR = readData<watched>(ADR, d.operandImpulses);
+            break;
+        }
+    }
+
+    // EX
+    DISPATCH(d.operation);
+
+#if !defined(__GNUC__)
+dispatch:
+#endif
+    switch (d.operation) {
+    HANDLER(illegal):
+        halt = true;
+        reason = "CIL - illegal instruction";
+        cgb.setPhase(Phase::IF);
+        cgb.setImpluse(4);
+        impulseCount += d.impulses;
+        return executed;
+
+    HANDLER(mov):
+        result = T;
+        goto storeResult;
+
+    HANDLER(add):
+        result = T + MDR;
+        deferFlags(FlagOperation::add, T, MDR, result);
+        goto storeResult;
+
+    HANDLER(sub):
+    HANDLER(cmp):
+        result = MDR - T;
+        deferFlags(FlagOperation::subtract, T, MDR, result);
+
+        // cmp only sets the flags
+        if (d.operation == Operation::cmp)
+            goto finish;
+        goto storeResult;
+
+    HANDLER(AND):
+        result = T & MDR;
+        goto setZS;
+
+    HANDLER(OR):
+        result = T | MDR;
+        goto setZS;
+
+    HANDLER(XOR):
+        result = T ^ MDR;
+
+    setZS:
+        evaluateFlags();
+        applyFlag(0b0100, result == 0);
+        applyFlag(0b0010, result >> 15);
+
+    storeResult:
+        latchResult(d, result);
+        goto writeResult;
+
+    // The b2 class latches the result before setting the flags, so the
+    // shifts take their carry from the updated MDR as the impulse level
+    // methods do
+    HANDLER(clr):
+        result = 0;
+        latchResult(d, result);
+        goto setZSAndWrite;
+
+    HANDLER(neg):
+        result = ~MDR;
+        latchResult(d, result);
+        goto setZSAndWrite;
+
+    HANDLER(inc):
+        operand = MDR;
+        result = operand + 1;
+        latchResult(d, result);
+        deferFlags(FlagOperation::increment, 1, operand, result);
+        goto writeResult;
+
+    HANDLER(dec):
+        operand = MDR;
+        result = operand - 1;
+        latchResult(d, result);
+        deferFlags(FlagOperation::decrement, 1, operand, result);
+        goto writeResult;
+
+    HANDLER(asl):
+        result = MDR << 1;
+        latchResult(d, result);
+        goto setCHigh;
+
+    HANDLER(asr):
+        result = (MDR >> 1) | (MDR & 0x8000);
+        latchResult(d, result);
+        goto setCLow;
+
+    HANDLER(lsr):
+        result = MDR >> 1;
+        latchResult(d, result);
+        goto setCLow;
+
+    HANDLER(rol):
+        result = (MDR << 1) | (MDR >> 15);
+        latchResult(d, result);
+        goto setCHigh;
+
+    HANDLER(ror):
+        result = (MDR >> 1) | (MDR << 15);
+        latchResult(d, result);
+        goto setCLow;
+
+    HANDLER(rlc):
+        result = (MDR << 1) | ((evaluateFlags() >> 3) & 0x1);
+        latchResult(d, result);
+        goto setCHigh;
+
+    HANDLER(rrc):
+        result = (MDR >> 1) | (MDR << 15) | ((evaluateFlags() & 0x0008) << 12);
+        latchResult(d, result);
+
+    setCLow:
+        evaluateFlags();
+        applyFlag(0b1000, MDR & 1);
+        goto writeResult;
+
+    setCHigh:
+        evaluateFlags();
+        applyFlag(0b1000, MDR >> 15);
+        goto writeResult;
+
+    setZSAndWrite:
+        evaluateFlags();
+        applyFlag(0b0100, result == 0);
+        applyFlag(0b0010, result >> 15);
+
+    writeResult:
+        if (d.mad != AD)
+            writeWord<watched>(ADR, MDR, d.impulses);
+        goto finish;
+
+    HANDLER(jmp):
+        PC = MDR;
+        goto finish;
+
+    HANDLER(call):
+        T = MDR;
+        SP -= 2;
+        ADR = SP;
+        MDR = PC;
+        writeWord<watched>(ADR, MDR, d.impulses - 1);
+        PC = T;
+
+        if (sampling && followsCalls())
+            profiler->call(PC);
+        goto finish;
+
+    HANDLER(pushRi):
+        SP -= 2;
+        ADR = SP;
+        MDR = R[d.destination];
+        writeWord<watched>(ADR, MDR, d.impulses);
+        goto finish;
+
+    HANDLER(popRi):
+        ADR = SP;
+        MDR = readData<watched>(ADR, d.impulses - 1);
+        R[d.destination] = MDR;
+        SP += 2;
+        goto finish;
+
+    HANDLER(br):
+        PC += d.sourceWord;
+        goto finish;
+
+    HANDLER(bne):
+        takeBranch<covered>(start, !testFlag(0b0100), d.sourceWord);
+        goto finish;
+
+    HANDLER(beq):
+        takeBranch<covered>(start, testFlag(0b0100), d.sourceWord);
+        goto finish;
+
+    HANDLER(bpl):
+        takeBranch<covered>(start, !testFlag(0b0010), d.sourceWord);
+        goto finish;
+
+    HANDLER(bcs):
+        takeBranch<covered>(start, testFlag(0b1000), d.sourceWord);
+        goto finish;
+
+    HANDLER(bcc):
+        takeBranch<covered>(start, !testFlag(0b1000), d.sourceWord);
+        goto finish;
+
+    HANDLER(bvs):
+        takeBranch<covered>(start, testFlag(0b0001), d.sourceWord);
+        goto finish;
+
+    HANDLER(bvc):
+        takeBranch<covered>(start, !testFlag(0b0001), d.sourceWord);
+        goto finish;
+
+    HANDLER(clc):
+        evaluateFlags();
+        FLAG &= 0xfff7;
+        goto finish;
+
+    HANDLER(clv):
+        evaluateFlags();
+        FLAG &= 0xfffe;
+        goto finish;
+
+    HANDLER(clz):
+        evaluateFlags();
+        FLAG &= 0xfffb;
+        goto finish;
+
+    HANDLER(cls):
+        evaluateFlags();
+        FLAG &= 0xfffd;
+        goto finish;
+
+    HANDLER(ccc):
+        evaluateFlags();
+        FLAG &= 0xfff0;
+        goto finish;
+
+    HANDLER(sec):
+        evaluateFlags();
+        FLAG |= 0x0008;
+        goto finish;
+
+    HANDLER(sev):
+        evaluateFlags();
+        FLAG |= 0x0001;
+        goto finish;
+
+    HANDLER(sez):
+        evaluateFlags();
+        FLAG |= 0x0004;
+        goto finish;
+
+    HANDLER(ses):
+        evaluateFlags();
+        FLAG |= 0x0002;
+        goto finish;
+
+    HANDLER(scc):
+        evaluateFlags();
+        FLAG |= 0x000f;
+        goto finish;
+
+    HANDLER(nop):
+        goto finish;
+
+    HANDLER(ret):
+    HANDLER(poppc):
+        ADR = SP;
+        MDR = readData<watched>(ADR, d.impulses - 1);
+        PC = MDR;
+        SP += 2;
+
+        if (sampling && d.operation == Operation::ret && followsCalls())
+            profiler->ret();
+        goto finish;
+
+    HANDLER(reti):
+        intr = false;
+        ADR = SP;
+        MDR = readData<watched>(ADR, d.impulses - 4);
+        PC = MDR;
+        SP += 2;
+        ADR = SP;
+        MDR = readData<watched>(ADR, d.impulses - 1);
+        setFlags(MDR);
+        SP += 2;
+
+        // reti and interrupt entries are never translated
+        if (sampling)
+            profiler->ret();
+        goto finish;
+
+    HANDLER(uhalt):
+        // halt repeats its first EX impulse, like uhalt(), and is not
+        // counted as completed
+        halt = true;
+        reason = "Halt encounted. Simulation finished!";
+        cgb.setPhase(Phase::EX);
+        impulseCount += d.impulses;
+        return executed;
+
+    HANDLER(wait):
+        // wait blocks in its first EX impulse until an interrupt arrives
+        if (!intr) {
+            cgb.setPhase(Phase::EX);
+            instructionStart = impulseCount;
+            impulseCount += 3;
+            tracePC = start;
+            return executed;
+        }
+        goto finish;
+
+    HANDLER(pushpc):
+        SP -= 2;
+        ADR = SP;
+        MDR = PC;
+        writeWord<watched>(ADR, MDR, d.impulses);
+        goto finish;
+
+    HANDLER(pushflag):
+        SP -= 2;
+        ADR = SP;
+        MDR = evaluateFlags();
+        writeWord<watched>(ADR, MDR, d.impulses);
+        goto finish;
+
+    HANDLER(popflag):
+        ADR = SP;
+        MDR = readData<watched>(ADR, d.impulses - 1);
+        setFlags(MDR);
+        SP += 2;
+        goto finish;
+    }
+
+finish:
+    impulseCount += d.impulses;
+    executed++;
+
+    // Of the general registers only the destination changes
+    if (trace)
+        trace->record(false, start, d.IR, impulseCount, R, SP, evaluateFlags(), d.destination);
+
+    if (profiler && !sampling)
+        profile(start, d.operation, d.impulses);
+
+    if (intr)
+        interruptInstruction();
+
+    goto next;
+}
+
+#undef DISPATCH
+#undef HANDLER
+
+// Runs translated blocks and interprets what they leave to the
+// interpreter: instructions that are not translated, pending interrupts,
+// stores into code and the end of the budget
+template <class Observer>
+u64 CpuCore<Observer>::runTranslated(u64 count)
+{
+    u64 executed = 0;
+    JitState state;
+    std::vector<u8> before;
+
+    // Translated stores are not tracked one by one
+    markDirty(0, 1 << 16);
+
+    while (executed < count && !halt && !watchpointHit) {
+        const u8 *block = nullptr;
+
+        if (!intr) {
+            block = jit->lookup(PC);
+
+            if (!block)
+                block = translate(PC, false);
+        }
+
+        if (!block) {
+            u64 interpreted = interpret(1);
+
+            // halt, or wait without an interrupt
+            if (interpreted == 0)
+                break;
+
+            executed += interpreted;
+            continue;
+        }
+
+        u16 start = PC;
+
+        memcpy(state.R, R, sizeof(R));
+        state.PC = PC;
+        state.SP = SP;
+        state.FLAG = evaluateFlags();
+        state.budget = count - executed;
+        state.impulses = impulseCount;
+        state.superblockInstructions = 0;
+        state.pages = memory.pageTable();
+        state.link = nullptr;
+
+        // Flat copies, shared pages would keep translated stores from
+        // running
+        if (jitMode == JitMode::differential)
+            before = memory.toVector();
+
+        jit->run(state, block);
+
+        u64 completed = count - executed - state.budget;
+        executed += completed;
+        jitStatistics.superblockInstructions += state.superblockInstructions;
+
+        if (jitMode == JitMode::differential) {
+            // Replay the block through the interpreter from the same state,
+            // which stays the state of the core
+            std::vector<u8> translatedMemory = memory.toVector();
+            memory.load(before.data(), before.size());
+
+            interpret(completed);
+
+            if (!checkTranslation(start, state, translatedMemory))
+                return executed;
+        }
+        else {
+            memcpy(R, state.R, sizeof(R));
+            PC = state.PC;
+            SP = state.SP;
+            FLAG = state.FLAG;
+            impulseCount = state.impulses;
+        }
+
+        switch (state.exit) {
+        case exitBudget:
+            return executed + interpret(count - executed);
+
+        case exitInterpret: {
+            u64 interpreted = interpret(1);
+
+            if (interpreted == 0)
+                return executed;
+
+            executed += interpreted;
+            break;
+        }
+
+        case exitHot:
+            if (translate(PC, true))
+                jitStatistics.superblocks++;
+            break;
+
+        default:
+            // Link to blocks that already exist, the next pass through
+            // the jump links to the ones translated meanwhile
+            if (state.link && !intr) {
+                const u8 *target = jit->lookup(PC);
+
+                if (target)
+                    jit->link(state.link, target);
+            }
+            break;
+        }
+    }
+
+    return executed;
+}
+
+// Translates the basic block at address, or the superblock tracing from
+// it. Returns null if its first instruction is not translated
+template <class Observer>
+const u8 *CpuCore<Observer>::translate(u16 address, bool superblock)
+{
+    DecodedInstruction instructions[Jit::maxSuperblockLength];
+    u16 addresses[Jit::maxSuperblockLength];
+    size_t maxLength = superblock ? Jit::maxSuperblockLength : Jit::maxBlockLength;
+    size_t count = 0;
+    u16 pc = address;
+
+    if (address & 1)
+        return nullptr;
+
+    while (count < maxLength) {
+        DecodedInstruction d = decode(pc);
+
+        // The interpreter stops at breakpoints
+        if (!Jit::canTranslate(d.operation) || hasBreakpoint(pc))
+            break;
+
+        // A trace ends where it meets itself, a jump back to its start
+        // closes a loop
+        if (std::find(addresses, addresses + count, pc) != addresses + count)
+            break;
+
+        instructions[count] = d;
+        addresses[count++] = pc;
+
+        // Stores of the interpreter into the block reach invalidateDecoded()
+        codePages[pc >> 8] = true;
+        codePages[(u16)(pc + 2 * d.length - 1) >> 8] = true;
+
+        if (!superblock) {
+            pc += 2 * d.length;
+
+            if (Jit::endsBlock(d.operation))
+                break;
+        }
+        else if (!Jit::traceSuccessor(pc, d, pc)) {
+            break;
+        }
+    }
+
+    if (count == 0)
+        return nullptr;
+
+    const u8 *block = jit->translate(addresses, instructions, count, superblock);
+
+    // The code buffer is full
+    if (!block) {
+        flushTranslations();
+        block = jit->translate(addresses, instructions, count, superblock);
+    }
+
+    return block;
+}
+
+// Drops every translation together with the decoded instructions, whose
+// protection goes with them
+template <class Observer>
+void CpuCore<Observer>::flushTranslations()
+{
+    jit->flush();
+    protectWatchpoints();
+
+    for (DecodedInstruction &entry : decoded)
+        entry.length = 0;
+}
+
+// Compares the state left by a translated block with the one left by the
+// interpreter. On the first difference halts with it as reason
+template <class Observer>
+bool CpuCore<Observer>::checkTranslation(u16 block, const JitState &state, const std::vector<u8> &translatedMemory)
+{
+    static const char *const registerNames[] = {
+        "R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7",
+        "R8", "R9", "R10", "R11", "R12", "R13", "R14", "R15"
+    };
+
+    char message[128];
+    char address[8];
+    const char *name = nullptr;
+    unsigned translated = 0;
+    unsigned interpreted = 0;
+
+    auto compare = [&](const char *field, unsigned translatedValue, unsigned interpretedValue) {
+        if (!name && translatedValue != interpretedValue) {
+            name = field;
+            translated = translatedValue;
+            interpreted = interpretedValue;
+        }
+    };
+
+    for (int i = 0; i < 16; i++)
+        compare(registerNames[i], state.R[i], R[i]);
+
+    compare("PC", state.PC, PC);
+    compare("SP", state.SP, SP);
+    compare("FLAG", state.FLAG, evaluateFlags());
+    compare("impulses", (unsigned)state.impulses, (unsigned)impulseCount);
+
+    if (!name) {
+        std::vector<u8> interpretedMemory = memory.toVector();
+        auto difference = std::mismatch(interpretedMemory.begin(), interpretedMemory.end(),
+                                        translatedMemory.begin());
+
+        if (difference.first == interpretedMemory.end())
+            return true;
+
+        snprintf(address, sizeof(address), "[%04x]", (unsigned)(difference.first - interpretedMemory.begin()));
+        name = address;
+        translated = *difference.second;
+        interpreted = *difference.first;
+    }
+
+    snprintf(message, sizeof(message), "JIT mismatch after block %04x: %s is %04x, interpreter has %04x",
+             block, name, translated, interpreted);
+
+    halt = true;
+    reason = message;
+    observer.log(message);
+
+    return false;
+}
+
+template <class Observer>
+bool CpuCore<Observer>::atInstructionBoundary()
+{
+    return cgb.getImpulse() == 1 &&
+           (cgb.getPhase() == Phase::IF || cgb.getPhase() == Phase::INT);
+}
+
+// In the first EX impulse of wait, which repeats until an interrupt
+// arrives
+template <class Observer>
+bool CpuCore<Observer>::isWaiting()
+{
+    return cgb.getPhase() == Phase::EX && IR == 0xc00e;
+}
+
+// Decodes the instruction at address the way impulse 3 of IF and execute()
+// do, together with the words that OF will read after it
+template <class Observer>
+DecodedInstruction CpuCore<Observer>::decode(u16 address)
+{
+    static const u8 sourceImpulses[] = {3, 1, 3, 5};
+    static const u8 destinationImpulses[] = {2, 1, 2, 4};
+
+    DecodedInstruction d;
+    u16 ir = readWord(address);
+    u16 next = address + 2;
+
+    d.IR = ir;
+    d.sourceWord = 0;
+    d.destinationWord = 0;
+    d.operation = operationTable.operation[ir];
+    d.source = (ir >> 6) & 0xf;
+    d.destination = ir & 0xf;
+    d.mas = (ir >> 10) & 0x3;
+    d.mad = (ir >> 4) & 0x3;
+    d.length = 1;
+    d.impulses = 3;
+    d.operandImpulses = 3;
+
+    switch (d.operation) {
+    case Operation::illegal:
+        break;
+    case Operation::mov: case Operation::add: case Operation::sub: case Operation::cmp:
+    case Operation::AND: case Operation::OR: case Operation::XOR:
+        if (d.mas == AM || d.mas == AX) {
+            d.sourceWord = readWord(next);
+            next += 2;
+            d.length++;
+        }
+
+        if (d.mad == AM || d.mad == AX) {
+            d.destinationWord = readWord(next);
+            d.length++;
+        }
+
+        d.impulses += sourceImpulses[d.mas] + destinationImpulses[d.mad];
+        d.operandImpulses = d.impulses;
+        d.impulses += d.operation == Operation::cmp || d.mad == AD ? 1 : 2;
+        break;
+    case Operation::jmp: case Operation::call: case Operation::pushRi: case Operation::popRi:
+    case Operation::clr: case Operation::neg: case Operation::inc: case Operation::dec:
+    case Operation::asl: case Operation::asr: case Operation::lsr: case Operation::rol:
+    case Operation::ror: case Operation::rlc: case Operation::rrc:
+        if (d.mad == AM || d.mad == AX) {
+            d.destinationWord = readWord(next);
+            d.length++;
+        }
+
+        d.impulses += destinationImpulses[d.mad];
+        d.operandImpulses = d.impulses;
+
+        if (d.operation == Operation::jmp)
+            d.impulses += 1;
+        else if (d.operation == Operation::call)
+            d.impulses += 6;
+        else if (d.operation == Operation::pushRi)
+            d.impulses += 4;
+        else if (d.operation == Operation::popRi)
+            d.impulses += 3;
+        else
+            d.impulses += d.mad == AD ? 1 : 2;
+        break;
+    case Operation::br: case Operation::bne: case Operation::beq: case Operation::bpl:
+    case Operation::bcs: case Operation::bcc: case Operation::bvs: case Operation::bvc:
+        // sign extended branch offset
+        d.sourceWord = ir & 0xff;
+        if (d.sourceWord & 0x80)
+            d.sourceWord |= 0xff00;
+
+        d.impulses += 1;
+        break;
+    case Operation::ret: case Operation::poppc: case Operation::popflag:
+        d.impulses += 3;
+        break;
+    case Operation::pushpc: case Operation::pushflag:
+        d.impulses += 4;
+        break;
+    case Operation::reti:
+        d.impulses += 6;
+        break;
+    default:
+        d.impulses += 1;
+        break;
+    }
+
+    return d;
+}
+
+// A store can change the instruction word or an operand word of any
+// instruction starting up to two words before the words it touches
+template <class Observer>
+void CpuCore<Observer>::invalidateDecoded(u16 address)
+{
+    u16 last = (u16)(address + 1) >> 1;
+
+    for (u16 word = (address >> 1) - 2; ; word++) {
+        decoded[word & 0x7fff].length = 0;
+
+        if ((word & 0x7fff) == last)
+            break;
+    }
+
+    if (jit && jit->isCode(address))
+        flushTranslations();
+}
+
+// Saves FLAG and PC on the stack and jumps to IVR, as the INT phase does
+template <class Observer>
+void CpuCore<Observer>::interruptInstruction()
+{
+    u16 returnAddress = PC;
+
+    SP -= 2;
+    ADR = SP;
+    MDR = evaluateFlags();
+    writeWord(ADR, MDR, 4);
+
+    SP -= 2;
+    ADR = SP;
+    MDR = PC;
+    writeWord(ADR, MDR, 7);
+
+    PC = IVR;
+    cgb.setPhase(Phase::IF);
+
+    impulseCount += 8;
+
+    if (trace)
+        trace->record(true, returnAddress, IR, impulseCount, R, SP, evaluateFlags());
+
+    if (profiler)
+        profiler->interrupt(PC, 8);
+}
+
+// Counts a completed instruction and follows the calls and returns
+template <class Observer>
+void CpuCore<Observer>::profile(u16 address, Operation operation, u64 impulses)
+{
+    if (!sampling)
+        profiler->instruction(address, impulses);
+    else if (operation != Operation::reti && !followsCalls())
+        return;
+
+    if (operation == Operation::call)
+        profiler->call(PC);
+    else if (operation == Operation::ret || operation == Operation::reti)
+        profiler->ret();
+}
+
+// A conditional branch of the interpreter, at address
+template <class Observer>
+template <bool covered>
+void CpuCore<Observer>::takeBranch(u16 address, bool taken, u16 offset)
+{
+    if (taken)
+        PC += offset;
+
+    if (covered)
+        coverage->branch(address, taken);
+}
+
+// Whether the conditional branch operation goes to its target, which the
+// flags it leaves alone still tell once it completed
+template <class Observer>
+bool CpuCore<Observer>::branchCondition(Operation operation)
+{
+    switch (operation) {
+    case Operation::bne:
+        return !testFlag(0b0100);
+    case Operation::beq:
+        return testFlag(0b0100);
+    case Operation::bpl:
+        return !testFlag(0b0010);
+    case Operation::bcs:
+        return testFlag(0b1000);
+    case Operation::bcc:
+        return !testFlag(0b1000);
+    case Operation::bvs:
+        return testFlag(0b0001);
+    case Operation::bvc:
+        return !testFlag(0b0001);
+    default:
+        return true;
+    }
+}
+
+template <class Observer>
+u16 CpuCore<Observer>::readWord(u16 address)
+{
+    return memory.readWord(address);
+}
+
+template <class Observer>
+template <bool watched>
+u16 CpuCore<Observer>::readData(u16 address, u8 impulse)
+{
+    u16 value = memory.readWord(address);
+
+    if (watched && (watchedPages[address >> 8] & watchRead))
+        watchAccess(address, false, value, value, impulse);
+
+    return value;
+}
+
+template <class Observer>
+template <bool watched>
+void CpuCore<Observer>::writeWord(u16 address, u16 value, u8 impulse)
+{
+    if (watched && (watchedPages[address >> 8] & watchWrite))
+        watchAccess(address, true, memory.readWord(address), value, impulse);
+
+    memory.writeWord(address, value);
+
+    if (trace)
+        trace->write(address, value);
+
+    markDirty(address, 2);
+
+    if (codePages[address >> 8] || codePages[(u16)(address + 1) >> 8])
+        invalidateDecoded(address);
+}
+
+// Result of a b1 or b2 instruction into its destination register or MDR
+template <class Observer>
+void CpuCore<Observer>::latchResult(const DecodedInstruction &d, u16 result)
+{
+    if (d.mad == AD)
+        R[d.destination] = result;
+    else if (d.mad != AM)
+        MDR = result;
+}
+
+// Same masks as setC/setZ/setS, including the clearing of the upper bits
+template <class Observer>
+void CpuCore<Observer>::applyFlag(u16 bit, bool value)
+{
+    if (value)
+        FLAG |= bit;
+    else
+        FLAG &= 0xf & ~bit;
+}
+
+template <class Observer>
+void CpuCore<Observer>::instructionFetch()
+{
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        DBUS = PC;
+        observer.PdPCD(true);
+        observer.ALU(true, false, true, "DBUS");
+        RBUS = DBUS;
+        observer.PdALU(true);
+        ADR = RBUS;
+        observer.PmADR(true, ADR);
+        observer.log("IF I1");
+        break;
+
+    case 2:
+        IR = readWord(ADR);
+        observer.RD(true, "READ");
+        observer.PmIR(true, IR);
+        PC += 2;
+        observer.PCchanged(true, PC);
+        observer.log("IF I2");
+        break;
+
+    case 3: {
+        bool cil = false;
+
+        if((IR >> 15) == 0){
+            instructionClass = InstructionClass::b1;
+            if((IR >> 12) > 6)
+                cil = true;
+        }
+        else {
+            switch((IR >> 13) & 0x03) {
+            case 0:
+                instructionClass = InstructionClass::b2;
+                if((IR >> 6) > 0x20E)
+                    cil = true;
+                break;
+
+            case 1:
+                instructionClass = InstructionClass::b3;
+                if((IR >> 8) > 0xA7)
+                    cil = true;
+                break;
+
+            case 2:
+                instructionClass = InstructionClass::b4;
+                if(IR > 0xC012)
+                    cil = true;
+                break;
+
+            default:
+                cil = true;
+            }
+        }
+
+        if(cil) {
+            halt = true;
+            reason =  "CIL - illegal instruction";
+            return;
+        }
+
+        if((IR & 0x8000) == 0 || ((IR >> 13) & 0x7) == 4) {
+            cgb.setPhase(Phase::OF);
+        }
+        else {
+            cgb.setPhase(Phase::EX);
+        }
+
+        observer.log("IF I3");
+        break;
+    }
+
+    default:
+        halt = true;
+        reason = "Impulses out of range for Instruction Fetch phase";
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::operandFetch()
+{
+    mas = (IR >> 10) & 0x3;
+    mad = (IR >> 4) & 0x03;
+
+    if ((IR & 0x8000) != 0 && (cgb.getImpulse() < 6))
+        cgb.setImpluse(6);
+
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        switch (mas) {
+        case AM: case AX:
+            SBUS = PC;
+            observer.PdPCS(true);
+            observer.ALU(true, true, false, "SBUS");
+
+            PC += 2;
+            observer.PCchanged(true, PC);
+
+            RBUS = SBUS;
+            observer.PdALU(true);
+
+            ADR = RBUS;
+            observer.PmADR(true, ADR);
+
+            break;
+        case AD:
+            SBUS = R[(IR >> 6) & 0xf];
+            observer.PdRGS(true);
+            observer.ALU(true, true, false, "SBUS");
+
+            RBUS = SBUS;
+            observer.PdALU(true);
+
+            T = RBUS;
+            observer.PmT(true, T);
+
+            cgb.setImpluse(6);
+
+            break;
+        case AI:
+            SBUS = R[(IR >> 6) & 0xf];
+            observer.PdRGS(true);
+            observer.ALU(true, true, false, "SBUS");
+
+            RBUS = SBUS;
+            observer.PdALU(true);
+
+            ADR = RBUS;
+            observer.PmADR(true, ADR);
+
+            break;
+        default:
+            break;
+        }
+
+        observer.log("SURSA OF I1");
+        break;
+
+    case 2:
+        // Immediate operands and index words are fetched with the code
+        MDR = mas == AI ? readData(ADR) : readWord(ADR);
+        observer.RD(true, "READ");
+        observer.PmMDR(true, MDR);
+
+        observer.log("SURSA OF I2");
+        break;
+
+    case 3:
+        switch(mas) {
+        case AM: case AI:
+            SBUS = MDR;
+            observer.PdMDRS(true);
+
+            observer.ALU(true, true, false, "SBUS");
+
+            RBUS = SBUS;
+            observer.PdALU(true);
+
+            T = RBUS;
+            observer.PmT(true, T);
+
+            cgb.setImpluse(6);
+
+            observer.log("SURSA OF I3");
+            break;
+        case AX:
+            SBUS = R[(IR >> 6) & 0xf];
+            observer.PdRGS(true);
+
+            DBUS = MDR;
+            observer.PdMDRD(true);
+
+            observer.ALU(true, true, true, "SUM");
+
+            RBUS = SBUS + DBUS;
+            observer.PdALU(true);
+
+            ADR = RBUS;
+            observer.PmADR(true, ADR);
+
+             observer.log("SURSA OF I3");
+            break;
+        default:
+            observer.log("ERROR SURSA OF I3");
+            break;
+        }
+
+        break;
+    case 4:
+        MDR = readData(ADR);
+        observer.RD(true, "READ");
+        observer.PmMDR(true, MDR);
+
+        observer.log("SURSA OF I4");
+
+        break;
+    case 5:
+        SBUS = MDR;
+        observer.PdMDRS(true);
+
+        observer.ALU(true, true, false, "SBUS");
+
+        RBUS = SBUS;
+        observer.PdALU(true);
+
+        T = RBUS;
+        observer.PmT(true, T);
+
+        observer.log("SURSA OF I5");
+        break;
+    case 6:
+        switch (mad) {
+        case AM: case AX:
+            DBUS = PC;
+            observer.PdPCD(true);
+            observer.ALU(true, false, true, "DBUS");
+
+            PC += 2;
+            observer.PCchanged(true, PC);
+
+            RBUS = DBUS;
+            observer.PdALU(true);
+
+            ADR = RBUS;
+            observer.PmADR(true, ADR);
+
+            break;
+        case AD:
+            DBUS = R[IR & 0xf];
+            observer.PdRGD(true);
+            observer.ALU(true, false, true, "DBUS");
+
+            RBUS = DBUS;
+            observer.PdALU(true);
+
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+
+            cgb.setPhase(Phase::EX);
+            break;
+        case AI:
+            DBUS = R[IR & 0xf];
+            observer.PdRGD(true);
+            observer.ALU(true, false, true, "DBUS");
+
+            RBUS = DBUS;
+            observer.PdALU(true);
+
+            ADR = RBUS;
+            observer.PmADR(true, ADR);
+            break;
+
+        default:
+            observer.log("ERROR I1 MAD");
+            break;
+        }
+
+        observer.log("DESTINATIE OF I1");
+        break;
+    case 7:
+        MDR = mad == AI ? readData(ADR) : readWord(ADR);
+        observer.RD(true, "READ");
+        observer.PmMDR(true, MDR);
+
+        if (mad == AM || mad == AI)
+            cgb.setPhase(Phase::EX);
+
+        observer.log("DESTINATIE OF I2");
+        break;
+    case 8:
+        DBUS = R[IR & 0xf];
+        observer.PdRGD(true);
+
+        SBUS = MDR;
+        observer.PdMDRS(true);
+
+        observer.ALU(true, true, true, "SUM");
+
+        RBUS = SBUS + DBUS;
+        observer.PdALU(true);
+
+        ADR = RBUS;
+        observer.PmADR(true, ADR);
+
+        observer.log("DESTINATIE OF I3");
+
+        break;
+    case 9:
+        MDR = readData(ADR);
+        observer.RD(true, "READ");
+        observer.PmMDR(true, MDR);
+
+        cgb.setPhase(Phase::EX);
+
+        observer.log("DESTINATIE OF I4");
+
+        break;
+    default:
+        observer.log("ERROR");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::execute()
+{
+    // Same order as Operation
+    static void (CpuCore::*const handlers[])() = {
+        &CpuCore::undefined,
+        &CpuCore::mov, &CpuCore::add, &CpuCore::sub, &CpuCore::cmp, &CpuCore::AND, &CpuCore::OR,
+        &CpuCore::XOR,
+        &CpuCore::clr, &CpuCore::neg, &CpuCore::inc, &CpuCore::dec, &CpuCore::asl, &CpuCore::asr,
+        &CpuCore::lsr, &CpuCore::rol, &CpuCore::ror, &CpuCore::rlc, &CpuCore::rrc, &CpuCore::jmp,
+        &CpuCore::call, &CpuCore::pushRi, &CpuCore::popRi,
+        &CpuCore::br, &CpuCore::bne, &CpuCore::beq, &CpuCore::bpl, &CpuCore::bcs, &CpuCore::bcc,
+        &CpuCore::bvs, &CpuCore::bvc,
+        &CpuCore::clc, &CpuCore::clv, &CpuCore::clz, &CpuCore::cls, &CpuCore::ccc, &CpuCore::sec,
+        &CpuCore::sev, &CpuCore::sez, &CpuCore::ses, &CpuCore::scc, &CpuCore::nop, &CpuCore::ret,
+        &CpuCore::reti, &CpuCore::uhalt, &CpuCore::wait, &CpuCore::pushpc, &CpuCore::poppc,
+        &CpuCore::pushflag, &CpuCore::popflag
+    };
+
+    (this->*handlers[u8(operationTable.operation[IR])])();
+}
+
+template <class Observer>
+void CpuCore<Observer>::undefined()
+{
+    observer.log("Instruction not defined");
+}
+
+template <class Observer>
+void CpuCore<Observer>::interrupt()
+{
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        SP -= 2;
+        observer.SPchanged(true, SP);
+
+        observer.log("INT I1");
+
+        break;
+    case 2:
+        SBUS = SP;
+        observer.PdSPS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        ADR = RBUS;
+        observer.PmADR(true, ADR);
+
+        observer.log("INT I2");
+
+        break;
+    case 3:
+        SBUS = evaluateFlags();
+        observer.PdFLAGS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        MDR = RBUS;
+        observer.PmMDR(true, MDR);
+
+        observer.log("INT I3");
+
+        break;
+    case 4:
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        SP -= 2;
+        observer.SPchanged(true, SP);
+
+        observer.log("INT I4");
+
+        break;
+    case 5:
+        SBUS = SP;
+        observer.PdSPS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        ADR = RBUS;
+        observer.PmADR(true, ADR);
+
+        observer.log("INT I5");
+
+        break;
+    case 6:
+        SBUS = PC;
+        observer.PdPCS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        MDR = RBUS;
+        observer.PmMDR(true, MDR);
+
+        observer.log("INT I6");
+
+        break;
+    case 7:
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        observer.log("INT I7");
+
+        break;
+    case 8:
+        SBUS = IVR;
+        observer.PdIVRS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        PC = RBUS;
+        observer.PmPC(true, ADR);
+
+        observer.log("INT I8");
+
+        // Unconditional set instruction fetch
+        cgb.setPhase(Phase::IF);
+
+        break;
+    default:
+        observer.log("ERROR INTERRUPT");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::mov()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        SBUS = T;
+        observer.PdTS(true);
+        observer.ALU(true, true, false, "SBUS");
+
+        RBUS = SBUS;
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        observer.log("EX MOV I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX MOV I2");
+        break;
+    }
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::add()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        SBUS = T;
+        observer.PdTS(true);
+
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = (short)SBUS + (short)DBUS;
+        observer.ALU(true, true, true, "SUM");
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        deferFlags(FlagOperation::add, SBUS, DBUS, RBUS);
+        observer.PmFLAG(true, observedFlags());
+
+        observer.log("EX ADD I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX ADD I2");
+        break;
+    }
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::sub()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        SBUS = ~T;
+        observer.PdTS(true);
+
+        RBUS = (short)DBUS + (short)SBUS + 1; //Cin
+        observer.ALU(true, true, true, "SUM+C");
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        deferFlags(FlagOperation::subtract, T, DBUS, RBUS);
+        observer.PmFLAG(true, observedFlags());
+        observer.log("EX SUB I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX SUB I2");
+        break;
+    }
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::cmp()
+{
+    if(cgb.getAndIncrementImpulse() == 1) {
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        SBUS = ~T;
+        observer.PdTS(true);
+
+        RBUS = DBUS + SBUS + 1; //Cin
+        observer.ALU(true, true, true, "SUM+C");
+
+        deferFlags(FlagOperation::subtract, T, DBUS, RBUS);
+        observer.PmFLAG(true, observedFlags());
+        decideNextPhase();
+        observer.log("EX CMP I1");
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::AND()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        SBUS = T;
+        observer.PdTS(true);
+
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = SBUS & DBUS;
+        observer.ALU(true, true, true, "AND");
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        setZ();
+        setS();
+        observer.log("EX AND I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX AND I2");
+        break;
+    }
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::OR()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        SBUS = T;
+        observer.PdTS(true);
+
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = SBUS | DBUS;
+        observer.ALU(true, true, true, "OR");
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        setZ();
+        setS();
+        observer.log("EX OR I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX OR I2");
+        break;
+    }
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::XOR()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        SBUS = T;
+        observer.PdTS(true);
+
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = SBUS ^ DBUS;
+        observer.ALU(true, true, true, "XOR");
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        setZ();
+        setS();
+        observer.log("EX XOR I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX XOR I2");
+        break;
+    }
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::clr()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        SBUS = 0;
+        observer.PmSBUS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        setZ();
+        setS();
+        observer.log("EX CLR I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX CLR I2");
+        break;
+    }
+    }
+
+}
+
+template <class Observer>
+void CpuCore<Observer>::neg()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = ~DBUS;
+        observer.ALU(true, false, true, "!DBUS");
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        setZ();
+        setS();
+        observer.log("EX NEG I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX NEG I2");
+        break;
+    }
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::inc()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        SBUS = 0;
+        observer.PmSBUS(true);
+
+        RBUS = SBUS + DBUS + 1; //Cin
+        observer.ALU(true, true, true, "SUM+C");
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        deferFlags(FlagOperation::increment, 1, DBUS, RBUS);
+        observer.PmFLAG(true, observedFlags());
+
+        observer.log("EX INC I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX INC I2");
+        break;
+    }
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::dec()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        SBUS = (short) - 1;
+        observer.PmSBUS(true);
+
+        RBUS = SBUS + DBUS;
+        observer.ALU(true, true, true, "SUM");
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        deferFlags(FlagOperation::decrement, 1, DBUS, RBUS);
+        observer.PmFLAG(true, observedFlags());
+
+        observer.log("EX DEC I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX DEC I2");
+        break;
+    }
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::asl()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = DBUS << 1;
+        observer.ALU(true, false, true, "ST");
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        setC(MDR >> 15);
+
+        observer.log("EX ASL I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX ASL I2");
+        break;
+    }
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::asr()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = DBUS >> 1;
+        RBUS |= (DBUS & 0x8000);
+        observer.ALU(true, false, true, "DR");
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        setC(MDR & 1);
+
+        observer.log("EX ASR I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX ASR I2");
+        break;
+    }
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::lsr()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = DBUS >> 1;
+        observer.ALU(true, false, true, "DR");
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        setC(MDR & 1);
+
+        observer.log("EX LSR I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX LSR I2");
+        break;
+    }
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::rol()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = DBUS << 1;
+        RBUS |= DBUS >> 15;
+        observer.ALU(true, false, true, "ST");
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        setC(MDR >> 15);
+
+        observer.log("EX ROL I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX ROL I2");
+        break;
+    }
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::ror()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = DBUS >> 1;
+        RBUS |= MDR << 15;
+        observer.ALU(true, false, true, "DR");
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        setC(MDR & 1);
+
+        observer.log("EX ROR I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX ROR I2");
+        break;
+    }
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::rlc()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = DBUS << 1;
+        RBUS |= (evaluateFlags() >> 3) & 0x1;
+        observer.ALU(true, false, true, "ST");
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        setC(MDR >> 15);
+
+        observer.log("EX RLC I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX RLC I2");
+        break;
+    }
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::rrc()
+{
+    switch (cgb.getAndIncrementImpulse()) {
+    case 1: {
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = DBUS >> 1;
+        RBUS |= MDR << 15;
+        RBUS |= (evaluateFlags() & 0x0008) << 12;
+        observer.ALU(true, false, true, "DR");
+        observer.PdALU(true);
+
+        switch (mad) {
+        case AD: {
+            u8 index = IR & 0xF;
+            R[index] = RBUS;
+            observer.PmRG(true, index, R[index]);
+
+            decideNextPhase();
+            break;
+        }
+        case AI: case AX:
+            MDR = RBUS;
+            observer.PmMDR(true, MDR, true);
+            break;
+        }
+
+        setC(MDR & 1);
+
+        observer.log("EX ROR I1");
+        break;
+    }
+    case 2: {
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+        observer.log("EX ROR I2");
+        break;
+    }
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::jmp()
+{
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = DBUS;
+        observer.ALU(true, false, true, "DBUS");
+        observer.PdALU(true);
+
+        PC = RBUS;
+        observer.PmPC(true, PC);
+
+        decideNextPhase();
+        observer.log("EX JMP I1");
+        break;
+    default:
+        observer.log("ERROR EX JMP");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::call()
+{
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = DBUS;
+        observer.ALU(true, false, true, "DBUS");
+        observer.PdALU(true);
+
+        T = RBUS;
+        observer.PmT(true, T);
+
+        observer.log("EX CALL I1");
+        break;
+    case 2:
+        SP -= 2;
+        observer.SPchanged(true, SP);
+
+        observer.log("EX CALL I2");
+        break;
+    case 3:
+        SBUS = SP;
+        observer.PdSPS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        ADR = RBUS;
+        observer.PmADR(true, ADR);
+
+        observer.log("EX CALL I3");
+        break;
+    case 4:
+        SBUS = PC;
+        observer.PdPCS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        MDR = RBUS;
+        observer.PmMDR(true, MDR);
+
+        observer.log("EX CALL I4");
+        break;
+    case 5:
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        observer.log("EX CALL I5");
+        break;
+    case 6:
+        SBUS = T;
+        observer.PdTS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        PC = RBUS;
+        observer.PmPC(true, PC);
+
+        decideNextPhase();
+
+        observer.log("EX CALL I6");
+        break;
+    default:
+        observer.log("ERROR EX CALL");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::pushRi()
+{
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        SP -= 2;
+        observer.SPchanged(true, SP);
+
+        observer.log("EX PUSH I1");
+        break;
+    case 2:
+        SBUS = SP;
+        observer.PdSPS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        ADR = RBUS;
+        observer.PmADR(true, ADR);
+
+        observer.log("EX PUSH I2");
+        break;
+    case 3:
+        SBUS = R[IR & 0xf];
+        observer.PdRGS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        MDR = RBUS;
+        observer.PmMDR(true, MDR);
+
+        observer.log("EX PUSH I3");
+        break;
+    case 4:
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+
+        observer.log("EX PUSH I4");
+        break;
+    default:
+        observer.log("ERROR EX PUSH");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::popRi()
+{
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        SBUS = SP;
+        observer.PdSPS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        ADR = RBUS;
+        observer.PmADR(true, ADR);
+
+        observer.log("EX POP I1");
+        break;
+    case 2:
+        MDR = readData(ADR);
+        observer.RD(true, "READ");
+        observer.PmMDR(true, MDR);
+
+        observer.log("EX POP I2");
+        break;
+    case 3: {
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = DBUS;
+        observer.ALU(true, false, true, "DBUS");
+        observer.PdALU(true);
+
+        u8 index = IR & 0xf;
+        R[index] = RBUS;
+        observer.PmRG(true, index, R[index]);
+
+        SP += 2;
+        observer.SPchanged(true, SP);
+
+        decideNextPhase();
+
+        observer.log("EX POP I3");
+        break;
+    }
+    default:
+        observer.log("ERROR EX POP");
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::br() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        SBUS = IR & 0xff;
+        observer.PmSBUS(true);
+
+        // sign extend if negative
+        if (SBUS & 0x80)
+            SBUS |= 0xff00;
+
+        DBUS = PC;
+        observer.PdPCD(true);
+
+        RBUS = (u16)((short)SBUS + (short)DBUS);
+        observer.ALU(true, true, true, "SUM");
+        observer.PdALU(true);
+
+        PC = RBUS;
+
+        observer.PmPC(true, PC);
+
+        decideNextPhase();
+
+        observer.log("EX BR I1");
+        break;
+    default:
+        observer.log("ERROR EX BR");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::bne() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        SBUS = IR & 0xff;
+        observer.PmSBUS(true);
+
+        // sign extend if negative
+        if (SBUS & 0x80)
+            SBUS |= 0xff00;
+
+        DBUS = PC;
+        observer.PdPCD(true);
+
+        RBUS = (u16)((short)SBUS + (short)DBUS);
+        observer.ALU(true, true, true, "SUM");
+        observer.PdALU(true);
+
+        if (!testFlag(0b0100)) {
+            PC = RBUS;
+            observer.PmPC(true, PC);
+        }
+
+        decideNextPhase();
+        observer.log("EX BNE I1");
+
+        break;
+    default:
+        observer.log("ERROR EX BNQ");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::beq() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        SBUS = IR & 0xff;
+        observer.PmSBUS(true);
+
+        // sign extend if negative
+        if (SBUS & 0x80)
+            SBUS |= 0xff00;
+
+        DBUS = PC;
+        observer.PdPCD(true);
+
+        RBUS = (u16)((short)SBUS + (short)DBUS);
+        observer.ALU(true, true, true, "SUM");
+        observer.PdALU(true);
+
+        if (testFlag(0b0100)) {
+            PC = RBUS;
+            observer.PmPC(true, PC);
+        }
+
+        decideNextPhase();
+        observer.log("EX BEQ I1");
+
+        break;
+    default:
+        observer.log("ERROR EX BEQ");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::bpl() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        SBUS = IR & 0xff;
+        observer.PmSBUS(true);
+
+        // sign extend if negative
+        if (SBUS & 0x80)
+            SBUS |= 0xff00;
+
+        DBUS = PC;
+        observer.PdPCD(true);
+
+        RBUS = (u16)((short)SBUS + (short)DBUS);
+        observer.ALU(true, true, true, "SUM");
+        observer.PdALU(true);
+
+        if (!testFlag(0b0010)) {
+            PC = RBUS;
+            observer.PmPC(true, PC);
+        }
+
+        decideNextPhase();
+        observer.log("EX BPL I1");
+
+        break;
+    default:
+        observer.log("ERROR EX BPL");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::bcs() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        SBUS = IR & 0xff;
+        observer.PmSBUS(true);
+
+        // sign extend
+        if (SBUS & 0x80)
+            SBUS |= 0xff00;
+
+        DBUS = PC;
+        observer.PdPCD(true);
+
+        RBUS = (u16)((short)SBUS + (short)DBUS);
+        observer.ALU(true, true, true, "SUM");
+        observer.PdALU(true);
+
+        if (testFlag(0b1000)) {
+            PC = RBUS;
+            observer.PmPC(true, PC);
+        }
+
+        decideNextPhase();
+        observer.log("EX BCS I1");
+
+        break;
+    default:
+        observer.log("ERROR EX BCS");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::bcc() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        SBUS = IR & 0xff;
+        observer.PmSBUS(true);
+
+        // sign extend
+        if (SBUS & 0x80)
+            SBUS |= 0xff00;
+
+        DBUS = PC;
+        observer.PdPCD(true);
+
+        RBUS = (u16)((short)SBUS + (short)DBUS);
+        observer.ALU(true, true, true, "SUM");
+        observer.PdALU(true);
+
+        if (!testFlag(0b1000)) {
+            PC = RBUS;
+            observer.PmPC(true, PC);
+        }
+
+        decideNextPhase();
+        observer.log("EX BCC I1");
+
+        break;
+    default:
+        observer.log("ERROR EX BCC");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::bvs() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        SBUS = IR & 0xff;
+        observer.PmSBUS(true);
+
+        // sign extend if negative
+        if (SBUS & 0x80)
+            SBUS |= 0xff00;
+
+        DBUS = PC;
+        observer.PdPCD(true);
+
+        RBUS = (u16)((short)SBUS + (short)DBUS);
+        observer.ALU(true, true, true, "SUM");
+        observer.PdALU(true);
+
+        if (testFlag(0b0001)) {
+            PC = RBUS;
+            observer.PmPC(true, PC);
+        }
+
+        decideNextPhase();
+        observer.log("EX BVS I1");
+
+        break;
+    default:
+        observer.log("ERROR EX BVS");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::bvc() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        SBUS = IR & 0xff;
+        observer.PmSBUS(true);
+
+        // sign extend
+        if (SBUS & 0x80)
+            SBUS |= 0xff00;
+
+        DBUS = PC;
+        observer.PdPCD(true);
+
+        RBUS = (u16)((short)SBUS + (short)DBUS);
+        observer.ALU(true, true, true, "SUM");
+        observer.PdALU(true);
+
+        if (!testFlag(0b0001)) {
+            PC = RBUS;
+            observer.PmPC(true, PC);
+        }
+
+        decideNextPhase();
+        observer.log("EX BVC I1");
+
+        break;
+    default:
+        observer.log("ERROR EX BVC");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::clc() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        // Reset C bit in flag register
+        evaluateFlags();
+        FLAG &= 0xfff7;
+        observer.PmFLAG(true, FLAG);
+
+        decideNextPhase();
+        observer.log("EX CLC I1");
+
+        break;
+    default:
+        observer.log("ERROR EX CLC");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::clv() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        // Reset V bit in flag register
+        evaluateFlags();
+        FLAG &= 0xfffe;
+        observer.PmFLAG(true, FLAG);
+
+        decideNextPhase();
+        observer.log("EX CLV I1");
+
+        break;
+    default:
+        observer.log("ERROR EX CLV");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::clz() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        // Reset Z bit in flag register
+        evaluateFlags();
+        FLAG &= 0xfffb;
+        observer.PmFLAG(true, FLAG);
+
+        decideNextPhase();
+        observer.log("EX CLZ I1");
+
+        break;
+    default:
+        observer.log("ERROR EX CLZ");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::cls() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        // Reset S bit in flag register
+        evaluateFlags();
+        FLAG &= 0xfffd;
+        observer.PmFLAG(true, FLAG);
+
+        decideNextPhase();
+        observer.log("EX CLS I1");
+
+        break;
+    default:
+        observer.log("ERROR EX CLS");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::ccc() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        // Reset CZSV bit in flag register
+        evaluateFlags();
+        FLAG &= 0xfff0;
+        observer.PmFLAG(true, FLAG);
+
+        decideNextPhase();
+        observer.log("EX CCC I1");
+
+        break;
+    default:
+        observer.log("ERROR EX CCC");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::sec() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        // Set C bit in flag register
+        evaluateFlags();
+        FLAG |= 0x0008;
+        observer.PmFLAG(true, FLAG);
+
+        decideNextPhase();
+        observer.log("EX SEC I1");
+
+        break;
+    default:
+        observer.log("ERROR EX SEC");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::sev() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        // Set V bit in flag register
+        evaluateFlags();
+        FLAG |= 0x0001;
+        observer.PmFLAG(true, FLAG);
+
+        decideNextPhase();
+        observer.log("EX SEV I1");
+
+        break;
+    default:
+        observer.log("ERROR EX SEV");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::sez() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        // Get Z bit in flag register
+        evaluateFlags();
+        FLAG |= 0x0004;
+        observer.PmFLAG(true, FLAG);
+
+        decideNextPhase();
+        observer.log("EX SEZ I1");
+
+        break;
+    default:
+        observer.log("ERROR EX SEZ");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::ses() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        // Set S bit in flag register
+        evaluateFlags();
+        FLAG |= 0x0002;
+        observer.PmFLAG(true, FLAG);
+
+        decideNextPhase();
+        observer.log("EX SES I1");
+
+        break;
+    default:
+        observer.log("ERROR EX SES");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::scc() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        // Set CZSV bits in flag register
+        evaluateFlags();
+        FLAG |= 0x000f;
+        observer.PmFLAG(true, FLAG);
+
+        decideNextPhase();
+        observer.log("EX SCC I1");
+
+        break;
+    default:
+        observer.log("ERROR EX SCC");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::nop() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        decideNextPhase();
+        observer.log("EX NOP I1");
+
+        break;
+    default:
+        observer.log("ERROR EX NOP");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::ret() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        SBUS = SP;
+        observer.PdSPS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        ADR = RBUS;
+        observer.PmADR(true, ADR);
+
+        observer.log("EX RET I1");
+
+        break;
+    case 2:
+        MDR = readData(ADR);
+        observer.RD(true, "READ");
+        observer.PmMDR(true, MDR);
+
+        observer.log("EX RET I2");
+
+        break;
+    case 3:
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = DBUS;
+        observer.ALU(true, false, true, "DBUS");
+        observer.PdALU(true);
+
+        PC = RBUS;
+        observer.PmPC(true, PC);
+
+        SP += 2;
+        observer.SPchanged(true, SP);
+
+        decideNextPhase();
+
+        observer.log("EX RET I3");
+
+        break;
+    default:
+        observer.log("ERROR EX RET");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::reti() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        intr = false;
+
+        SBUS = SP;
+        observer.PdSPS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        ADR = RBUS;
+        observer.PmADR(true, ADR);
+
+        observer.log("EX RETI I1");
+
+        break;
+    case 2:
+        MDR = readData(ADR);
+        observer.RD(true, "READ");
+        observer.PmMDR(true, MDR);
+
+        observer.log("EX RETI I2");
+
+        break;
+    case 3:
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = DBUS;
+        observer.ALU(true, false, true, "DBUS");
+        observer.PdALU(true);
+
+        PC = RBUS;
+        observer.PmPC(true, PC);
+
+        SP += 2;
+        observer.SPchanged(true, SP);
+
+        observer.log("EX RETI I3");
+
+        break;
+    case 4:
+        SBUS = SP;
+        observer.PdSPS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        ADR = RBUS;
+        observer.PmADR(true, ADR);
+
+        observer.log("EX RETI I4");
+
+        break;
+    case 5:
+        MDR = readData(ADR);
+        observer.RD(true, "READ");
+        observer.PmMDR(true, MDR);
+
+        observer.log("EX RETI I5");
+
+        break;
+    case 6:
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = DBUS;
+        observer.ALU(true, false, true, "DBUS");
+        observer.PdALU(true);
+
+        setFlags(RBUS);
+        observer.PmFLAG(true, FLAG, true);
+
+        SP += 2;
+        observer.SPchanged(true, SP);
+
+        decideNextPhase();
+
+        observer.log("EX RETI I6");
+
+        break;
+    default:
+        observer.log("ERROR EX RETI");
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::uhalt()
+{
+    halt = true;
+    reason = "Halt encounted. Simulation finished!";
+}
+
+//this is not designed to function in run
+template <class Observer>
+void CpuCore<Observer>::wait()
+{
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        if(intr)
+            cgb.setPhase(Phase::INT);
+        else
+            cgb.setImpluse(cgb.getImpulse() - 1);
+
+        observer.log("EX WAIT I1");
+
+        break;
+    default:
+        observer.log("ERROR EX WAITP");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::pushpc() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        SP -= 2;
+        observer.SPchanged(true, SP);
+
+        observer.log("EX PUSHPC I1");
+
+        break;
+    case 2:
+        SBUS = SP;
+        observer.PdSPS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        ADR = RBUS;
+        observer.PmADR(true, ADR);
+
+        observer.log("EX PUSHPC I2");
+
+        break;
+    case 3:
+        SBUS = PC;
+        observer.PdPCS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        MDR = RBUS;
+        observer.PmMDR(true, MDR);
+
+        observer.log("EX PUSHPC I3");
+
+        break;
+    case 4:
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+
+        observer.log("EX PUSHPC I4");
+
+        break;
+    default:
+        observer.log("ERROR EX PUSHPC");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::poppc() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        SBUS = SP;
+        observer.PdSPS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        ADR = RBUS;
+        observer.PmADR(true, ADR);
+
+        observer.log("EX POPPC I1");
+
+        break;
+    case 2:
+        MDR = readData(ADR);
+        observer.RD(true, "READ");
+        observer.PmMDR(true, MDR);
+
+        observer.log("EX POPPC I2");
+
+        break;
+    case 3:
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = DBUS;
+        observer.ALU(true, false, true, "DBUS");
+        observer.PdALU(true);
+
+        PC = RBUS;
+        observer.PmPC(true, PC);
+
+        SP += 2;
+        observer.SPchanged(true, SP);
+
+        decideNextPhase();
+
+        break;
+    default:
+        observer.log("ERROR EX POPPC");
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::pushflag() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        SP -= 2;
+        observer.SPchanged(true, SP);
+
+        observer.log("EX PUSHFLAG I1");
+
+        break;
+    case 2:
+        SBUS = SP;
+        observer.PdSPS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        ADR = RBUS;
+        observer.PmADR(true, ADR);
+
+        observer.log("EX PUSHFLAG I2");
+
+        break;
+    case 3:
+        SBUS = evaluateFlags();
+        observer.PdFLAGS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        MDR = RBUS;
+        observer.PmMDR(true, MDR);
+
+        observer.log("EX PUSHFLAG I3");
+
+        break;
+    case 4:
+        writeWord(ADR, MDR);
+        observer.WR(true, "WRITE");
+
+        decideNextPhase();
+
+        observer.log("EX PUSHFLAG I4");
+
+        break;
+    default:
+        observer.log("ERROR EX PUSHFLAG");
+        break;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::popflag() {
+    switch(cgb.getAndIncrementImpulse()) {
+    case 1:
+        SBUS = SP;
+        observer.PdSPS(true);
+
+        RBUS = SBUS;
+        observer.ALU(true, true, false, "SBUS");
+        observer.PdALU(true);
+
+        ADR = RBUS;
+        observer.PmADR(true, ADR);
+
+        observer.log("EX POPFLAG I1");
+
+        break;
+    case 2:
+        MDR = readData(ADR);
+        observer.RD(true, "READ");
+        observer.PmMDR(true, MDR);
+
+        observer.log("EX POPFLAG I2");
+
+        break;
+    case 3:
+        DBUS = MDR;
+        observer.PdMDRD(true);
+
+        RBUS = DBUS;
+        observer.ALU(true, false, true, "DBUS");
+        observer.PdALU(true);
+
+        setFlags(RBUS);
+        observer.PmFLAG(true, FLAG, true);
+
+        SP += 2;
+        observer.SPchanged(true, SP);
+
+        decideNextPhase();
+
+        observer.log("EX POPFLAG I3");
+
+        break;
+    default:
+        observer.log("ERROR EX POPPC");
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::decideNextPhase()
+{
+    if(intr)
+        cgb.setPhase(Phase::INT);
+    else
+        cgb.setPhase(Phase::IF);
+}
+
+template <class Observer>
+void CpuCore<Observer>::setC(bool value)
+{
+    evaluateFlags();
+
+    if(value) {
+        FLAG |= 0b1000;
+        observer.PmFLAG(true, FLAG);
+    }
+    else {
+        FLAG &= 0b0111;
+        observer.PmFLAG(true, FLAG);
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::setZ()
+{
+    evaluateFlags();
+
+    if(checkZ()) {
+        FLAG |= 0b0100;
+        observer.PmFLAG(true, FLAG);
+    }
+    else {
+        FLAG &= 0b1011;
+        observer.PmFLAG(true, FLAG);
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::setS()
+{
+    evaluateFlags();
+
+    if(checkS()) {
+        FLAG |= 0b0010;
+        observer.PmFLAG(true, FLAG);
+    }
+    else {
+        FLAG &= 0b1101;
+        observer.PmFLAG(true, FLAG);
+    }
+}
+
+template <class Observer>
+bool CpuCore<Observer>::checkZ()
+{
+    return RBUS == 0;
+}
+
+template <class Observer>
+bool CpuCore<Observer>::checkS()
+{
+    return RBUS >> 15;
+}
+
+template <class Observer>
+void CpuCore<Observer>::deferFlags(FlagOperation operation, u16 source, u16 destination, u16 result)
+{
+    flagOperation = operation;
+    flagSource = source;
+    flagDestination = destination;
+    flagResult = result;
+}
+
+template <class Observer>
+u16 CpuCore<Observer>::deferredFlags()
+{
+    return deferredFlagValue(flagOperation, flagSource, flagDestination, flagResult);
+}
+
+template <class Observer>
+u16 CpuCore<Observer>::evaluateFlags()
+{
+    if (flagOperation != FlagOperation::none) {
+        FLAG = deferredFlags();
+        flagOperation = FlagOperation::none;
+    }
+
+    return FLAG;
+}
+
+template <class Observer>
+void CpuCore<Observer>::setFlags(u16 value)
+{
+    FLAG = value;
+    flagOperation = FlagOperation::none;
+}
+
+template <class Observer>
+bool CpuCore<Observer>::testFlag(u16 bit)
+{
+    if (flagOperation == FlagOperation::none)
+        return FLAG & bit;
+
+    // Z and S come straight from the result
+    switch (bit) {
+    case 0b0100:
+        return flagResult == 0;
+    case 0b0010:
+        return flagResult >> 15;
+    default:
+        return deferredFlags() & bit;
+    }
+}
+
+template <class Observer>
+u16 CpuCore<Observer>::observedFlags()
+{
+    return Observer::showsFlags ? evaluateFlags() : FLAG;
+}
+
+// Records written bytes for observers that show memory. Ranges that
+// touch the previous one are merged, past maxDirtyRanges they collapse
+// into the range covering all of them
+template <class Observer>
+void CpuCore<Observer>::markDirty(u16 address, u32 length)
+{
+    if (!Observer::showsMemory)
+        return;
+
+    // Words at 0xffff wrap around
+    if (address + length > 1 << 16) {
+        u32 head = (1 << 16) - address;
+
+        markDirty(address, head);
+        markDirty(0, length - head);
+        return;
+    }
+
+    if (!dirtyRanges.empty()) {
+        MemoryRange &last = dirtyRanges.back();
+
+        if (address <= last.address + last.length && address + length >= last.address) {
+            u32 end = std::max<u32>(last.address + last.length, address + length);
+
+            last.address = std::min(last.address, address);
+            last.length = end - last.address;
+            return;
+        }
+    }
+
+    if (dirtyRanges.size() == maxDirtyRanges) {
+        u32 first = address;
+        u32 end = address + length;
+
+        for (const MemoryRange &range : dirtyRanges) {
+            first = std::min<u32>(first, range.address);
+            end = std::max<u32>(end, range.address + range.length);
+        }
+
+        dirtyRanges.clear();
+        dirtyRanges.push_back({(u16)first, end - first});
+        return;
+    }
+
+    dirtyRanges.push_back({address, length});
+}
+
+template <class Observer>
+void CpuCore<Observer>::publishMemory()
+{
+    if (!Observer::showsMemory || dirtyRanges.empty())
+        return;
+
+    observer.PmMem(dirtyRanges);
+    dirtyRanges.clear();
+}
+
+template <class Observer>
+void CpuCore<Observer>::resetActivatedSignals()
+{
+    observer.PdPCD(false);
+    observer.ALU(false, false, false);
+    observer.PdALU(false);
+    observer.PmADR(false, ADR);
+    observer.RD(false);
+    observer.PmIR(false, IR);
+    observer.PCchanged(false, PC);
+    observer.SPchanged(false, SP);
+    observer.PmT(false, T);
+    observer.PdRGS(false);
+    observer.PmMDR(false, MDR);
+    observer.PdRGS(false);
+    observer.PdMDRS(false);
+    observer.PdMDRD(false);
+    observer.PdRGD(false);
+    observer.PdPCS(false);
+    publishMemory();
+    observer.PdTS(false);
+    observer.PmRG(false);
+    observer.WR(false);
+    observer.PmFLAG(false, observedFlags());
+    observer.PmPC(false, PC);
+    observer.PdSPS(false);
+    observer.PdFLAGS(false);
+    observer.PdIVRS(false);
+    observer.loadIVR(false, IVR);
+}
+
+template <class Observer>
+void CpuCore<Observer>::publishState()
+{
+    for (u8 index = 0; index < 16; index++)
+        observer.PmRG(true, index, R[index]);
+
+    resetActivatedSignals();
+}
+
+template <class Observer>
+void CpuCore<Observer>::setInterrupt()
+{
+    interruptLog.push_back(impulseCount);
+
+    if (trace)
+        trace->request(impulseCount);
+
+    intr = true;
+    IVR = 1000;
+    observer.loadIVR(true, IVR);
+}
+
+template <class Observer>
+const std::vector<u64> &CpuCore<Observer>::getInterruptLog()
+{
+    return interruptLog;
+}
+
+template <class Observer>
+void CpuCore<Observer>::replayInterrupts(const std::vector<u64> &impulses)
+{
+    scheduledInterrupts = impulses;
+    nextInterrupt = 0;
+    interruptDue = scheduledInterrupts.empty() ? noInterrupt : scheduledInterrupts.front();
+}
+
+template <class Observer>
+void CpuCore<Observer>::setTrace(TraceWriter *writer)
+{
+    trace = writer;
+    tracePC = PC;
+
+    if (trace)
+        trace->keyframe(saveState(), impulseCount);
+}
+
+// Sampling profilers miss the calls and returns of translated code
+template <class Observer>
+bool CpuCore<Observer>::followsCalls()
+{
+    return !jit || trace;
+}
+
+template <class Observer>
+void CpuCore<Observer>::setProfiler(Profiler *profiler)
+{
+    this->profiler = profiler;
+    sampling = profiler && profiler->getSamplePeriod();
+    tracePC = PC;
+    instructionStart = impulseCount;
+
+    if (sampling)
+        profiler->startSampling(impulseCount);
+}
+
+template <class Observer>
+void CpuCore<Observer>::setCoverage(Coverage *coverage)
+{
+    this->coverage = coverage;
+
+    // Instructions decoded so far would not be noted again
+    if (jit) {
+        flushTranslations();
+    }
+    else {
+        for (DecodedInstruction &entry : decoded)
+            entry.length = 0;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::setBreakpoint(u16 address, const BreakpointCondition &condition)
+{
+    breakpoints[address] = condition;
+    breakpointWords[address >> 7] |= 1ull << (address >> 1 & 63);
+
+    // Translated and decoded instructions do not test for it
+    if (jit)
+        flushTranslations();
+    else if (!decoded.empty())
+        decoded[address >> 1].length = 0;
+}
+
+template <class Observer>
+void CpuCore<Observer>::clearBreakpoint(u16 address)
+{
+    breakpoints.erase(address);
+
+    // The other byte of the word may keep the bit
+    if (!breakpoints.count(address ^ 1))
+        breakpointWords[address >> 7] &= ~(1ull << (address >> 1 & 63));
+}
+
+template <class Observer>
+void CpuCore<Observer>::clearBreakpoints()
+{
+    breakpoints.clear();
+    memset(breakpointWords, 0, sizeof(breakpointWords));
+}
+
+template <class Observer>
+bool CpuCore<Observer>::atBreakpoint()
+{
+    return breakpointHit;
+}
+
+template <class Observer>
+bool CpuCore<Observer>::hasBreakpoint(u16 address)
+{
+    return breakpointWords[address >> 7] >> (address >> 1 & 63) & 1;
+}
+
+// Whether the run stops before the instruction at address. Not while
+// replaying, and not again at the stop the run resumes from, which is the
+// only one at its impulse count
+template <class Observer>
+bool CpuCore<Observer>::breakpointAt(u16 address)
+{
+    if (!hasBreakpoint(address) || replaying || impulseCount == resumeImpulse)
+        return false;
+
+    auto breakpoint = breakpoints.find(address);
+
+    if (breakpoint == breakpoints.end() || !breakpoint->second.holds(R, PC, SP, evaluateFlags(), memory))
+        return false;
+
+    breakpointHit = true;
+    resumeImpulse = impulseCount;
+
+    return true;
+}
+
+template <class Observer>
+void CpuCore<Observer>::setWatchpoint(u16 address, u32 length, u8 access)
+{
+    if (!length || !access)
+        return;
+
+    watchpoints.push_back({address, std::min<u32>(length, 1 << 16), access});
+    watchPages();
+    protectWatchpoints();
+}
+
+template <class Observer>
+void CpuCore<Observer>::clearWatchpoints()
+{
+    watchpoints.clear();
+    watchPages();
+
+    // Drops the protection of the watched bytes
+    if (jit)
+        flushTranslations();
+}
+
+template <class Observer>
+bool CpuCore<Observer>::atWatchpoint()
+{
+    return watchpointHit;
+}
+
+template <class Observer>
+WatchpointHit CpuCore<Observer>::getWatchpointHit()
+{
+    return watchedAccess;
+}
+
+// Records the first access of a run to watched bytes. The page test
+// before the call also passes words next to watched ones
+template <class Observer>
+void CpuCore<Observer>::watchAccess(u16 address, bool write, u16 oldValue, u16 newValue, u8 impulse)
+{
+    if (watchpointHit || replaying)
+        return;
+
+    u8 access = write ? watchWrite : watchRead;
+    bool watched = false;
+
+    for (const Watchpoint &watchpoint : watchpoints) {
+        if ((watchpoint.access & access) &&
+            ((u16)(address - watchpoint.address) < watchpoint.length ||
+             (u16)(address + 1 - watchpoint.address) < watchpoint.length)) {
+            watched = true;
+            break;
+        }
+    }
+
+    if (!watched)
+        return;
+
+    bool interrupt = cgb.getPhase() == Phase::INT;
+
+    watchpointHit = true;
+    watchedAccess.address = address;
+    watchedAccess.write = write;
+    watchedAccess.oldValue = oldValue;
+    watchedAccess.newValue = newValue;
+    watchedAccess.interrupt = interrupt;
+    // The interpreter fills in the start of instructions when they finish
+    watchedAccess.instruction = interrupt ? PC : tracePC;
+    watchedAccess.impulse = impulseCount + impulse;
+}
+
+// A word access at address touches address + 1 as well, so the byte
+// before each watched range marks its page too
+template <class Observer>
+void CpuCore<Observer>::watchPages()
+{
+    memset(watchedPages, 0, sizeof(watchedPages));
+    watchesReads = false;
+
+    for (const Watchpoint &watchpoint : watchpoints) {
+        for (u32 offset = 0; offset <= watchpoint.length; offset++)
+            watchedPages[(u16)(watchpoint.address - 1 + offset) >> 8] |= watchpoint.access;
+
+        if (watchpoint.access & watchRead)
+            watchesReads = true;
+    }
+}
+
+// Translated stores into watched bytes leave to the interpreter, which
+// sees them
+template <class Observer>
+void CpuCore<Observer>::protectWatchpoints()
+{
+    if (!jit)
+        return;
+
+    for (const Watchpoint &watchpoint : watchpoints) {
+        if (!(watchpoint.access & watchWrite))
+            continue;
+
+        for (u32 offset = 0; offset < watchpoint.length; offset += 0x8000)
+            jit->protect(watchpoint.address + offset, std::min<u32>(watchpoint.length - offset, 0x8000));
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::requestScheduledInterrupts()
+{
+    while (interruptDue <= impulseCount) {
+        setInterrupt();
+
+        nextInterrupt++;
+        interruptDue = nextInterrupt < scheduledInterrupts.size() ? scheduledInterrupts[nextInterrupt]
+                                                                  : noInterrupt;
+    }
+}
+
+template <class Observer>
+void CpuCore<Observer>::setHistory(size_t capacity, u64 interval)
+{
+    historyCapacity = capacity;
+    historyInterval = std::max<u64>(interval, 1);
+
+    resetHistory();
+}
+
+template <class Observer>
+bool CpuCore<Observer>::rewind(u64 impulse)
+{
+    if (checkpoints.empty() || impulse < checkpoints.front().state.impulseCount || impulse > impulseCount)
+        return false;
+
+    replayTo(impulse);
+    return true;
+}
+
+template <class Observer>
+bool CpuCore<Observer>::stepBack()
+{
+    return impulseCount && rewind(impulseCount - 1);
+}
+
+template <class Observer>
+bool CpuCore<Observer>::stepBackInstruction()
+{
+    u64 now = impulseCount;
+    u64 start;
+
+    if (checkpoints.empty())
+        return false;
+
+    if (!findInHistory(now, [](const CpuRegisters &) { return true; }, start)) {
+        replayTo(now);
+        return false;
+    }
+
+    replayTo(start);
+    return true;
+}
+
+template <class Observer>
+bool CpuCore<Observer>::reverseContinue(const std::function<bool(const CpuRegisters &)> &stop)
+{
+    u64 position;
+
+    if (checkpoints.empty())
+        return false;
+
+    bool found = findInHistory(impulseCount, stop, position);
+    replayTo(found ? position : checkpoints.front().state.impulseCount);
+
+    return found;
+}
+
+// Drops the checkpoints, the state they led to was replaced
+template <class Observer>
+void CpuCore<Observer>::resetHistory()
+{
+    checkpoints.clear();
+
+    if (historyCapacity)
+        takeCheckpoint();
+}
+
+template <class Observer>
+void CpuCore<Observer>::takeCheckpoint()
+{
+    if (checkpoints.size() == historyCapacity)
+        checkpoints.pop_front();
+
+    checkpoints.emplace_back();
+
+    CpuCheckpoint &checkpoint = checkpoints.back();
+    saveRegisters(checkpoint.state);
+    checkpoint.memory = memory;
+    checkpoint.interrupts = interruptLog.size();
+
+    historyInstructions = 0;
+}
+
+// Goes back to a checkpoint. The interrupts logged since then are requested
+// again as the core runs forward, ahead of those still to be replayed
+template <class Observer>
+void CpuCore<Observer>::restoreCheckpoint(size_t index)
+{
+    const CpuCheckpoint &checkpoint = checkpoints[index];
+
+    std::vector<u64> interrupts(interruptLog.begin() + checkpoint.interrupts, interruptLog.end());
+    interrupts.insert(interrupts.end(), scheduledInterrupts.begin() + nextInterrupt, scheduledInterrupts.end());
+
+    interruptLog.resize(checkpoint.interrupts);
+    replayInterrupts(interrupts);
+
+    restoreRegisters(checkpoint.state);
+    memory = checkpoint.memory;
+    memoryReplaced();
+
+    historyInstructions = 0;
+}
+
+// Runs forward from the newest checkpoint at or before impulse, which
+// becomes the newest one kept
+template <class Observer>
+void CpuCore<Observer>::replayTo(u64 impulse)
+{
+    size_t index = checkpoints.size() - 1;
+    while (index && checkpoints[index].state.impulseCount > impulse)
+        index--;
+
+    restoreCheckpoint(index);
+    checkpoints.resize(index + 1);
+
+    runTo(impulse);
+}
+
+template <class Observer>
+void CpuCore<Observer>::runTo(u64 impulse)
+{
+    TraceWriter *suspended = trace;
+    Profiler *suspendedProfiler = profiler;
+    bool suspendedSampling = sampling;
+    trace = nullptr;
+    profiler = nullptr;
+    sampling = false;
+    replaying = true;
+
+    while (impulseCount < impulse && !halt) {
+        u64 count = (impulse - impulseCount) / maxInstructionImpulses;
+
+        // wait repeats its first impulse until the next request
+        if (isWaiting() && !intr && interruptDue > impulseCount)
+            impulseCount = std::min(impulse, interruptDue);
+        else if (!count || !runInstructions(count))
+            advance();
+    }
+
+    replaying = false;
+    trace = suspended;
+    profiler = suspendedProfiler;
+    sampling = suspendedSampling;
+}
+
+// Runs every checkpoint forward from the newest one back, until one holds
+// an instruction start before the impulse count before at which stop does
+template <class Observer>
+bool CpuCore<Observer>::findInHistory(u64 before, const std::function<bool(const CpuRegisters &)> &stop,
+                                      u64 &found)
+{
+    bool any = false;
+
+    TraceWriter *suspended = trace;
+    Profiler *suspendedProfiler = profiler;
+    bool suspendedSampling = sampling;
+    trace = nullptr;
+    profiler = nullptr;
+    sampling = false;
+    replaying = true;
+
+    for (size_t index = checkpoints.size(); index-- > 0 && !any;) {
+        if (checkpoints[index].state.impulseCount >= before)
+            continue;
+
+        u64 end = index + 1 < checkpoints.size() ? checkpoints[index + 1].state.impulseCount : before;
+
+        restoreCheckpoint(index);
+
+        while (impulseCount < end && !halt) {
+            if (stop(getRegisters())) {
+                found = impulseCount;
+                any = true;
+            }
+
+            if (isWaiting() && !intr && interruptDue > impulseCount) {
+                if (interruptDue >= end)
+                    break;
+
+                impulseCount = interruptDue;
+            }
+
+            // The INT phase on its own, runInstructions() would go on
+            // with the first instruction of the handler
+            if (cgb.getPhase() == Phase::INT && atInstructionBoundary())
+                stepInstruction();
+            else
+                runInstructions(1);
+        }
+    }
+
+    replaying = false;
+    trace = suspended;
+    profiler = suspendedProfiler;
+    sampling = suspendedSampling;
+
+    return any;
+}
+
+#endif // CPUCOREIMPL_H
@@ -0,0 +1,274 @@
+#include "cpuworker.h"
+
+#include <QMetaObject>
+
+#include <algorithm>
+
+CpuWorker::CpuWorker(Cpu *cpu) : QObject(nullptr), core(CpuSignalObserver(cpu, this))
+{
+    status = CpuStatus::paused;
+    sliceInstructions = minSliceInstructions;
+    frameInterval = 1000 / 30;
+    framePending = false;
+    publishedInterrupts = 0;
+}
+
+std::vector<u8> CpuWorker::getMemory()
+{
+    return core.getMemory();
+}
+
+void CpuWorker::memoryWritten(const std::vector<MemoryRange> &ranges)
+{
+    writtenRanges.insert(writtenRanges.end(), ranges.begin(), ranges.end());
+}
+
+void CpuWorker::frameShown()
+{
+    framePending = false;
+}
+
+void CpuWorker::load(const QByteArray &machineCode)
+{
+    core.setMachineCodeInMemory(reinterpret_cast<u8 *>(const_cast<char *>(machineCode.data())),
+                                machineCode.size());
+}
+
+void CpuWorker::step()
+{
+    if (status != CpuStatus::paused)
+        return;
+
+    if (!core.advance()) {
+        reason = QString::fromStdString(core.getReason());
+        status = CpuStatus::halted;
+    }
+
+    publish();
+}
+
+void CpuWorker::stepBack()
+{
+    if (status != CpuStatus::paused && !(status == CpuStatus::halted && core.isHalted()))
+        return;
+
+    if (core.stepBack())
+        status = CpuStatus::paused;
+
+    core.publishState();
+    publish();
+}
+
+void CpuWorker::setHistorySize(int megabytes)
+{
+    // A checkpoint holds at most all of memory
+    size_t checkpointBytes = (1 << 16) + sizeof(CpuCheckpoint);
+
+    core.setHistory(((size_t)megabytes << 20) / checkpointBytes, historyInterval);
+}
+
+void CpuWorker::run()
+{
+    if (status != CpuStatus::paused)
+        return;
+
+    setStatus(CpuStatus::running);
+    frameTimer.start();
+    QMetaObject::invokeMethod(this, "runSlice", Qt::QueuedConnection);
+}
+
+// Runs one slice and queues the next one behind the commands that arrived
+// meanwhile
+void CpuWorker::runSlice()
+{
+    if (status != CpuStatus::running)
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    u64 executed = core.runInstructions(sliceInstructions);
+    qint64 elapsed = timer.nsecsElapsed();
+
+    if (elapsed < sliceNanoseconds / 2 && sliceInstructions < maxSliceInstructions)
+        sliceInstructions *= 2;
+    else if (elapsed > sliceNanoseconds * 2 && sliceInstructions > minSliceInstructions)
+        sliceInstructions /= 2;
+
+    if (core.isHalted()) {
+        reason = QString::fromStdString(core.getReason());
+        status = CpuStatus::halted;
+        publish(true);
+        return;
+    }
+
+    if (core.atBreakpoint() || core.atWatchpoint()) {
+        status = CpuStatus::paused;
+        publish(true);
+        return;
+    }
+
+    // Nothing runs until setInterrupt()
+    if (!executed) {
+        status = CpuStatus::waiting;
+        publish(true);
+        return;
+    }
+
+    // Written ranges keep accumulating while the GUI is behind
+    if (!framePending && frameTimer.elapsed() >= frameInterval) {
+        publish(true);
+        frameTimer.restart();
+    }
+
+    QMetaObject::invokeMethod(this, "runSlice", Qt::QueuedConnection);
+}
+
+void CpuWorker::pause()
+{
+    if (status != CpuStatus::running && status != CpuStatus::waiting)
+        return;
+
+    status = CpuStatus::paused;
+    publish(true);
+}
+
+void CpuWorker::stop()
+{
+    if (status == CpuStatus::halted)
+        return;
+
+    reason = tr("Simulation stopped");
+    status = CpuStatus::halted;
+    publish(true);
+}
+
+void CpuWorker::setInterrupt()
+{
+    core.setInterrupt();
+
+    if (status == CpuStatus::waiting) {
+        setStatus(CpuStatus::running);
+        QMetaObject::invokeMethod(this, "runSlice", Qt::QueuedConnection);
+    }
+}
+
+void CpuWorker::replayInterrupts(const std::vector<u64> &impulses)
+{
+    core.replayInterrupts(impulses);
+}
+
+void CpuWorker::setBreakpoint(int address, const QString &condition)
+{
+    core.setBreakpoint((u16)address, BreakpointCondition(condition.toStdString()));
+}
+
+void CpuWorker::clearBreakpoints()
+{
+    core.clearBreakpoints();
+}
+
+void CpuWorker::setWatchpoint(int address, int length, int access)
+{
+    core.setWatchpoint((u16)address, (u32)length, (u8)access);
+}
+
+void CpuWorker::clearWatchpoints()
+{
+    core.clearWatchpoints();
+}
+
+void CpuWorker::restoreState(const QByteArray &state)
+{
+    if (status == CpuStatus::running || status == CpuStatus::waiting)
+        return;
+
+    if (!core.restoreState(reinterpret_cast<const u8 *>(state.data()), state.size()))
+        return;
+
+    reason = QString::fromStdString(core.getReason());
+    status = core.isHalted() ? CpuStatus::halted : CpuStatus::paused;
+
+    core.publishState();
+    publish(true);
+}
+
+void CpuWorker::setJitMode(JitMode mode)
+{
+    core.setJitMode(mode);
+}
+
+void CpuWorker::setFrameRate(int framesPerSecond)
+{
+    frameInterval = 1000 / framesPerSecond;
+}
+
+void CpuWorker::publishState()
+{
+    core.publishState();
+    publish();
+}
+
+void CpuWorker::resetActivatedSignals()
+{
+    core.resetActivatedSignals();
+    publish();
+}
+
+void CpuWorker::setStatus(CpuStatus status)
+{
+    this->status = status;
+    publish(true);
+}
+
+void CpuWorker::publish(bool frame)
+{
+    // runInstructions() leaves its ranges with the core
+    core.publishMemory();
+
+    CpuSnapshot snapshot;
+    snapshot.status = status;
+    snapshot.reason = reason;
+    snapshot.impulseCount = core.getImpulseCount();
+    snapshot.jitStatistics = core.getJitStatistics();
+    snapshot.registers = core.getRegisters();
+    snapshot.frame = frame;
+    snapshot.breakpoint = status == CpuStatus::paused && core.atBreakpoint();
+
+    if (status == CpuStatus::paused && core.atWatchpoint()) {
+        WatchpointHit hit = core.getWatchpointHit();
+        QString access = hit.write ? tr("0x%1 written, 0x%2 to 0x%3").arg(hit.address, 4, 16, QChar('0'))
+                                         .arg(hit.oldValue, 4, 16, QChar('0'))
+                                         .arg(hit.newValue, 4, 16, QChar('0'))
+                                   : tr("0x%1 read, 0x%2").arg(hit.address, 4, 16, QChar('0'))
+                                         .arg(hit.newValue, 4, 16, QChar('0'));
+        QString by = hit.interrupt ? tr("the interrupt entry returning to 0x%1")
+                                   : tr("the instruction at 0x%1");
+
+        snapshot.watchpoint = tr("%1 by %2").arg(access, by.arg(hit.instruction, 4, 16, QChar('0')));
+    }
+
+    if (frame)
+        framePending = true;
+
+    const PagedMemory &memory = core.getMemoryView();
+
+    for (const MemoryRange &range : writtenRanges) {
+        size_t offset = snapshot.bytes.size();
+
+        snapshot.ranges.push_back(range);
+        snapshot.bytes.resize(offset + range.length);
+        memory.read(range.address, range.length, snapshot.bytes.data() + offset);
+    }
+
+    writtenRanges.clear();
+
+    // Going back drops the requests logged since the checkpoint
+    const std::vector<u64> &interrupts = core.getInterruptLog();
+    publishedInterrupts = std::min(publishedInterrupts, interrupts.size());
+    snapshot.interruptsKept = publishedInterrupts;
+    snapshot.interrupts.assign(interrupts.begin() + publishedInterrupts, interrupts.end());
+    publishedInterrupts = interrupts.size();
+
+    emit snapshotReady(snapshot);
+}
@@ -0,0 +1,88 @@
+#ifndef CPUWORKER_H
+#define CPUWORKER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <cpu/cpu.h>
+
+#include <atomic>
+
+//// Owns the core of a Cpu and lives on its execution thread. The slots are
+//// only invoked through queued connections, so the core is never touched
+//// by two threads
+class CpuWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CpuWorker(Cpu *cpu);
+
+    //// Only valid before the worker is moved to the execution thread
+    std::vector<u8> getMemory();
+
+    //// Collects the ranges reported by the core for the next snapshot
+    void memoryWritten(const std::vector<MemoryRange> &ranges);
+
+    //// Called by the GUI thread once it applied a frame, the next one may
+    //// then be published
+    void frameShown();
+
+public slots:
+    void load(const QByteArray &machineCode);
+    void step();
+    void stepBack();
+    void setHistorySize(int megabytes);
+    void run();
+    void pause();
+    void stop();
+    void setInterrupt();
+    void replayInterrupts(const std::vector<u64> &impulses);
+    void setBreakpoint(int address, const QString &condition);
+    void clearBreakpoints();
+    void setWatchpoint(int address, int length, int access);
+    void clearWatchpoints();
+    void restoreState(const QByteArray &state);
+    void setJitMode(JitMode mode);
+    void setFrameRate(int framesPerSecond);
+    void publishState();
+    void resetActivatedSignals();
+
+signals:
+    void snapshotReady(const CpuSnapshot &snapshot);
+
+private slots:
+    void runSlice();
+
+private:
+    void setStatus(CpuStatus status);
+    void publish(bool frame = false);
+
+    // Slices are sized to take about this long, which bounds how late a
+    // command queued while running is handled
+    static const qint64 sliceNanoseconds = 2000000;
+    static const u64 minSliceInstructions = 1 << 10;
+    static const u64 maxSliceInstructions = 1 << 26;
+
+    // Instructions between two checkpoints of the history, each of which
+    // stepBack() may run again
+    static const u64 historyInterval = 1 << 16;
+
+    CpuCore<CpuSignalObserver> core;
+
+    CpuStatus status;
+    QString reason;
+
+    u64 sliceInstructions;
+
+    // Milliseconds between frames while running
+    qint64 frameInterval;
+    QElapsedTimer frameTimer;
+    std::atomic<bool> framePending;
+
+    // Reported by the core since the last snapshot
+    std::vector<MemoryRange> writtenRanges;
+
+    // Entries of the core's interrupt log already in a snapshot
+    size_t publishedInterrupts;
+};
+
+#endif // CPUWORKER_H
@@ -0,0 +1,43 @@
+#include "interruptlog.h"
+
+#include <cctype>
+#include <stdexcept>
+#include <string>
+
+std::vector<u64> readInterruptLog(std::istream &input)
+{
+    std::vector<u64> impulses;
+    std::string line;
+
+    for (size_t number = 1; std::getline(input, line); number++) {
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        size_t digits = 0;
+        while (digits < line.size() && isdigit((unsigned char)line[digits]))
+            digits++;
+
+        if (!digits || digits != line.size() || digits > 19)
+            throw std::runtime_error("line " + std::to_string(number) + ": expected an impulse count");
+
+        u64 impulse = std::stoull(line);
+
+        if (!impulses.empty() && impulse < impulses.back())
+            throw std::runtime_error("line " + std::to_string(number) + ": impulse counts go back");
+
+        impulses.push_back(impulse);
+    }
+
+    return impulses;
+}
+
+void writeInterruptLog(std::ostream &output, const std::vector<u64> &impulses)
+{
+    output << "# impulse counts of interrupt requests\n";
+
+    for (u64 impulse : impulses)
+        output << impulse << '\n';
+}
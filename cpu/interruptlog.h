@@ -0,0 +1,20 @@
+#ifndef INTERRUPTLOG_H
+#define INTERRUPTLOG_H
+
+#include "assembler/defs.h"
+
+#include <istream>
+#include <ostream>
+#include <vector>
+
+//// Interrupt logs of CpuCore::getInterruptLog() as text, one decimal
+//// impulse count per line. Blank lines and lines starting with # are
+//// skipped
+
+//// Throws std::runtime_error on a line that is not a count, or a count
+//// below the one before it
+std::vector<u64> readInterruptLog(std::istream &input);
+
+void writeInterruptLog(std::ostream &output, const std::vector<u64> &impulses);
+
+#endif // INTERRUPTLOG_H
@@ -0,0 +1,1320 @@
+#include <cpu/jit.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+
+#include <cpu/cpucore.h>
+#include <cpu/pagedmemory.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+const size_t bufferSize = 8 << 20;
+
+// Upper bound of the code emitted for one instruction, side exit included
+const size_t maxInstructionSize = 512;
+
+enum Register : u8 {
+    rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+    r8, r9, r10, r11, r12, r13, r14, r15,
+    noRegister = 0xff
+};
+
+enum Condition : u8 {
+    below = 0x2,
+    equal = 0x4,
+    notEqual = 0x5
+};
+
+enum AluOperation : u8 {
+    aluAdd = 0,
+    aluOr = 1,
+    aluAnd = 4,
+    aluSub = 5,
+    aluXor = 6,
+    aluCmp = 7
+};
+
+enum ShiftOperation : u8 {
+    shiftLeft = 4,
+    shiftRight = 5
+};
+
+// Registers of translated code. Guest values are kept in JitState between
+// instructions except FLAG, which a block keeps in flagRegister until it
+// leaves. Everything else is scratch
+const Register statePointer = rbx;
+const Register pageTable = r12;
+const Register codeMap = r13;
+const Register blockTable = r14;
+const Register counterTable = r15;
+const Register flagRegister = r11;
+
+//// base + index * scale + displacement
+struct Address
+{
+    Register base;
+    Register index;
+    u8 scale;
+    int displacement;
+};
+
+Address at(Register base, int displacement = 0)
+{
+    return {base, noRegister, 1, displacement};
+}
+
+Address at(Register base, Register index, u8 scale = 1, int displacement = 0)
+{
+    return {base, index, scale, displacement};
+}
+
+Address field(size_t offset)
+{
+    return at(statePointer, (int)offset);
+}
+
+Address registerField(u8 index)
+{
+    return field(offsetof(JitState, R) + 2 * index);
+}
+
+const Address pcField = field(offsetof(JitState, PC));
+const Address spField = field(offsetof(JitState, SP));
+const Address flagField = field(offsetof(JitState, FLAG));
+const Address exitField = field(offsetof(JitState, exit));
+const Address budgetField = field(offsetof(JitState, budget));
+const Address impulsesField = field(offsetof(JitState, impulses));
+const Address pagesField = field(offsetof(JitState, pages));
+const Address linkField = field(offsetof(JitState, link));
+const Address superblockField = field(offsetof(JitState, superblockInstructions));
+
+//// Encoder of the few x86-64 instructions translated code is made of
+class Assembler
+{
+public:
+    explicit Assembler(u8 *position) : position(position) {}
+
+    u8 *here() { return position; }
+
+    void byte(u8 value) { *position++ = value; }
+
+    void word(u16 value)
+    {
+        memcpy(position, &value, sizeof(value));
+        position += sizeof(value);
+    }
+
+    void dword(u32 value)
+    {
+        memcpy(position, &value, sizeof(value));
+        position += sizeof(value);
+    }
+
+    void qword(u64 value)
+    {
+        memcpy(position, &value, sizeof(value));
+        position += sizeof(value);
+    }
+
+    // Instructions
+    void movzxWord(Register destination, Address source) { rm(false, destination, source, {0x0f, 0xb7}); }
+    void movzxWord(Register destination, Register source) { rr(false, destination, source, {0x0f, 0xb7}); }
+    void loadQword(Register destination, Address source) { rm(true, destination, source, {0x8b}); }
+    void storeQword(Address destination, Register source) { rm(true, source, destination, {0x89}); }
+    void lea(Register destination, Address source) { rm(false, destination, source, {0x8d}); }
+
+    void storeWord(Address destination, Register source)
+    {
+        byte(0x66);
+        rm(false, source, destination, {0x89});
+    }
+
+    void storeWord(Address destination, u16 value)
+    {
+        byte(0x66);
+        rm(false, rax, destination, {0xc7});
+        word(value);
+    }
+
+    void storeByte(Address destination, u8 value)
+    {
+        rm(false, rax, destination, {0xc6});
+        byte(value);
+    }
+
+    void mov(Register destination, Register source) { rr(false, source, destination, {0x89}); }
+
+    void mov(Register destination, u32 value)
+    {
+        if (destination >= r8)
+            byte(0x41);
+        byte(0xb8 + (destination & 7));
+        dword(value);
+    }
+
+    void movQword(Register destination, Register source) { rr(true, source, destination, {0x89}); }
+
+    void mov64(Register destination, u64 value)
+    {
+        byte(0x48 | (destination >> 3));
+        byte(0xb8 + (destination & 7));
+        qword(value);
+    }
+
+    void alu(AluOperation operation, Register destination, Register source)
+    {
+        rr(false, source, destination, {(u8)((operation << 3) | 0x01)});
+    }
+
+    void alu(AluOperation operation, Register destination, u32 value)
+    {
+        rr(false, (Register)operation, destination, {0x81});
+        dword(value);
+    }
+
+    void aluQword(AluOperation operation, Address destination, u32 value)
+    {
+        rm(true, (Register)operation, destination, {0x81});
+        dword(value);
+    }
+
+    void aluDword(AluOperation operation, Address destination, u32 value)
+    {
+        rm(false, (Register)operation, destination, {0x81});
+        dword(value);
+    }
+
+    void test(Register first, Register second) { rr(false, second, first, {0x85}); }
+
+    void test(Register destination, u32 value)
+    {
+        rr(false, rax, destination, {0xf7});
+        dword(value);
+    }
+    void testQword(Register first, Register second) { rr(true, second, first, {0x85}); }
+
+    void shift(ShiftOperation operation, Register destination, u8 count)
+    {
+        rr(false, (Register)operation, destination, {0xc1});
+        byte(count);
+    }
+
+    void notReg(Register destination) { rr(false, (Register)2, destination, {0xf7}); }
+
+    void setcc(Condition condition, Register destination)
+    {
+        rr(false, rax, destination, {0x0f, (u8)(0x90 | condition)}, true);
+    }
+
+    void cmov(Condition condition, Register destination, Register source)
+    {
+        rr(false, destination, source, {0x0f, (u8)(0x40 | condition)});
+    }
+
+    // Jumps return the position of their rel32, for bind()
+    u8 *jcc(Condition condition)
+    {
+        byte(0x0f);
+        byte(0x80 | condition);
+        dword(0);
+        return position - 4;
+    }
+
+    u8 *jmp()
+    {
+        byte(0xe9);
+        dword(0);
+        return position - 4;
+    }
+
+    void jmp(const u8 *target) { bind(jmp(), target); }
+
+    void jmp(Register target)
+    {
+        if (target >= r8)
+            byte(0x41);
+        byte(0xff);
+        byte(0xe0 | (target & 7));
+    }
+
+    void push(Register source)
+    {
+        if (source >= r8)
+            byte(0x41);
+        byte(0x50 + (source & 7));
+    }
+
+    void pop(Register destination)
+    {
+        if (destination >= r8)
+            byte(0x41);
+        byte(0x58 + (destination & 7));
+    }
+
+    void ret() { byte(0xc3); }
+
+    static void bind(u8 *site, const u8 *target)
+    {
+        int displacement = (int)(target - (site + 4));
+        memcpy(site, &displacement, sizeof(displacement));
+    }
+
+    void bind(u8 *site) { bind(site, position); }
+
+private:
+    struct Opcode
+    {
+        u8 bytes[2];
+        u8 size;
+
+        Opcode(std::initializer_list<u8> list) : bytes{0, 0}, size(0)
+        {
+            for (u8 value : list)
+                bytes[size++] = value;
+        }
+    };
+
+    void rex(bool wide, u8 reg, u8 index, u8 base, bool byteRegister)
+    {
+        u8 prefix = 0x40 | (wide << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+
+        // spl, bpl, sil and dil are only reachable with a REX prefix
+        if (prefix != 0x40 || (byteRegister && base >= rsp && base <= rdi))
+            byte(prefix);
+    }
+
+    void opcode(const Opcode &op)
+    {
+        for (u8 i = 0; i < op.size; i++)
+            byte(op.bytes[i]);
+    }
+
+    void rr(bool wide, Register reg, Register rmRegister, const Opcode &op, bool byteRegister = false)
+    {
+        rex(wide, reg, 0, rmRegister, byteRegister);
+        opcode(op);
+        byte(0xc0 | ((reg & 7) << 3) | (rmRegister & 7));
+    }
+
+    void rm(bool wide, Register reg, Address address, const Opcode &op)
+    {
+        bool hasIndex = address.index != noRegister;
+        u8 index = hasIndex ? address.index : 0;
+
+        rex(wide, reg, index, address.base, false);
+        opcode(op);
+
+        u8 mod;
+        if (address.displacement == 0 && (address.base & 7) != rbp)
+            mod = 0x00;
+        else if (address.displacement >= -128 && address.displacement <= 127)
+            mod = 0x40;
+        else
+            mod = 0x80;
+
+        if (hasIndex || (address.base & 7) == rsp) {
+            u8 scale = address.scale == 8 ? 3 : address.scale == 4 ? 2 : address.scale == 2 ? 1 : 0;
+
+            byte(mod | ((reg & 7) << 3) | 0x04);
+            byte((scale << 6) | ((hasIndex ? index & 7 : rsp) << 3) | (address.base & 7));
+        }
+        else {
+            byte(mod | ((reg & 7) << 3) | (address.base & 7));
+        }
+
+        if (mod == 0x40)
+            byte((u8)address.displacement);
+        else if (mod == 0x80)
+            dword((u32)address.displacement);
+    }
+
+    u8 *position;
+};
+
+//// Emits the code of one block or superblock. FLAG lives in r11d from the
+//// entry of the block to its exits
+class BlockTranslator
+{
+public:
+    BlockTranslator(Assembler &assembler, const u8 *epilogue, const std::vector<const u8 *> &blocks,
+                    bool chaining)
+        : a(assembler), epilogue(epilogue), blocks(blocks), chaining(chaining) {}
+
+    void translate(const u16 *addresses, const DecodedInstruction *instructions, size_t count,
+                   bool superblock);
+
+private:
+    struct SideExit
+    {
+        u8 *site;
+        size_t instruction;
+    };
+
+    struct BranchExit
+    {
+        u8 *site;
+        size_t instruction;
+        u16 target;
+        // Instruction whose flags the branch was fused with, if any
+        const DecodedInstruction *flagSource;
+    };
+
+    size_t instruction(size_t index);
+    void twoOperands(const DecodedInstruction &d);
+    void oneOperand(const DecodedInstruction &d);
+    void jump(const DecodedInstruction &d);
+    void branch(size_t index, const DecodedInstruction *flagSource);
+    static bool canFuse(Operation flagSource, Operation operation);
+    void fusedCondition(Operation flagSource, Operation operation, int &outcome, Condition &taken);
+
+    bool flagsLive(size_t from);
+    void flags(const DecodedInstruction &d);
+    void zeroAndSign();
+
+    void operandAddress(Register destination, u8 mode, u8 reg, u16 word);
+    void readCheck(Register address);
+    void writeCheck(Register address);
+    Address memoryWord(Register address);
+    void loadOperand(Register destination, u8 mode, u8 reg, u16 word, Register address, bool written);
+
+    void giveBack(size_t completed);
+    void exitTo(u16 target, size_t completed);
+    void exitToPC(size_t completed);
+
+    Assembler &a;
+    const u8 *epilogue;
+    const std::vector<const u8 *> &blocks;
+    bool chaining;
+
+    const u16 *addresses;
+    const DecodedInstruction *instructions;
+    size_t count;
+    bool superblock;
+    const u8 *entry;
+
+    size_t current;
+    u16 next;
+
+    // Impulses of every instruction from an index to the end of the block
+    u32 remainingImpulses[Jit::maxSuperblockLength + 1];
+    std::vector<SideExit> sideExits;
+    std::vector<BranchExit> branchExits;
+};
+
+void BlockTranslator::translate(const u16 *addresses, const DecodedInstruction *instructions, size_t count,
+                                bool superblock)
+{
+    this->addresses = addresses;
+    this->instructions = instructions;
+    this->count = count;
+    this->superblock = superblock;
+    entry = a.here();
+
+    remainingImpulses[count] = 0;
+    for (size_t i = count; i > 0; i--)
+        remainingImpulses[i - 1] = remainingImpulses[i] + instructions[i - 1].impulses;
+
+    // Basic blocks count down to their translation as a superblock
+    u8 *hotExit = nullptr;
+    if (!superblock) {
+        a.aluDword(aluSub, at(counterTable, 4 * (addresses[0] >> 1)), 1);
+        hotExit = a.jcc(equal);
+    }
+
+    // The whole block is accounted on entry, early exits give back what
+    // they skip
+    a.aluQword(aluCmp, budgetField, (u32)count);
+    u8 *budgetExit = a.jcc(below);
+    a.aluQword(aluSub, budgetField, (u32)count);
+    a.aluQword(aluAdd, impulsesField, remainingImpulses[0]);
+    if (superblock)
+        a.aluQword(aluAdd, superblockField, (u32)count);
+
+    a.movzxWord(flagRegister, flagField);
+
+    size_t index = 0;
+    while (index < count)
+        index += instruction(index);
+
+    const DecodedInstruction &last = instructions[count - 1];
+    if (!Jit::endsBlock(last.operation))
+        exitTo(addresses[count - 1] + 2 * last.length, count);
+
+    // Cold paths
+    for (const BranchExit &branchExit : branchExits) {
+        a.bind(branchExit.site);
+
+        if (branchExit.flagSource)
+            flags(*branchExit.flagSource);
+
+        exitTo(branchExit.target, branchExit.instruction + 1);
+    }
+
+    // Side exits leave before their instruction made any change
+    for (const SideExit &sideExit : sideExits) {
+        a.bind(sideExit.site);
+        a.storeWord(flagField, flagRegister);
+        a.storeWord(pcField, addresses[sideExit.instruction]);
+        giveBack(sideExit.instruction);
+        a.storeByte(exitField, exitInterpret);
+        a.jmp(epilogue);
+    }
+
+    a.bind(budgetExit);
+    a.storeWord(pcField, addresses[0]);
+    a.storeByte(exitField, exitBudget);
+    a.jmp(epilogue);
+
+    if (hotExit) {
+        a.bind(hotExit);
+        a.storeWord(pcField, addresses[0]);
+        a.storeByte(exitField, exitHot);
+        a.jmp(epilogue);
+    }
+}
+
+// Emits the instruction at index, together with the branch after it when
+// the two are fused. Returns the number of instructions emitted
+size_t BlockTranslator::instruction(size_t index)
+{
+    const DecodedInstruction &d = instructions[index];
+
+    current = index;
+    next = addresses[index] + 2 * d.length;
+
+    switch (d.operation) {
+    case Operation::mov:
+        twoOperands(d);
+        return 1;
+
+    case Operation::add: case Operation::sub: case Operation::cmp:
+    case Operation::AND: case Operation::OR: case Operation::XOR:
+    case Operation::clr: case Operation::neg: case Operation::inc: case Operation::dec:
+    case Operation::asl: case Operation::asr: case Operation::lsr: case Operation::rol:
+    case Operation::ror: case Operation::rlc: case Operation::rrc: {
+        if (d.operation <= Operation::XOR)
+            twoOperands(d);
+        else
+            oneOperand(d);
+
+        // A branch right after the instruction tests its result instead
+        // of FLAG, which is then only computed where it is observed
+        if (index + 1 < count && canFuse(d.operation, instructions[index + 1].operation)) {
+            current = index + 1;
+            next = addresses[index + 1] + 2;
+            branch(index + 1, &d);
+            return 2;
+        }
+
+        if (flagsLive(index + 1))
+            flags(d);
+        return 1;
+    }
+
+    case Operation::jmp: case Operation::call:
+        jump(d);
+        return 1;
+
+    case Operation::pushRi: case Operation::pushpc: case Operation::pushflag:
+        a.movzxWord(rdi, spField);
+        a.alu(aluSub, rdi, 2);
+        a.movzxWord(rdi, rdi);
+        writeCheck(rdi);
+
+        if (d.operation == Operation::pushRi)
+            a.movzxWord(rax, registerField(d.destination));
+        else if (d.operation == Operation::pushflag)
+            a.mov(rax, flagRegister);
+        else
+            a.mov(rax, next);
+
+        a.storeWord(memoryWord(rdi), rax);
+        a.storeWord(spField, rdi);
+        return 1;
+
+    case Operation::popRi: case Operation::popflag: case Operation::ret: case Operation::poppc:
+        a.movzxWord(rdi, spField);
+        readCheck(rdi);
+        a.movzxWord(rax, memoryWord(rdi));
+        a.lea(rcx, at(rdi, 2));
+        a.storeWord(spField, rcx);
+
+        if (d.operation == Operation::popRi) {
+            a.storeWord(registerField(d.destination), rax);
+        }
+        else if (d.operation == Operation::popflag) {
+            a.mov(flagRegister, rax);
+        }
+        else {
+            a.storeWord(pcField, rax);
+            exitToPC(index + 1);
+        }
+        return 1;
+
+    case Operation::br: case Operation::bne: case Operation::beq: case Operation::bpl:
+    case Operation::bcs: case Operation::bcc: case Operation::bvs: case Operation::bvc:
+        branch(index, nullptr);
+        return 1;
+
+    case Operation::clc: a.alu(aluAnd, flagRegister, 0xfff7); return 1;
+    case Operation::clv: a.alu(aluAnd, flagRegister, 0xfffe); return 1;
+    case Operation::clz: a.alu(aluAnd, flagRegister, 0xfffb); return 1;
+    case Operation::cls: a.alu(aluAnd, flagRegister, 0xfffd); return 1;
+    case Operation::ccc: a.alu(aluAnd, flagRegister, 0xfff0); return 1;
+    case Operation::sec: a.alu(aluOr, flagRegister, 0x0008); return 1;
+    case Operation::sev: a.alu(aluOr, flagRegister, 0x0001); return 1;
+    case Operation::sez: a.alu(aluOr, flagRegister, 0x0004); return 1;
+    case Operation::ses: a.alu(aluOr, flagRegister, 0x0002); return 1;
+    case Operation::scc: a.alu(aluOr, flagRegister, 0x000f); return 1;
+
+    default:
+        return 1;
+    }
+}
+
+// b1 class: T in esi, MDR in edi, the memory destination address in ebp
+// and the result in eax
+void BlockTranslator::twoOperands(const DecodedInstruction &d)
+{
+    loadOperand(rsi, d.mas, d.source, d.sourceWord, rax, false);
+    loadOperand(rdi, d.mad, d.destination, d.destinationWord, rbp, d.operation != Operation::cmp);
+
+    switch (d.operation) {
+    case Operation::mov:
+        a.mov(rax, rsi);
+        break;
+    case Operation::add:
+        a.lea(rax, at(rsi, rdi));
+        a.movzxWord(rax, rax);
+        break;
+    case Operation::sub: case Operation::cmp:
+        a.mov(rax, rdi);
+        a.alu(aluSub, rax, rsi);
+        a.movzxWord(rax, rax);
+        break;
+    default:
+        a.mov(rax, rsi);
+        a.alu(d.operation == Operation::AND ? aluAnd : d.operation == Operation::OR ? aluOr : aluXor,
+              rax, rdi);
+        break;
+    }
+
+    if (d.operation == Operation::cmp)
+        return;
+
+    // An immediate destination writes back its unchanged word
+    if (d.mad == AD)
+        a.storeWord(registerField(d.destination), rax);
+    else if (d.mad != AM)
+        a.storeWord(memoryWord(rbp), rax);
+}
+
+// b2 class: the operand in edi and the result in eax
+void BlockTranslator::oneOperand(const DecodedInstruction &d)
+{
+    loadOperand(rdi, d.mad, d.destination, d.destinationWord, rbp, true);
+
+    switch (d.operation) {
+    case Operation::clr:
+        a.mov(rax, 0u);
+        break;
+    case Operation::neg:
+        a.mov(rax, rdi);
+        a.notReg(rax);
+        break;
+    case Operation::inc:
+        a.lea(rax, at(rdi, 1));
+        break;
+    case Operation::dec:
+        a.lea(rax, at(rdi, -1));
+        break;
+    case Operation::asl:
+        a.lea(rax, at(rdi, rdi));
+        break;
+    case Operation::asr:
+        a.mov(rax, rdi);
+        a.shift(shiftRight, rax, 1);
+        a.mov(rcx, rdi);
+        a.alu(aluAnd, rcx, 0x8000);
+        a.alu(aluOr, rax, rcx);
+        break;
+    case Operation::lsr:
+        a.mov(rax, rdi);
+        a.shift(shiftRight, rax, 1);
+        break;
+    case Operation::rol:
+        a.lea(rax, at(rdi, rdi));
+        a.mov(rcx, rdi);
+        a.shift(shiftRight, rcx, 15);
+        a.alu(aluOr, rax, rcx);
+        break;
+    case Operation::rlc:
+        a.lea(rax, at(rdi, rdi));
+        a.mov(rcx, flagRegister);
+        a.shift(shiftRight, rcx, 3);
+        a.alu(aluAnd, rcx, 1);
+        a.alu(aluOr, rax, rcx);
+        break;
+    default:
+        // ror and rrc, which ORs C into bit 15 over bit 0 of MDR
+        a.mov(rax, rdi);
+        a.shift(shiftRight, rax, 1);
+        a.mov(rcx, rdi);
+        a.shift(shiftLeft, rcx, 15);
+        a.alu(aluOr, rax, rcx);
+
+        if (d.operation == Operation::rrc) {
+            a.mov(rcx, flagRegister);
+            a.alu(aluAnd, rcx, 0x0008);
+            a.shift(shiftLeft, rcx, 12);
+            a.alu(aluOr, rax, rcx);
+        }
+        break;
+    }
+    a.movzxWord(rax, rax);
+
+    if (d.mad == AD)
+        a.storeWord(registerField(d.destination), rax);
+    else if (d.mad != AM)
+        a.storeWord(memoryWord(rbp), rax);
+}
+
+void BlockTranslator::jump(const DecodedInstruction &d)
+{
+    if (d.mad != AM)
+        loadOperand(rsi, d.mad, d.destination, d.destinationWord, rbp, false);
+
+    if (d.operation == Operation::call) {
+        a.movzxWord(rdi, spField);
+        a.alu(aluSub, rdi, 2);
+        a.movzxWord(rdi, rdi);
+        writeCheck(rdi);
+        a.mov(rax, next);
+        a.storeWord(memoryWord(rdi), rax);
+        a.storeWord(spField, rdi);
+    }
+
+    if (d.mad != AM) {
+        a.mov(rax, rsi);
+        a.storeWord(pcField, rax);
+        exitToPC(current + 1);
+    }
+    else if (!superblock || current + 1 == count) {
+        exitTo(d.destinationWord, current + 1);
+    }
+}
+
+// b3 class. Superblocks continue on the side of the branch that the next
+// instruction is on and leave on the other
+void BlockTranslator::branch(size_t index, const DecodedInstruction *flagSource)
+{
+    const DecodedInstruction &d = instructions[index];
+    u16 target = next + d.sourceWord;
+    bool last = index + 1 == count;
+
+    int outcome = 1;
+    Condition taken = notEqual;
+
+    if (flagSource) {
+        fusedCondition(flagSource->operation, d.operation, outcome, taken);
+    }
+    else if (d.operation != Operation::br) {
+        u8 bit;
+
+        switch (d.operation) {
+        case Operation::bne: bit = 0b0100; taken = equal; break;
+        case Operation::beq: bit = 0b0100; taken = notEqual; break;
+        case Operation::bpl: bit = 0b0010; taken = equal; break;
+        case Operation::bcs: bit = 0b1000; taken = notEqual; break;
+        case Operation::bcc: bit = 0b1000; taken = equal; break;
+        case Operation::bvs: bit = 0b0001; taken = notEqual; break;
+        default:             bit = 0b0001; taken = equal; break;
+        }
+
+        a.test(flagRegister, bit);
+        outcome = 0;
+    }
+
+    bool liveAfter = flagSource && flagsLive(index + 1);
+
+    if (outcome != 0) {
+        u16 destination = outcome > 0 ? target : next;
+
+        if (!last && addresses[index + 1] == destination) {
+            if (liveAfter)
+                flags(*flagSource);
+        }
+        else {
+            if (flagSource)
+                flags(*flagSource);
+            exitTo(destination, index + 1);
+        }
+        return;
+    }
+
+    if (!last && addresses[index + 1] == target && target != next) {
+        branchExits.push_back({a.jcc((Condition)(taken ^ 1)), index, next, flagSource});
+
+        if (liveAfter)
+            flags(*flagSource);
+    }
+    else {
+        branchExits.push_back({a.jcc(taken), index, target, flagSource});
+
+        if (!last) {
+            if (liveAfter)
+                flags(*flagSource);
+        }
+        else {
+            if (flagSource)
+                flags(*flagSource);
+            exitTo(next, index + 1);
+        }
+    }
+}
+
+// Whether a branch can test the result in eax of the flag writer before
+// it instead of FLAG
+bool BlockTranslator::canFuse(Operation flagSource, Operation operation)
+{
+    bool subtraction = flagSource == Operation::sub || flagSource == Operation::cmp;
+
+    if (flagSource == Operation::clr || flagSource >= Operation::asl)
+        return false;
+
+    switch (operation) {
+    case Operation::bne: case Operation::beq: case Operation::bpl:
+        return true;
+    case Operation::bcs: case Operation::bcc:
+        return subtraction || flagSource == Operation::inc;
+    case Operation::bvs: case Operation::bvc:
+        return subtraction;
+    default:
+        return false;
+    }
+}
+
+// Condition of a branch on the result in eax. outcome is -1 for a branch
+// that is never taken, 1 for one that always is and 0 when taken decides
+void BlockTranslator::fusedCondition(Operation flagSource, Operation operation, int &outcome, Condition &taken)
+{
+    outcome = 0;
+
+    switch (operation) {
+    case Operation::bne:
+    case Operation::beq:
+        a.test(rax, rax);
+        taken = operation == Operation::bne ? notEqual : equal;
+        break;
+
+    case Operation::bpl:
+        a.test(rax, 0x8000);
+        taken = equal;
+        break;
+
+    // inc leaves C clear, a subtraction sets it from the sign of the
+    // result and leaves V clear
+    case Operation::bcs:
+    case Operation::bcc:
+        if (flagSource == Operation::inc) {
+            outcome = operation == Operation::bcs ? -1 : 1;
+            break;
+        }
+        a.test(rax, 0x8000);
+        taken = operation == Operation::bcs ? notEqual : equal;
+        break;
+
+    default:
+        outcome = operation == Operation::bvs ? -1 : 1;
+        break;
+    }
+}
+
+// Whether the flags set before the instruction at from can be observed:
+// by an instruction reading FLAG, or at an exit of the block. They are
+// dead once an instruction that cannot leave the block sets all of C, Z,
+// S and V: add, sub, cmp, inc and dec always clear one of them, so they
+// leave FLAG equal to their four bits whatever it held
+bool BlockTranslator::flagsLive(size_t from)
+{
+    for (size_t k = from; k < count; k++) {
+        const DecodedInstruction &d = instructions[k];
+        bool memory = d.mad == AI || d.mad == AX;
+
+        switch (d.operation) {
+        case Operation::add: case Operation::sub: case Operation::cmp:
+            return memory || d.mas == AI || d.mas == AX;
+
+        case Operation::inc: case Operation::dec:
+            return memory;
+
+        case Operation::mov:
+            if (memory || d.mas == AI || d.mas == AX)
+                return true;
+            break;
+
+        case Operation::nop:
+            break;
+
+        case Operation::br:
+            if (k + 1 == count)
+                return true;
+            break;
+
+        case Operation::jmp:
+            if (d.mad != AM || k + 1 == count)
+                return true;
+            break;
+
+        default:
+            return true;
+        }
+    }
+
+    return true;
+}
+
+// Computes FLAG in r11d from the operands and the result left by the
+// instruction, the way deferredFlags(), setC, setZ and setS do
+void BlockTranslator::flags(const DecodedInstruction &d)
+{
+    switch (d.operation) {
+    case Operation::add:
+        zeroAndSign();
+
+        // C is the carry out of the sum
+        a.lea(r8, at(rsi, rdi));
+        a.shift(shiftRight, r8, 16);
+
+        // V = !bit15((T + 1) ^ MDR) && (S ^ C)
+        a.lea(rcx, at(rsi, 1));
+        a.alu(aluXor, rcx, rdi);
+        a.shift(shiftRight, rcx, 15);
+        a.alu(aluAnd, rcx, 1);
+        a.alu(aluXor, rcx, 1);
+        a.mov(r10, r9);
+        a.alu(aluXor, r10, r8);
+        a.alu(aluAnd, rcx, r10);
+        a.alu(aluOr, rdx, rcx);
+        a.shift(shiftLeft, r8, 3);
+        a.alu(aluOr, rdx, r8);
+        a.mov(flagRegister, rdx);
+        break;
+
+    case Operation::sub: case Operation::cmp:
+        // C is bit 15 of the result, which makes V always clear
+        zeroAndSign();
+        a.shift(shiftLeft, r9, 3);
+        a.alu(aluOr, rdx, r9);
+        a.mov(flagRegister, rdx);
+        break;
+
+    case Operation::inc:
+        // C is computed without the Cin and stays clear
+        zeroAndSign();
+        a.mov(rcx, rdi);
+        a.shift(shiftRight, rcx, 15);
+        a.alu(aluXor, rcx, 1);
+        a.alu(aluAnd, rcx, r9);
+        a.alu(aluOr, rdx, rcx);
+        a.mov(flagRegister, rdx);
+        break;
+
+    case Operation::dec:
+        zeroAndSign();
+        a.mov(r8, rdi);
+        a.shift(shiftRight, r8, 15);
+        a.mov(rcx, r9);
+        a.alu(aluXor, rcx, 1);
+        a.alu(aluAnd, rcx, r8);
+        a.alu(aluOr, rdx, rcx);
+        a.shift(shiftLeft, r8, 3);
+        a.alu(aluOr, rdx, r8);
+        a.mov(flagRegister, rdx);
+        break;
+
+    // Z and S are never both set, so C and V stay and bits 4 to 15 clear
+    case Operation::clr:
+        a.alu(aluAnd, flagRegister, 0b1001);
+        a.alu(aluOr, flagRegister, 0b0100);
+        break;
+
+    case Operation::AND: case Operation::OR: case Operation::XOR: case Operation::neg:
+        zeroAndSign();
+        a.alu(aluAnd, flagRegister, 0b1001);
+        a.alu(aluOr, flagRegister, rdx);
+        break;
+
+    default: {
+        // Shifts set C from MDR after the result is latched, which only
+        // memory destinations update
+        bool fromLow = d.operation == Operation::asr || d.operation == Operation::lsr ||
+                       d.operation == Operation::ror || d.operation == Operation::rrc;
+
+        a.mov(rdx, d.mad == AD || d.mad == AM ? rdi : rax);
+        if (fromLow)
+            a.alu(aluAnd, rdx, 1);
+        else
+            a.shift(shiftRight, rdx, 15);
+
+        a.mov(rcx, flagRegister);
+        a.alu(aluOr, rcx, 0b1000);
+        a.alu(aluAnd, flagRegister, 0b0111);
+        a.test(rdx, rdx);
+        a.cmov(notEqual, flagRegister, rcx);
+        break;
+    }
+    }
+}
+
+// Z into bit 2 and S into bit 1 of edx, S alone into r9d
+void BlockTranslator::zeroAndSign()
+{
+    a.mov(r9, rax);
+    a.shift(shiftRight, r9, 15);
+    a.mov(rdx, 0u);
+    a.test(rax, rax);
+    a.setcc(equal, rdx);
+    a.shift(shiftLeft, rdx, 2);
+    a.lea(rdx, at(rdx, r9, 2));
+}
+
+// Effective address of an AI or AX operand, wrapped to 16 bits
+void BlockTranslator::operandAddress(Register destination, u8 mode, u8 reg, u16 word)
+{
+    a.movzxWord(destination, registerField(reg));
+
+    if (mode == AX) {
+        a.alu(aluAdd, destination, word);
+        a.movzxWord(destination, destination);
+    }
+}
+
+// Words at the last byte of a page span two pages, the word at 0xffff
+// wraps around memory. The interpreter reads them
+void BlockTranslator::readCheck(Register address)
+{
+    a.lea(rcx, at(address, 1));
+    a.test(rcx, 0xff);
+    sideExits.push_back({a.jcc(equal), current});
+}
+
+// Stores into code and into pages that other copies of memory share are
+// left to the interpreter too
+void BlockTranslator::writeCheck(Register address)
+{
+    readCheck(address);
+
+    a.movzxWord(rcx, at(codeMap, address));
+    a.test(rcx, rcx);
+    sideExits.push_back({a.jcc(notEqual), current});
+
+    a.mov(rcx, address);
+    a.shift(shiftRight, rcx, 8);
+    a.loadQword(rcx, at(pageTable, rcx, 8));
+    a.aluDword(aluCmp, at(rcx, (int)offsetof(MemoryPage, references)), 1);
+    sideExits.push_back({a.jcc(notEqual), current});
+}
+
+// Word at address, after readCheck() or writeCheck(). Uses rcx and rdx
+Address BlockTranslator::memoryWord(Register address)
+{
+    a.mov(rcx, address);
+    a.shift(shiftRight, rcx, 8);
+    a.loadQword(rcx, at(pageTable, rcx, 8));
+    a.mov(rdx, address);
+    a.alu(aluAnd, rdx, 0xff);
+
+    return at(rcx, rdx, 1, (int)offsetof(MemoryPage, bytes));
+}
+
+void BlockTranslator::loadOperand(Register destination, u8 mode, u8 reg, u16 word, Register address, bool written)
+{
+    switch (mode) {
+    case AM:
+        a.mov(destination, word);
+        break;
+    case AD:
+        a.movzxWord(destination, registerField(reg));
+        break;
+    default:
+        operandAddress(address, mode, reg, word);
+        if (written)
+            writeCheck(address);
+        else
+            readCheck(address);
+        a.movzxWord(destination, memoryWord(address));
+        break;
+    }
+}
+
+// Gives back the budget and impulses of the instructions from completed
+// to the end of the block, which an early exit skips
+void BlockTranslator::giveBack(size_t completed)
+{
+    if (completed == count)
+        return;
+
+    a.aluQword(aluAdd, budgetField, (u32)(count - completed));
+    a.aluQword(aluSub, impulsesField, remainingImpulses[completed]);
+    if (superblock)
+        a.aluQword(aluSub, superblockField, (u32)(count - completed));
+}
+
+// Jumps to the block at target when it is translated. Otherwise leaves
+// through a jump that Jit::link() points at the block once it exists
+void BlockTranslator::exitTo(u16 target, size_t completed)
+{
+    a.storeWord(flagField, flagRegister);
+    giveBack(completed);
+
+    if (chaining && superblock && target == addresses[0]) {
+        a.jmp(entry);
+        return;
+    }
+
+    if (chaining && !(target & 1) && blocks[target >> 1]) {
+        a.jmp(blocks[target >> 1]);
+        return;
+    }
+
+    u8 *site = a.jmp();
+    a.bind(site);
+    a.storeWord(pcField, target);
+    a.mov64(rax, (u64)site);
+    a.storeQword(linkField, rax);
+    a.storeByte(exitField, exitBranch);
+    a.jmp(epilogue);
+}
+
+// Continues at the block of the PC in eax, looked up in the block table
+void BlockTranslator::exitToPC(size_t completed)
+{
+    a.storeWord(flagField, flagRegister);
+    giveBack(completed);
+
+    if (chaining) {
+        a.mov(rcx, rax);
+        a.alu(aluAnd, rcx, 1);
+        u8 *odd = a.jcc(notEqual);
+        a.loadQword(rcx, at(blockTable, rax, 4));
+        a.testQword(rcx, rcx);
+        u8 *missing = a.jcc(equal);
+        a.jmp(rcx);
+
+        a.bind(odd);
+        a.bind(missing);
+    }
+
+    a.storeByte(exitField, exitBranch);
+    a.jmp(epilogue);
+}
+
+}
+
+Jit::Jit(bool chaining) :
+    chaining(chaining),
+    buffer(nullptr),
+    bufferEnd(nullptr),
+    blocksStart(nullptr),
+    position(nullptr),
+    entry(nullptr),
+    epilogue(nullptr),
+    blocks(1 << 15, nullptr),
+    counters(1 << 15, hotThreshold),
+    code(1 << 16, 0)
+{
+#ifdef JIT_X86_64
+    void *memory = mmap(nullptr, bufferSize, PROT_READ | PROT_WRITE | PROT_EXEC,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (memory == MAP_FAILED)
+        return;
+
+    buffer = static_cast<u8 *>(memory);
+    bufferEnd = buffer + bufferSize;
+
+    emitTrampoline();
+#endif
+}
+
+Jit::~Jit()
+{
+#ifdef JIT_X86_64
+    if (buffer)
+        munmap(buffer, bufferSize);
+#endif
+}
+
+bool Jit::isAvailable()
+{
+    return buffer != nullptr;
+}
+
+bool Jit::canTranslate(Operation operation)
+{
+    switch (operation) {
+    case Operation::illegal:
+    case Operation::reti:
+    case Operation::uhalt:
+    case Operation::wait:
+        return false;
+    default:
+        return true;
+    }
+}
+
+bool Jit::traceSuccessor(u16 address, const DecodedInstruction &instruction, u16 &successor)
+{
+    u16 next = address + 2 * instruction.length;
+
+    switch (instruction.operation) {
+    case Operation::jmp: case Operation::call:
+        if (instruction.mad != AM)
+            return false;
+        successor = instruction.destinationWord;
+        break;
+
+    case Operation::ret: case Operation::poppc:
+        return false;
+
+    case Operation::br:
+        successor = next + instruction.sourceWord;
+        break;
+
+    case Operation::bne: case Operation::beq: case Operation::bpl:
+    case Operation::bcs: case Operation::bcc: case Operation::bvs: case Operation::bvc:
+        // Backward branches close loops
+        successor = instruction.sourceWord & 0x8000 ? (u16)(next + instruction.sourceWord) : next;
+        break;
+
+    default:
+        successor = next;
+        break;
+    }
+
+    return !(successor & 1);
+}
+
+bool Jit::endsBlock(Operation operation)
+{
+    switch (operation) {
+    case Operation::jmp: case Operation::call: case Operation::ret: case Operation::poppc:
+    case Operation::br: case Operation::bne: case Operation::beq: case Operation::bpl:
+    case Operation::bcs: case Operation::bcc: case Operation::bvs: case Operation::bvc:
+        return true;
+    default:
+        return false;
+    }
+}
+
+const u8 *Jit::lookup(u16 address)
+{
+    return address & 1 ? nullptr : blocks[address >> 1];
+}
+
+const u8 *Jit::translate(const u16 *addresses, const DecodedInstruction *instructions, size_t count,
+                         bool superblock)
+{
+    if (!buffer || count == 0 || addresses[0] & 1)
+        return nullptr;
+
+    if ((size_t)(bufferEnd - position) < (count + 2) * maxInstructionSize)
+        return nullptr;
+
+    for (size_t i = 0; i < count; i++)
+        protect(addresses[i], 2 * instructions[i].length);
+
+    Assembler assembler(position);
+    BlockTranslator translator(assembler, epilogue, blocks, chaining);
+    u8 *block = position;
+
+    translator.translate(addresses, instructions, count, superblock);
+    position = assembler.here();
+
+    // Blocks jumping to the basic block continue in the superblock, its
+    // entry starts with a counter update long enough to hold the jump
+    const u8 *basicBlock = blocks[addresses[0] >> 1];
+    if (superblock && basicBlock) {
+        Assembler patch(const_cast<u8 *>(basicBlock));
+        patch.jmp(block);
+    }
+
+    blocks[addresses[0] >> 1] = block;
+    return block;
+}
+
+void Jit::run(JitState &state, const u8 *block)
+{
+    typedef void (*Entry)(JitState *, const u8 *);
+
+    Entry function;
+    memcpy(&function, &entry, sizeof(function));
+    function(&state, block);
+}
+
+void Jit::link(u8 *site, const u8 *block)
+{
+    if (chaining && site && block)
+        Assembler::bind(site, block);
+}
+
+void Jit::protect(u16 address, u16 size)
+{
+    for (u16 i = 0; i < size; i++)
+        code[(u16)(address + i)] = 1;
+}
+
+bool Jit::isCode(u16 address)
+{
+    return code[address] || code[(u16)(address + 1)];
+}
+
+void Jit::flush()
+{
+    std::fill(blocks.begin(), blocks.end(), nullptr);
+    std::fill(counters.begin(), counters.end(), hotThreshold);
+    std::fill(code.begin(), code.end(), 0);
+
+    position = blocksStart;
+}
+
+// entry saves the callee saved registers it uses, loads the base
+// registers and jumps to the block. epilogue undoes it
+void Jit::emitTrampoline()
+{
+    Assembler a(buffer);
+
+    entry = a.here();
+    a.push(rbx);
+    a.push(rbp);
+    a.push(r12);
+    a.push(r13);
+    a.push(r14);
+    a.push(r15);
+    a.movQword(statePointer, rdi);
+    a.loadQword(pageTable, pagesField);
+    a.mov64(codeMap, (u64)code.data());
+    a.mov64(blockTable, (u64)blocks.data());
+    a.mov64(counterTable, (u64)counters.data());
+    a.jmp(rsi);
+
+    epilogue = a.here();
+    a.pop(r15);
+    a.pop(r14);
+    a.pop(r13);
+    a.pop(r12);
+    a.pop(rbp);
+    a.pop(rbx);
+    a.ret();
+
+    blocksStart = a.here();
+    position = blocksStart;
+}
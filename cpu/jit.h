@@ -0,0 +1,143 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstddef>
+#include <vector>
+
+#include "assembler/defs.h"
+
+struct DecodedInstruction;
+struct MemoryPage;
+enum class Operation : u8;
+
+enum class JitMode {
+    off,
+    //// Translated blocks jump to each other directly
+    on,
+    //// Every block returns to CpuCore, which replays it through the
+    //// interpreter and halts on the first difference
+    differential
+};
+
+//// Architectural state seen by translated code. CpuCore copies its
+//// registers in before entering a block and out after leaving it
+struct JitState
+{
+    u16 R[16];
+    u16 PC;
+    u16 SP;
+    u16 FLAG;
+    u8 exit;      // JitExit
+    u64 budget;   // instructions translated code may still complete
+    u64 impulses; // impulse count of the core
+    u64 superblockInstructions; // instructions completed in superblocks
+    MemoryPage *const *pages; // PagedMemory::pageTable()
+    u8 *link;     // jump that left the block, null after an indirect jump
+};
+
+enum JitExit : u8 {
+    //// Left for PC, which is not translated or not linked yet
+    exitBranch,
+    //// The instruction at PC has to run in the interpreter: it stores
+    //// into decoded code or a shared page, or its word spans two pages
+    exitInterpret,
+    //// The block at PC is longer than the remaining budget
+    exitBudget,
+    //// The basic block at PC ran often enough to be translated again as
+    //// a superblock
+    exitHot
+};
+
+//// How much of the translated execution ran in superblocks
+struct JitStatistics
+{
+    u64 instructions;
+    u64 superblockInstructions;
+    u64 superblocks;
+};
+
+//// Translates basic blocks of decoded instructions to x86-64 code working
+//// on a JitState. Basic blocks that run hotThreshold times are translated
+//// again as superblocks: traces following unconditional jumps and the
+//// likely side of branches, in which a flag writer and the branch after
+//// it fuse and flags nobody reads are not computed. Only available on
+//// x86-64 Linux, everywhere else isAvailable() is false and CpuCore keeps
+//// interpreting
+class Jit
+{
+public:
+    static const size_t maxBlockLength = 32;
+    static const size_t maxSuperblockLength = 64;
+    static const u32 hotThreshold = 64;
+
+    explicit Jit(bool chaining);
+    ~Jit();
+
+    Jit(const Jit &) = delete;
+    Jit &operator=(const Jit &) = delete;
+
+    bool isAvailable();
+
+    //// Whether the operation can be part of a block. wait, reti, halt and
+    //// illegal instructions are left to the interpreter
+    static bool canTranslate(Operation operation);
+
+    //// Whether the operation changes PC and so ends its block
+    static bool endsBlock(Operation operation);
+
+    //// Address a superblock continues at after the instruction at
+    //// address: the target of jumps and backward branches, the next
+    //// instruction otherwise. False where the trace has to end
+    static bool traceSuccessor(u16 address, const DecodedInstruction &instruction, u16 &successor);
+
+    //// Block starting at address, null if it is not translated
+    const u8 *lookup(u16 address);
+
+    //// Translates count instructions at addresses, a basic block or the
+    //// trace of a superblock. A superblock replaces the basic block at
+    //// its first address. Returns null when the code buffer is full,
+    //// after a flush() it succeeds
+    const u8 *translate(const u16 *addresses, const DecodedInstruction *instructions, size_t count,
+                        bool superblock);
+
+    //// Runs translated code from block until it leaves for the CpuCore
+    void run(JitState &state, const u8 *block);
+
+    //// Points the jump that left through state.link at block
+    void link(u8 *site, const u8 *block);
+
+    //// Marks bytes holding code that the interpreter decoded, so that
+    //// translated stores into them return to the interpreter
+    void protect(u16 address, u16 size);
+
+    //// Whether a word store at address hits translated or protected code
+    bool isCode(u16 address);
+
+    //// Drops every translation and protection
+    void flush();
+
+private:
+    void emitTrampoline();
+
+    bool chaining;
+
+    u8 *buffer;
+    u8 *bufferEnd;
+    // Blocks are emitted from here on, after the trampoline
+    u8 *blocksStart;
+    u8 *position;
+
+    // Entered as void entry(JitState *state, const u8 *block)
+    u8 *entry;
+    // Restores the registers saved by entry and returns to run()
+    u8 *epilogue;
+
+    // Entry of the block starting at every even address
+    std::vector<const u8 *> blocks;
+    // Entries left to every basic block before exitHot
+    std::vector<u32> counters;
+    // Non zero for every byte of translated or protected code
+    std::vector<u8> code;
+};
+
+#endif // JIT_H
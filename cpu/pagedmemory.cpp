@@ -0,0 +1,139 @@
+#include <cpu/pagedmemory.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Holds a reference of its own, so that it is shared by every user and
+// never written
+MemoryPage zeroPage = {{1}, {}};
+
+}
+
+PagedMemory::PagedMemory()
+{
+    for (MemoryPage *&page : pages) {
+        acquire(&zeroPage);
+        page = &zeroPage;
+    }
+}
+
+PagedMemory::PagedMemory(const PagedMemory &other)
+{
+    for (u32 index = 0; index < pageCount; index++) {
+        acquire(other.pages[index]);
+        pages[index] = other.pages[index];
+    }
+}
+
+PagedMemory &PagedMemory::operator=(const PagedMemory &other)
+{
+    for (u32 index = 0; index < pageCount; index++) {
+        acquire(other.pages[index]);
+        release(pages[index]);
+        pages[index] = other.pages[index];
+    }
+
+    return *this;
+}
+
+PagedMemory::~PagedMemory()
+{
+    for (MemoryPage *page : pages)
+        release(page);
+}
+
+void PagedMemory::read(u16 address, u32 length, u8 *destination) const
+{
+    u32 position = address;
+    u32 end = position + length;
+
+    while (position < end) {
+        u32 offset = position % MemoryPage::size;
+        u32 count = std::min(MemoryPage::size - offset, end - position);
+
+        memcpy(destination, pages[position / MemoryPage::size]->bytes + offset, count);
+        destination += count;
+        position += count;
+    }
+}
+
+void PagedMemory::load(const u8 *data, size_t size)
+{
+    auto isZero = [](u8 byte) { return byte == 0; };
+
+    size = std::min<size_t>(size, 1 << 16);
+
+    for (u32 index = 0; index < pageCount; index++) {
+        u32 start = index * MemoryPage::size;
+        u32 count = size > start ? std::min<u32>(MemoryPage::size, size - start) : 0;
+        const u8 *bytes = pages[index]->bytes;
+
+        // Pages already holding their part stay as they are, shared ones
+        // included
+        if ((!count || memcmp(bytes, data + start, count) == 0) &&
+            std::all_of(bytes + count, bytes + MemoryPage::size, isZero))
+            continue;
+
+        if (!count || std::all_of(data + start, data + start + count, isZero)) {
+            clearPage(index);
+            continue;
+        }
+
+        u8 *page = writablePage(index);
+        memcpy(page, data + start, count);
+        memset(page + count, 0, MemoryPage::size - count);
+    }
+}
+
+void PagedMemory::writePage(u8 index, const u8 *bytes)
+{
+    memcpy(writablePage(index), bytes, MemoryPage::size);
+}
+
+void PagedMemory::clearPage(u8 index)
+{
+    acquire(&zeroPage);
+    release(pages[index]);
+    pages[index] = &zeroPage;
+}
+
+std::vector<u8> PagedMemory::toVector() const
+{
+    std::vector<u8> memory(1 << 16);
+    read(0, 1 << 16, memory.data());
+
+    return memory;
+}
+
+u32 PagedMemory::ownedPageCount() const
+{
+    return std::count_if(pages, pages + pageCount, [](const MemoryPage *page) {
+        return page->references.load(std::memory_order_relaxed) == 1;
+    });
+}
+
+MemoryPage *PagedMemory::unshare(u8 index)
+{
+    MemoryPage *page = new MemoryPage;
+
+    page->references.store(1, std::memory_order_relaxed);
+    memcpy(page->bytes, pages[index]->bytes, MemoryPage::size);
+
+    release(pages[index]);
+    pages[index] = page;
+
+    return page;
+}
+
+void PagedMemory::acquire(MemoryPage *page)
+{
+    page->references.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PagedMemory::release(MemoryPage *page)
+{
+    if (page->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete page;
+}
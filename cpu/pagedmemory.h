@@ -0,0 +1,116 @@
+#ifndef PAGEDMEMORY_H
+#define PAGEDMEMORY_H
+
+#include <atomic>
+#include <vector>
+
+#include "assembler/defs.h"
+
+//// 256 bytes of memory, referenced by every PagedMemory sharing it
+struct MemoryPage
+{
+    static const u32 size = 256;
+
+    std::atomic<u32> references;
+    u8 bytes[size];
+};
+
+//// 64 KiB of memory in pages that copies share until one of them writes.
+//// Pages never written share one zero page, so a copy costs its page
+//// table and every copy only owns the pages it wrote. Copies can be used
+//// on different threads, a single PagedMemory can not
+class PagedMemory
+{
+public:
+    static const u32 pageCount = (1 << 16) / MemoryPage::size;
+
+    PagedMemory();
+    PagedMemory(const PagedMemory &other);
+    PagedMemory &operator=(const PagedMemory &other);
+    ~PagedMemory();
+
+    u8 read(u16 address) const
+    {
+        return pages[address >> 8]->bytes[address & 0xff];
+    }
+
+    //// Little endian, wraps around at 0xffff
+    u16 readWord(u16 address) const
+    {
+        const MemoryPage *page = pages[address >> 8];
+        u8 offset = address & 0xff;
+
+        if (offset == 0xff)
+            return (read((u16)(address + 1)) << 8) | page->bytes[offset];
+
+        return (page->bytes[offset + 1] << 8) | page->bytes[offset];
+    }
+
+    void write(u16 address, u8 value)
+    {
+        writablePage(address >> 8)[address & 0xff] = value;
+    }
+
+    void writeWord(u16 address, u16 value)
+    {
+        u8 offset = address & 0xff;
+
+        if (offset == 0xff) {
+            write(address, value & 0xff);
+            write((u16)(address + 1), value >> 8);
+            return;
+        }
+
+        u8 *bytes = writablePage(address >> 8);
+        bytes[offset] = value & 0xff;
+        bytes[offset + 1] = value >> 8;
+    }
+
+    //// Copies length bytes from address on, which must not run past the
+    //// end of memory
+    void read(u16 address, u32 length, u8 *destination) const;
+
+    //// Replaces the contents with size bytes of data followed by zeros
+    void load(const u8 *data, size_t size);
+
+    const u8 *page(u8 index) const { return pages[index]->bytes; }
+
+    //// Replaces the 256 bytes of a page
+    void writePage(u8 index, const u8 *bytes);
+
+    //// Gives a page back to the zero page
+    void clearPage(u8 index);
+
+    std::vector<u8> toVector() const;
+
+    //// Pages no other copy shares, which is the memory this copy costs
+    u32 ownedPageCount() const;
+
+    //// Page of every 256 bytes for translated code, which may only write
+    //// pages with a single reference. Entries change when a shared page
+    //// is written, the table stays in place
+    MemoryPage *const *pageTable() const { return pages; }
+
+private:
+    // Bytes of the page, copied first if it is shared
+    u8 *writablePage(u8 index)
+    {
+        MemoryPage *page = pages[index];
+
+        // Pairs with the release in release(), the copy that dropped the
+        // page last is done with it
+        if (page->references.load(std::memory_order_acquire) != 1)
+            page = unshare(index);
+
+        return page->bytes;
+    }
+
+    MemoryPage *unshare(u8 index);
+
+    static void acquire(MemoryPage *page);
+    static void release(MemoryPage *page);
+
+    MemoryPage *pages[pageCount];
+};
+
+#endif // PAGEDMEMORY_H
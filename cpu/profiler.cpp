@@ -0,0 +1,366 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <string>
+
+namespace {
+
+// Children of a frame by the key of their function
+u64 childKey(u32 parent, u16 function, bool interrupt)
+{
+    return (u64)parent << 17 | (u64)interrupt << 16 | function;
+}
+
+// Functions and handlers, summed over the frames they appear in
+struct FunctionTotals
+{
+    u16 address;
+    bool interrupt;
+    u64 calls;
+    u64 count;
+    u64 selfImpulses;
+    u64 totalImpulses;
+};
+
+class ProfileNames
+{
+public:
+    explicit ProfileNames(const Labels &labels)
+    {
+        // The first of several labels at an address, by name
+        for (const auto &label : labels)
+            names.emplace(label.second, label.first);
+    }
+
+    std::string function(u16 address, bool interrupt) const
+    {
+        auto name = names.find(address);
+        std::string text = name != names.end() ? name->second : hex(address);
+
+        return interrupt ? text + " (interrupt)" : text;
+    }
+
+    // label+offset of the nearest label at or before address
+    std::string location(u16 address) const
+    {
+        auto name = names.upper_bound(address);
+        if (name == names.begin())
+            return "";
+
+        --name;
+        if (name->first == address)
+            return name->second;
+
+        char offset[16];
+        snprintf(offset, sizeof(offset), "+0x%x", address - name->first);
+        return name->second + offset;
+    }
+
+    static std::string hex(u16 value)
+    {
+        char text[8];
+        snprintf(text, sizeof(text), "0x%04x", value);
+        return text;
+    }
+
+private:
+    std::map<u16, std::string> names;
+};
+
+std::string quote(const std::string &text)
+{
+    std::string quoted = "\"";
+
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        quoted += c;
+    }
+
+    return quoted + "\"";
+}
+
+double percent(u64 part, u64 whole)
+{
+    return whole ? 100.0 * part / whole : 0;
+}
+
+// Per function, by descending total impulses. Recursive calls only count
+// once towards the total
+std::vector<FunctionTotals> sumFunctions(const Profiler &profiler)
+{
+    const std::vector<ProfileFrame> &frames = profiler.getFrames();
+    std::vector<u64> subtree(frames.size());
+
+    for (size_t index = frames.size(); index-- > 0;) {
+        subtree[index] += frames[index].impulses;
+
+        if (index)
+            subtree[frames[index].parent] += subtree[index];
+    }
+
+    std::map<u32, FunctionTotals> functions;
+
+    for (size_t index = 0; index < frames.size(); index++) {
+        const ProfileFrame &frame = frames[index];
+        u32 key = (u32)frame.interrupt << 16 | frame.function;
+
+        FunctionTotals &totals = functions[key];
+        totals.address = frame.function;
+        totals.interrupt = frame.interrupt;
+        totals.calls += frame.calls;
+        totals.count += frame.count;
+        totals.selfImpulses += frame.impulses;
+
+        bool outermost = true;
+        for (u32 caller = index; caller && outermost;) {
+            caller = frames[caller].parent;
+            outermost = frames[caller].function != frame.function || frames[caller].interrupt != frame.interrupt;
+        }
+
+        if (outermost)
+            totals.totalImpulses += subtree[index];
+    }
+
+    std::vector<FunctionTotals> sorted;
+    for (const auto &function : functions)
+        sorted.push_back(function.second);
+
+    std::stable_sort(sorted.begin(), sorted.end(), [](const FunctionTotals &a, const FunctionTotals &b) {
+        return a.totalImpulses > b.totalImpulses;
+    });
+
+    return sorted;
+}
+
+// Word addresses that ran, by descending impulses
+std::vector<u32> sortAddresses(const Profiler &profiler)
+{
+    const std::vector<ProfileCounter> &counters = profiler.getCounters();
+    std::vector<u32> words;
+
+    for (u32 word = 0; word < counters.size(); word++) {
+        if (counters[word].count)
+            words.push_back(word);
+    }
+
+    std::stable_sort(words.begin(), words.end(), [&](u32 a, u32 b) {
+        return counters[a].impulses > counters[b].impulses;
+    });
+
+    return words;
+}
+
+void writeText(std::ostream &output, const Profiler &profiler, const ProfileNames &names)
+{
+    const std::vector<ProfileCounter> &counters = profiler.getCounters();
+    u64 impulses = profiler.getImpulses();
+    const char *unit = profiler.getSamplePeriod() ? "samples" : "instructions";
+    char line[256];
+
+    output << unit << ": " << profiler.getInstructions() << "\n";
+    if (profiler.getSamplePeriod())
+        output << "sample period: " << profiler.getSamplePeriod() << "\n";
+    output << "impulses: " << impulses << "\n"
+           << "interrupts: " << profiler.getInterrupts() << "\n\n";
+
+    snprintf(line, sizeof(line), "%-32s %10s %14s %14s %7s %14s %7s\n", "function", "calls", unit, "self", "%",
+             "total", "%");
+    output << line;
+
+    for (const FunctionTotals &function : sumFunctions(profiler)) {
+        snprintf(line, sizeof(line), "%-32s %10llu %14llu %14llu %6.2f%% %14llu %6.2f%%\n",
+                 names.function(function.address, function.interrupt).c_str(), function.calls, function.count,
+                 function.selfImpulses, percent(function.selfImpulses, impulses), function.totalImpulses,
+                 percent(function.totalImpulses, impulses));
+        output << line;
+    }
+
+    snprintf(line, sizeof(line), "\n%-7s %-32s %14s %14s %7s\n", "address", "location", "count", "impulses", "%");
+    output << line;
+
+    for (u32 word : sortAddresses(profiler)) {
+        snprintf(line, sizeof(line), "0x%04x  %-32s %14llu %14llu %6.2f%%\n", word << 1,
+                 names.location(word << 1).c_str(), counters[word].count, counters[word].impulses,
+                 percent(counters[word].impulses, impulses));
+        output << line;
+    }
+}
+
+void writeJson(std::ostream &output, const Profiler &profiler, const ProfileNames &names)
+{
+    const std::vector<ProfileCounter> &counters = profiler.getCounters();
+
+    // Sampled profiles count samples where the others count instructions
+    output << "{\n  \"samplePeriod\": " << profiler.getSamplePeriod()
+           << ",\n  \"instructions\": " << profiler.getInstructions()
+           << ",\n  \"impulses\": " << profiler.getImpulses()
+           << ",\n  \"interrupts\": " << profiler.getInterrupts()
+           << ",\n  \"functions\": [";
+
+    const char *separator = "\n";
+    for (const FunctionTotals &function : sumFunctions(profiler)) {
+        output << separator << "    {\"name\": " << quote(names.function(function.address, false))
+               << ", \"address\": " << function.address
+               << ", \"interrupt\": " << (function.interrupt ? "true" : "false")
+               << ", \"calls\": " << function.calls << ", \"instructions\": " << function.count
+               << ", \"selfImpulses\": " << function.selfImpulses
+               << ", \"totalImpulses\": " << function.totalImpulses << "}";
+        separator = ",\n";
+    }
+
+    output << "\n  ],\n  \"addresses\": [";
+
+    separator = "\n";
+    for (u32 word : sortAddresses(profiler)) {
+        output << separator << "    {\"address\": " << (word << 1)
+               << ", \"location\": " << quote(names.location(word << 1))
+               << ", \"count\": " << counters[word].count << ", \"impulses\": " << counters[word].impulses << "}";
+        separator = ",\n";
+    }
+
+    output << "\n  ]\n}\n";
+}
+
+void writeCollapsed(std::ostream &output, const Profiler &profiler, const ProfileNames &names)
+{
+    const std::vector<ProfileFrame> &frames = profiler.getFrames();
+    std::vector<std::string> stacks(frames.size());
+
+    // Callers come first, their stacks are complete when the callees need
+    // them
+    for (size_t index = 0; index < frames.size(); index++) {
+        const ProfileFrame &frame = frames[index];
+        std::string name = names.function(frame.function, frame.interrupt);
+
+        stacks[index] = index ? stacks[frame.parent] + ";" + name : name;
+
+        if (frame.impulses)
+            output << stacks[index] << " " << frame.impulses << "\n";
+    }
+}
+
+}
+
+Profiler::Profiler(u16 entry, u64 samplePeriod, bool randomized)
+    : counters(1 << 15),
+      overflow(0),
+      interrupts(0),
+      samplePeriod(samplePeriod),
+      randomized(randomized),
+      random(0x9e3779b97f4a7c15ull),
+      interval(0),
+      nextSample(~0ull)
+{
+    frames.push_back({entry, false, 0, 0, 1, 0, 0});
+    frame = &frames.front();
+}
+
+u64 Profiler::getInstructions() const
+{
+    u64 instructions = 0;
+
+    for (const ProfileFrame &frame : frames)
+        instructions += frame.count;
+
+    return instructions;
+}
+
+u64 Profiler::getImpulses() const
+{
+    u64 impulses = 0;
+
+    for (const ProfileFrame &frame : frames)
+        impulses += frame.impulses;
+
+    return impulses;
+}
+
+void Profiler::ret()
+{
+    if (overflow)
+        overflow--;
+    else
+        frame = &frames[frame->parent];
+}
+
+void Profiler::interrupt(u16 handler, u64 impulses)
+{
+    enter(handler, true);
+
+    if (!samplePeriod)
+        frame->impulses += impulses;
+    interrupts++;
+}
+
+void Profiler::startSampling(u64 impulseCount)
+{
+    interval = drawInterval();
+    nextSample = impulseCount + interval;
+}
+
+void Profiler::sample(u16 address, u64 impulseCount, u32 frame)
+{
+    ProfileCounter &counter = counters[address >> 1];
+    ProfileFrame &sampled = frames[frame];
+
+    // A wait that skipped ahead passes several
+    while (nextSample <= impulseCount) {
+        counter.count++;
+        counter.impulses += interval;
+
+        sampled.count++;
+        sampled.impulses += interval;
+
+        interval = drawInterval();
+        nextSample += interval;
+    }
+}
+
+void Profiler::enter(u16 function, bool interrupt)
+{
+    if (frame->depth == maxDepth) {
+        overflow++;
+        return;
+    }
+
+    u32 current = frame - frames.data();
+    auto child = children.emplace(childKey(current, function, interrupt), (u32)frames.size());
+
+    if (child.second)
+        frames.push_back({function, interrupt, current, frame->depth + 1, 0, 0, 0});
+
+    frame = &frames[child.first->second];
+    frame->calls++;
+}
+
+u64 Profiler::drawInterval()
+{
+    if (!randomized)
+        return samplePeriod;
+
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+
+    return std::max<u64>(samplePeriod / 2 + random % (samplePeriod + 1), 1);
+}
+
+void writeProfile(std::ostream &output, const Profiler &profiler, const Labels &labels, ProfileFormat format)
+{
+    ProfileNames names(labels);
+
+    switch (format) {
+    case ProfileFormat::text:
+        writeText(output, profiler, names);
+        break;
+    case ProfileFormat::json:
+        writeJson(output, profiler, names);
+        break;
+    case ProfileFormat::collapsed:
+        writeCollapsed(output, profiler, names);
+        break;
+    }
+}
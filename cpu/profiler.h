@@ -0,0 +1,134 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "assembler/defs.h"
+
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+//// Instructions completed at a word address and the impulses they took,
+//// or the samples taken there and the impulses they stand for
+struct ProfileCounter
+{
+    u64 count;
+    u64 impulses;
+};
+
+//// Node of the calling context tree: a function entered by call, or an
+//// interrupt handler, by the path of calls that led to it
+struct ProfileFrame
+{
+    u16 function; // entry address
+    bool interrupt;
+    u32 parent;   // index of the caller, the root is its own parent
+    u32 depth;
+    u64 calls;
+    u64 count;    // instructions completed or samples taken in it, not
+                  // in its callees
+    u64 impulses; // of those, and of interrupt entries
+};
+
+//// Report layouts of writeProfile()
+enum class ProfileFormat {
+    text,
+    json,
+    collapsed // one line per call stack and its impulses, for flame graphs
+};
+
+//// Execution counts and impulses per word address, and per call stack
+//// from the call, ret, reti and interrupt entries the core reports. The
+//// core calls the hooks while CpuCore::setProfiler() has it.
+////
+//// A sampling profiler counts a sample of the instruction that reaches
+//// each sample impulse instead of every instruction, with the impulses
+//// since the sample before it. Its reports read the same, counting
+//// samples
+class Profiler
+{
+public:
+    //// Deeper calls are counted in the frame at this depth
+    static const u32 maxDepth = 1024;
+
+    //// entry names the root frame, the code that runs outside of calls.
+    //// A samplePeriod other than 0 samples every samplePeriod impulses or,
+    //// randomized, after intervals drawn evenly from half to one and a
+    //// half of it, which do not fall into step with loops
+    explicit Profiler(u16 entry = 0, u64 samplePeriod = 0, bool randomized = false);
+
+    //// An instruction at address that completed after impulses
+    void instruction(u16 address, u64 impulses)
+    {
+        ProfileCounter &counter = counters[address >> 1];
+        counter.count++;
+        counter.impulses += impulses;
+
+        frame->count++;
+        frame->impulses += impulses;
+    }
+
+    //// After the instruction(): a call to function, or a ret or reti
+    void call(u16 function) { enter(function, false); }
+    void ret();
+
+    //// An interrupt entry to handler that took impulses, which sampling
+    //// profilers leave to the samples
+    void interrupt(u16 handler, u64 impulses);
+
+    //// 0 unless sampling
+    u64 getSamplePeriod() const { return samplePeriod; }
+
+    //// Starts the sample intervals at impulseCount
+    void startSampling(u64 impulseCount);
+
+    //// Impulses left before the next sample, 0 once it is due
+    u64 impulsesToSample(u64 impulseCount) const
+    {
+        return nextSample > impulseCount ? nextSample - impulseCount : 0;
+    }
+
+    //// Samples the instruction at address, which ran in the frame at
+    //// index frame of getFrames(), for every sample due by impulseCount.
+    //// That is the frame before the call or ret of the instruction
+    //// itself, as for instruction()
+    void sample(u16 address, u64 impulseCount, u32 frame);
+
+    //// Index of the current frame in getFrames()
+    u32 getCurrentFrame() const { return u32(frame - frames.data()); }
+
+    //// Totals of the frames, samples for sampling profilers
+    u64 getInstructions() const;
+    u64 getImpulses() const;
+    u64 getInterrupts() const { return interrupts; }
+
+    //// One counter per word address, instructions at odd addresses count
+    //// at the word address below
+    const std::vector<ProfileCounter> &getCounters() const { return counters; }
+
+    //// The root first, callers before their callees
+    const std::vector<ProfileFrame> &getFrames() const { return frames; }
+
+private:
+    void enter(u16 function, bool interrupt);
+    u64 drawInterval();
+
+    std::vector<ProfileCounter> counters;
+    std::vector<ProfileFrame> frames;
+    // Children by parent, interrupt and function
+    std::unordered_map<u64, u32> children;
+    ProfileFrame *frame; // the current one, in frames
+    u64 overflow;        // calls deeper than maxDepth not returned from yet
+    u64 interrupts;
+
+    u64 samplePeriod;
+    bool randomized;
+    u64 random;     // xorshift state
+    u64 interval;   // ending at nextSample
+    u64 nextSample;
+};
+
+//// Writes the report of profiler, naming functions after the labels at
+//// their entry and addresses after the nearest label before them
+void writeProfile(std::ostream &output, const Profiler &profiler, const Labels &labels, ProfileFormat format);
+
+#endif // PROFILER_H
@@ -0,0 +1,213 @@
+#include "signaltrace.h"
+
+#include <cpu/cpucoreimpl.h>
+
+#include <cstring>
+#include <stdexcept>
+
+template class CpuCore<SignalObserver>;
+
+namespace {
+
+const char magic[8] = {'X', 'A', 'S', 'M', 'S', 'I', 'G', 'S'};
+const u32 currentVersion = 1;
+const size_t headerSize = 16;
+
+// Identifier codes of the variables in a VCD, printable characters from !
+// on: the control signals, then phase, impulse and the five words
+enum VcdWord {
+    vcdPhase = controlSignalCount,
+    vcdImpulse,
+    vcdSBUS,
+    vcdDBUS,
+    vcdRBUS,
+    vcdADR,
+    vcdMDR,
+    vcdVariableCount
+};
+
+char vcdIdentifier(int variable)
+{
+    return char('!' + variable);
+}
+
+// Bits needed to write value in binary
+int bitWidth(u16 value)
+{
+    int width = 1;
+
+    while (value >> width)
+        width++;
+
+    return width;
+}
+
+void putVcdVector(std::ostream &output, int variable, u16 value)
+{
+    char digits[20];
+    char *digit = digits + sizeof(digits);
+
+    *--digit = 0;
+
+    do {
+        *--digit = char('0' + (value & 1));
+        value >>= 1;
+    } while (value);
+
+    output << 'b' << digit << ' ' << vcdIdentifier(variable) << '\n';
+}
+
+u16 vcdValue(const SignalRecord &record, int variable)
+{
+    switch (variable) {
+    case vcdPhase:
+        return record.phase;
+    case vcdImpulse:
+        return record.impulse;
+    case vcdSBUS:
+        return record.SBUS;
+    case vcdDBUS:
+        return record.DBUS;
+    case vcdRBUS:
+        return record.RBUS;
+    case vcdADR:
+        return record.ADR;
+    default:
+        return record.MDR;
+    }
+}
+
+}
+
+const char *const controlSignalNames[controlSignalCount] = {
+    "PdPCD", "PdPCS", "ALU", "PdALU", "PmADR", "RD", "PmIR", "PCchanged", "PmT", "PmMDR", "PdRGS", "PdRGD",
+    "PdMDRS", "PdMDRD", "PdTS", "PmRG", "WR", "PmFLAG", "PmPC", "PmSBUS", "PdSPS", "SPchanged", "PdFLAGS",
+    "PdIVRS", "loadIVR"
+};
+
+SignalWriter::SignalWriter(const std::string &path) : path(path), file(path, std::ios::binary)
+{
+    failed = false;
+    buffer.reserve(bufferRecords);
+
+    u8 header[headerSize] = {};
+    memcpy(header, magic, sizeof(magic));
+    header[8] = u8(currentVersion);
+
+    if (!file || !file.write(reinterpret_cast<const char *>(header), sizeof(header)))
+        throw std::runtime_error("cannot write " + path);
+}
+
+SignalWriter::~SignalWriter()
+{
+    try {
+        close();
+    } catch (std::runtime_error &) {
+    }
+}
+
+void SignalWriter::flush()
+{
+    if (!file.write(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(SignalRecord)))
+        failed = true;
+
+    buffer.clear();
+}
+
+void SignalWriter::close()
+{
+    if (!file.is_open())
+        return;
+
+    flush();
+    file.close();
+
+    if (failed || file.fail())
+        throw std::runtime_error("cannot write " + path);
+}
+
+SignalReader::SignalReader(const std::string &path) : file(path, std::ios::binary)
+{
+    char header[headerSize];
+
+    if (!file)
+        throw std::runtime_error("cannot open " + path);
+
+    if (!file.read(header, sizeof(header)) || memcmp(header, magic, sizeof(magic)))
+        throw std::runtime_error(path + " is not a signal capture");
+
+    u32 version = u8(header[8]) | u8(header[9]) << 8 | u8(header[10]) << 16 | u32(u8(header[11])) << 24;
+    if (version != currentVersion)
+        throw std::runtime_error(path + " is a signal capture of version " + std::to_string(version));
+}
+
+bool SignalReader::next(SignalRecord &record)
+{
+    file.read(reinterpret_cast<char *>(&record), sizeof(record));
+
+    if (file.gcount() == 0)
+        return false;
+
+    if (file.gcount() != sizeof(record))
+        throw std::runtime_error("truncated signal record");
+
+    return true;
+}
+
+void writeVcd(std::ostream &output, SignalReader &reader)
+{
+    const int widths[vcdVariableCount - vcdPhase] = {
+        bitWidth(u16(Phase::INT)), bitWidth(CGB::maxImpulse), 16, 16, 16, 16, 16
+    };
+    static const char *const names[vcdVariableCount - vcdPhase] = {
+        "phase", "impulse", "SBUS", "DBUS", "RBUS", "ADR", "MDR"
+    };
+
+    output << "$version xasm-run $end\n"
+              "$timescale 1 ns $end\n"
+              "$scope module cpu $end\n";
+
+    for (int signal = 0; signal < controlSignalCount; signal++)
+        output << "$var wire 1 " << vcdIdentifier(signal) << ' ' << controlSignalNames[signal] << " $end\n";
+
+    for (int variable = vcdPhase; variable < vcdVariableCount; variable++) {
+        output << "$var wire " << widths[variable - vcdPhase] << ' ' << vcdIdentifier(variable) << ' '
+               << names[variable - vcdPhase] << " $end\n";
+    }
+
+    output << "$upscope $end\n"
+              "$enddefinitions $end\n";
+
+    SignalRecord record;
+    SignalRecord previous = {};
+    bool first = true;
+
+    while (reader.next(record)) {
+        u32 signals = first ? ~0u : record.signals ^ previous.signals;
+
+        output << '#' << record.impulseCount - 1 << '\n';
+
+        for (int signal = 0; signal < controlSignalCount; signal++) {
+            if (signals >> signal & 1)
+                output << (record.signals >> signal & 1) << vcdIdentifier(signal) << '\n';
+        }
+
+        for (int variable = vcdPhase; variable < vcdVariableCount; variable++) {
+            u16 value = vcdValue(record, variable);
+
+            // A wider value than declared would make the dump invalid
+            if (bitWidth(value) > widths[variable - vcdPhase])
+                throw std::runtime_error("damaged signal record");
+
+            if (first || value != vcdValue(previous, variable))
+                putVcdVector(output, variable, value);
+        }
+
+        previous = record;
+        first = false;
+    }
+
+    // The end of the last impulse
+    if (!first)
+        output << '#' << previous.impulseCount << '\n';
+}
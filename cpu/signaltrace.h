@@ -0,0 +1,178 @@
+#ifndef SIGNALTRACE_H
+#define SIGNALTRACE_H
+
+#include "assembler/defs.h"
+#include <cpu/cpucore.h>
+
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//// Datapath commands of the core as bits of SignalRecord::signals, one per
+//// method of the observers
+enum ControlSignal {
+    signalPdPCD,
+    signalPdPCS,
+    signalALU,
+    signalPdALU,
+    signalPmADR,
+    signalRD,
+    signalPmIR,
+    signalPCchanged,
+    signalPmT,
+    signalPmMDR,
+    signalPdRGS,
+    signalPdRGD,
+    signalPdMDRS,
+    signalPdMDRD,
+    signalPdTS,
+    signalPmRG,
+    signalWR,
+    signalPmFLAG,
+    signalPmPC,
+    signalPmSBUS,
+    signalPdSPS,
+    signalSPchanged,
+    signalPdFLAGS,
+    signalPdIVRS,
+    signalLoadIVR,
+    controlSignalCount
+};
+
+extern const char *const controlSignalNames[controlSignalCount];
+
+//// One impulse of a signal capture: the commands it activated and the
+//// buses, ADR and MDR after it
+struct SignalRecord
+{
+    u64 impulseCount; // after it
+    u32 signals;      // 1 << ControlSignal per active command
+    u16 SBUS;
+    u16 DBUS;
+    u16 RBUS;
+    u16 ADR;
+    u16 MDR;
+    u8 phase;         // Phase the impulse ran in
+    u8 impulse;
+};
+
+static_assert(sizeof(SignalRecord) == 24, "signal records are packed into 24 bytes");
+
+//// Signal capture files. After a 16 byte header, "XASMSIGS", the u32
+//// version and a reserved u32, little endian, comes one SignalRecord per
+//// impulse, as it is laid out in memory
+class SignalWriter
+{
+public:
+    //// Throws std::runtime_error if path cannot be written
+    explicit SignalWriter(const std::string &path);
+    ~SignalWriter();
+
+    SignalWriter(const SignalWriter &) = delete;
+    SignalWriter &operator=(const SignalWriter &) = delete;
+
+    void write(const SignalRecord &record)
+    {
+        buffer.push_back(record);
+
+        if (buffer.size() == bufferRecords)
+            flush();
+    }
+
+    //// Throws std::runtime_error if writing failed
+    void close();
+
+private:
+    static const size_t bufferRecords = 1 << 15;
+
+    void flush();
+
+    std::string path;
+    std::ofstream file;
+    std::vector<SignalRecord> buffer;
+    bool failed;
+};
+
+class SignalReader
+{
+public:
+    //// Throws std::runtime_error if path is not a signal capture
+    explicit SignalReader(const std::string &path);
+
+    //// False at the end of the capture. Throws std::runtime_error on a
+    //// truncated record
+    bool next(SignalRecord &record);
+
+private:
+    std::ifstream file;
+};
+
+//// Writes the records of reader as a Value Change Dump, one time unit per
+//// impulse, for waveform viewers. Impulse n spans the time from n - 1 to n.
+//// Throws std::runtime_error like SignalReader::next(), and on a phase or
+//// impulse wider than its variable
+void writeVcd(std::ostream &output, SignalReader &reader);
+
+//// Observer that hands a SignalRecord per impulse run by advance() to a
+//// SignalWriter. The commands only set bits, which keeps advance() about
+//// as fast as with NullCpuObserver
+class SignalObserver
+{
+public:
+    static const bool showsFlags = false;
+    static const bool showsMemory = false;
+    static const bool recordsImpulses = true;
+
+    explicit SignalObserver(SignalWriter *writer = nullptr) : writer(writer), signals(0) {}
+
+    void PdPCD(bool active) { set(signalPdPCD, active); }
+    void PdPCS(bool active) { set(signalPdPCS, active); }
+    void ALU(bool active, bool, bool, const char * = "ALU") { set(signalALU, active); }
+    void PdALU(bool active) { set(signalPdALU, active); }
+    void PmADR(bool active, u16 = 0) { set(signalPmADR, active); }
+    void RD(bool active, const char * = "MEMORY") { set(signalRD, active); }
+    void PmIR(bool active, u16 = 0) { set(signalPmIR, active); }
+    void PCchanged(bool active, u16 = 0) { set(signalPCchanged, active); }
+    void PmT(bool active, u16 = 0) { set(signalPmT, active); }
+    void PmMDR(bool active, u16 = 0, bool = false) { set(signalPmMDR, active); }
+    void PdRGS(bool active) { set(signalPdRGS, active); }
+    void PdRGD(bool active) { set(signalPdRGD, active); }
+    void PdMDRS(bool active) { set(signalPdMDRS, active); }
+    void PdMDRD(bool active) { set(signalPdMDRD, active); }
+    void PdTS(bool active) { set(signalPdTS, active); }
+    void PmRG(bool active, u8 = 17, u16 = 0) { set(signalPmRG, active); }
+    void WR(bool active, const char * = "MEMORY") { set(signalWR, active); }
+    void PmFLAG(bool active, u16 = 0, bool = false) { set(signalPmFLAG, active); }
+    void PmPC(bool active, u16 = 0) { set(signalPmPC, active); }
+    void PmMem(const std::vector<MemoryRange> &) {}
+    void PmSBUS(bool active) { set(signalPmSBUS, active); }
+    void PdSPS(bool active) { set(signalPdSPS, active); }
+    void SPchanged(bool active, u16 = 0) { set(signalSPchanged, active); }
+    void PdFLAGS(bool active) { set(signalPdFLAGS, active); }
+    void PdIVRS(bool active) { set(signalPdIVRS, active); }
+    void loadIVR(bool active, u16 = 0) { set(signalLoadIVR, active); }
+
+    void log(const char *) {}
+
+    void impulseDone(const CpuImpulse &impulse)
+    {
+        if (writer) {
+            writer->write({impulse.impulseCount, signals, impulse.SBUS, impulse.DBUS, impulse.RBUS, impulse.ADR,
+                           impulse.MDR, u8(impulse.phase), impulse.impulse});
+        }
+
+        signals = 0;
+    }
+
+private:
+    // Commands are also reported inactive, at the start of every impulse
+    void set(ControlSignal signal, bool active) { signals |= u32(active) << signal; }
+
+    SignalWriter *writer;
+    u32 signals;
+};
+
+extern template class CpuCore<SignalObserver>;
+
+#endif // SIGNALTRACE_H
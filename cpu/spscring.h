@@ -0,0 +1,87 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+//// Lock-free ring buffer between exactly one producer thread and one
+//// consumer thread. Both sides work on indices that only grow, the slot of
+//// an index is index & mask. The producer fills slots past head() and
+//// publishes them with commit(), the consumer reads the slots between
+//// tail() and the published head and hands them back with release()
+template <class T>
+class SpscRing
+{
+public:
+    //// capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size *= 2;
+
+        slots.resize(size);
+        mask = size - 1;
+        head = 0;
+        tail = 0;
+        producerHead = 0;
+        producerTail = 0;
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    size_t capacity() const { return slots.size(); }
+
+    // Producer side
+
+    //// Waits until count slots past producerIndex() are free
+    void reserve(size_t count)
+    {
+        if (slots.size() - (producerHead - producerTail) >= count)
+            return;
+
+        while (slots.size() - (producerHead - (producerTail = tail.load(std::memory_order_acquire))) < count)
+            std::this_thread::yield();
+    }
+
+    size_t producerIndex() const { return producerHead; }
+    T &at(size_t index) { return slots[index & mask]; }
+
+    //// Publishes the slots up to index to the consumer
+    void commit(size_t index)
+    {
+        producerHead = index;
+        head.store(index, std::memory_order_release);
+    }
+
+    // Consumer side
+
+    //// Index past the last published slot
+    size_t published() const { return head.load(std::memory_order_acquire); }
+    size_t consumerIndex() const { return tail.load(std::memory_order_relaxed); }
+    const T &at(size_t index) const { return slots[index & mask]; }
+
+    //// Frees the slots before index for the producer
+    void release(size_t index) { tail.store(index, std::memory_order_release); }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+
+    // Written by one side each and kept on cache lines of their own. The
+    // padding stands in for alignas, which new only honours from C++17 on
+    char padding0[64];
+    std::atomic<size_t> head;
+    char padding1[64];
+    std::atomic<size_t> tail;
+    char padding2[64];
+
+    // Producer copies, so that reserve() rarely reads tail
+    size_t producerHead;
+    size_t producerTail;
+};
+
+#endif // SPSCRING_H
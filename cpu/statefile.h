@@ -0,0 +1,56 @@
+#ifndef STATEFILE_H
+#define STATEFILE_H
+
+#include "assembler/defs.h"
+
+//// Header of a state file as written by CpuCore::saveState(). Little
+//// endian with every field at a fixed offset, so a mapped file is read in
+//// place. It is followed by the 256 byte memory pages whose bit is set in
+//// pages, in address order, the other pages are zero. Versions only grow
+//// by using reserved bytes or appending after the pages
+struct StateFileHeader
+{
+    static const u32 currentVersion = 1;
+
+    char magic[8]; // "XASMSTAT"
+    u32 version;
+    u32 pageOffset; // where the pages start, sizeof(StateFileHeader)
+    u64 impulseCount;
+
+    u16 R[16];
+    u16 PC;
+    u16 SP;
+    u16 FLAG;
+    u16 T;
+    u16 IR;
+    u16 MDR;
+    u16 ADR;
+    u16 IVR;
+
+    u16 SBUS;
+    u16 DBUS;
+    u16 RBUS;
+
+    // CGB
+    u8 phase;
+    u8 impulse;
+
+    // Decoded by IF for the later phases
+    u8 mas;
+    u8 mad;
+    u8 instructionClass;
+
+    u8 intr;
+    u8 halt;
+    char reason[128]; // NUL terminated
+
+    u8 pages[32]; // bit i % 8 of byte i / 8 for page i
+
+    u8 reserved[11];
+};
+
+static_assert(sizeof(StateFileHeader) == 256, "state file pages start at offset 256");
+
+const char stateFileMagic[8] = {'X', 'A', 'S', 'M', 'S', 'T', 'A', 'T'};
+
+#endif // STATEFILE_H
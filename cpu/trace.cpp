@@ -0,0 +1,691 @@
+#include "trace.h"
+
+#include <cpu/statefile.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+const char magic[8] = {'X', 'A', 'S', 'M', 'T', 'R', 'A', 'C'};
+const u32 currentVersion = 2;
+const size_t headerSize = 16;
+
+const char indexMagic[8] = {'X', 'A', 'S', 'M', 'I', 'N', 'D', 'X'};
+const size_t trailerSize = 16;
+
+// Tag bits
+const u8 tagInterrupt = 1 << 0;
+const u8 tagPC = 1 << 1;
+const u8 tagIR = 1 << 2;
+const u8 tagImpulses = 1 << 3;
+const u8 tagRegisters = 1 << 4;
+const int tagWritesShift = 5;
+
+// Tags of version 2
+const u8 tagKeyframe = 0x80;
+const u8 tagRequest = 0x81;
+const u8 tagIndex = 0x82;
+
+// Longest encoded record: tag, PC, IR, impulses, mask, the registers and
+// the writes
+const size_t maxRecordBytes = 1 + 3 + 3 + 10 + 3 + traceRegisterCount * 3 + maxTraceWrites * 6;
+
+// Encoded bytes written at once
+const size_t outputBytes = 1 << 20;
+
+void putVarint(u8 *&output, u64 value)
+{
+    while (value >= 0x80) {
+        *output++ = u8(value) | 0x80;
+        value >>= 7;
+    }
+
+    *output++ = u8(value);
+}
+
+// Small differences in either direction become small numbers
+u16 zigzag(u16 difference)
+{
+    return u16(difference << 1) ^ (difference & 0x8000 ? 0xffff : 0);
+}
+
+u16 unzigzag(u16 value)
+{
+    return (value >> 1) ^ (value & 1 ? 0xffff : 0);
+}
+
+}
+
+TraceContext::TraceContext() : slots(1 << 15)
+{
+    PC = 0;
+    writeAddress = 0;
+    impulseCount = 0;
+    memset(registers, 0, sizeof(registers));
+}
+
+TraceWriter::TraceWriter(const std::string &path, u64 keyframeInterval)
+    : ring(ringWords), path(path), buffer(outputBytes + maxRecordBytes)
+{
+    writeCount = 0;
+    this->keyframeInterval = std::max<u64>(keyframeInterval, 1);
+    recordedInstructions = 0;
+    nextKeyframe = 0;
+    keyframed = false;
+
+    positions.instructions = 0;
+    positions.impulseCount = 0;
+    written = headerSize;
+    failed = false;
+    closing = false;
+
+    file.open(path, std::ios::binary);
+
+    u8 header[headerSize] = {};
+    memcpy(header, magic, sizeof(magic));
+    header[8] = u8(currentVersion);
+
+    if (!file || !file.write(reinterpret_cast<const char *>(header), sizeof(header)))
+        throw std::runtime_error("cannot write " + path);
+
+    thread = std::thread(&TraceWriter::run, this);
+}
+
+TraceWriter::~TraceWriter()
+{
+    try {
+        close();
+    } catch (std::runtime_error &) {
+    }
+}
+
+void TraceWriter::close()
+{
+    if (!thread.joinable())
+        return;
+
+    closing.store(true, std::memory_order_release);
+    thread.join();
+    file.close();
+
+    if (failed || file.fail())
+        throw std::runtime_error("cannot write " + path);
+}
+
+void TraceWriter::keyframe(std::vector<u8> state, u64 impulseCount)
+{
+    {
+        std::lock_guard<std::mutex> lock(statesLock);
+        states.push_back(std::move(state));
+    }
+
+    mark(keyframeMarker, impulseCount);
+    nextKeyframe = recordedInstructions + keyframeInterval;
+    keyframed = true;
+}
+
+void TraceWriter::flush(u8 *&output)
+{
+    if (!file.write(reinterpret_cast<const char *>(buffer.data()), output - buffer.data()))
+        failed = true;
+
+    written += output - buffer.data();
+    output = buffer.data();
+}
+
+void TraceWriter::run()
+{
+    u8 *output = buffer.data();
+
+    for (;;) {
+        // Read closing first, the records committed before it was set are
+        // published by then
+        bool last = closing.load(std::memory_order_acquire);
+        size_t end = ring.published();
+        size_t index = ring.consumerIndex();
+
+        if (index == end) {
+            if (last)
+                break;
+
+            if (output != buffer.data())
+                flush(output);
+
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+
+        while (index != end) {
+            index = encode(index, output);
+
+            if (output - buffer.data() >= (ptrdiff_t)outputBytes)
+                flush(output);
+        }
+
+        ring.release(index);
+    }
+
+    writeIndex(output);
+    flush(output);
+}
+
+void TraceWriter::writeIndex(u8 *&output)
+{
+    u64 offset = written + (output - buffer.data());
+
+    // Varints of at most 10 bytes, flushed in between
+    auto put = [&](u64 value) {
+        if (output - buffer.data() >= (ptrdiff_t)outputBytes)
+            flush(output);
+
+        putVarint(output, value);
+    };
+
+    *output++ = tagIndex;
+    put(positions.keyframes.size());
+
+    for (const TraceKeyframe &keyframe : positions.keyframes) {
+        put(keyframe.instructions);
+        put(keyframe.impulseCount);
+        put(keyframe.offset);
+        put(keyframe.requests);
+    }
+
+    put(positions.requests.size());
+
+    u64 previous = 0;
+    for (u64 request : positions.requests) {
+        put(request - previous);
+        previous = request;
+    }
+
+    put(positions.instructions);
+    put(positions.impulseCount);
+
+    flush(output);
+
+    for (int byte = 0; byte < 8; byte++)
+        *output++ = u8(offset >> 8 * byte);
+
+    memcpy(output, indexMagic, sizeof(indexMagic));
+    output += sizeof(indexMagic);
+}
+
+// Encodes the record at index of the ring, returns the index after it
+size_t TraceWriter::encode(size_t index, u8 *&output)
+{
+    const SpscRing<u32> &records = ring;
+
+    u32 first = records.at(index++);
+    u32 second = records.at(index++);
+    u64 impulseCount = records.at(index) | u64(records.at(index + 1)) << 32;
+    u32 info = records.at(index + 2);
+    index += 3;
+
+    if (info & requestMarker) {
+        *output++ = tagRequest;
+        putVarint(output, impulseCount);
+        positions.requests.push_back(impulseCount);
+        return index;
+    }
+
+    if (info & keyframeMarker) {
+        std::vector<u8> state;
+
+        {
+            std::lock_guard<std::mutex> lock(statesLock);
+            state = std::move(states.front());
+            states.pop_front();
+        }
+
+        positions.keyframes.push_back({positions.instructions, impulseCount,
+                                       written + (output - buffer.data()), positions.requests.size()});
+        positions.impulseCount = impulseCount;
+
+        *output++ = tagKeyframe;
+        putVarint(output, positions.instructions);
+        putVarint(output, impulseCount);
+        putVarint(output, state.size());
+        flush(output);
+
+        if (!file.write(reinterpret_cast<const char *>(state.data()), state.size()))
+            failed = true;
+
+        written += state.size();
+
+        // The records after it are read from here on
+        context = TraceContext();
+        context.impulseCount = impulseCount;
+
+        return index;
+    }
+
+    u16 pc = u16(first);
+    u16 ir = u16(first >> 16);
+    bool interrupt = info >> 21 & 1;
+    int writes = info >> 22 & 3;
+
+    if (!interrupt)
+        positions.instructions++;
+
+    positions.impulseCount = impulseCount;
+
+    // The registers that changed, with their new values
+    u32 changed = 0;
+    u16 values[traceRegisterCount];
+
+    auto compare = [&](int r, u16 value) {
+        if (value != context.registers[r]) {
+            changed |= 1 << r;
+            values[r] = value;
+        }
+    };
+
+    if (info & allRegisters) {
+        for (int r = 0; r < 16; r += 2) {
+            u32 word = records.at(index++);
+            compare(r, u16(word));
+            compare(r + 1, u16(word >> 16));
+        }
+    }
+    else {
+        compare(info >> 16 & 0xf, u16(info));
+    }
+
+    compare(traceSP, u16(second));
+    compare(traceFLAG, u16(second >> 16));
+
+    u64 impulses = impulseCount - context.impulseCount;
+    context.impulseCount = impulseCount;
+
+    u8 *tag = output++;
+    *tag = u8(writes << tagWritesShift);
+
+    TraceContext::Slot &slot = context.slots[pc >> 1];
+
+    if (interrupt) {
+        *tag |= tagInterrupt | tagPC | tagImpulses;
+        putVarint(output, zigzag(pc - context.PC));
+        putVarint(output, impulses);
+    }
+    else {
+        u16 &successor = context.slots[context.PC >> 1].successor;
+
+        if (pc != successor) {
+            *tag |= tagPC;
+            putVarint(output, zigzag(pc - context.PC));
+            successor = pc;
+        }
+
+        if (ir != slot.IR) {
+            *tag |= tagIR;
+            putVarint(output, ir);
+            slot.IR = ir;
+        }
+
+        if (impulses != slot.impulses) {
+            *tag |= tagImpulses;
+            putVarint(output, impulses);
+            slot.impulses = u32(impulses);
+        }
+    }
+
+    context.PC = pc;
+
+    if (changed) {
+        *tag |= tagRegisters;
+        putVarint(output, changed);
+
+        u32 general = changed & 0xffff;
+
+        for (int r = 0; general; r++, general >>= 1) {
+            if (general & 1) {
+                putVarint(output, zigzag(values[r] - context.registers[r]));
+                context.registers[r] = values[r];
+            }
+        }
+
+        if (changed >> traceSP & 1) {
+            putVarint(output, zigzag(values[traceSP] - context.registers[traceSP]));
+            context.registers[traceSP] = values[traceSP];
+        }
+
+        if (changed >> traceFLAG & 1) {
+            putVarint(output, values[traceFLAG]);
+            context.registers[traceFLAG] = values[traceFLAG];
+        }
+    }
+
+    for (int write = 0; write < writes; write++) {
+        u32 word = records.at(index++);
+        u16 address = u16(word);
+
+        putVarint(output, zigzag(address - context.writeAddress));
+        putVarint(output, word >> 16);
+        context.writeAddress = address;
+    }
+
+    return index;
+}
+
+TraceReader::TraceReader(const std::string &path)
+    : path(path), file(path, std::ios::binary), buffer(outputBytes)
+{
+    bufferOffset = headerSize;
+    position = 0;
+    size = 0;
+    finished = false;
+    IR = 0;
+    instructions = 0;
+    memset(registers, 0, sizeof(registers));
+    indexed = false;
+
+    char header[headerSize];
+
+    if (!file)
+        throw std::runtime_error("cannot open " + path);
+
+    if (!file.read(header, sizeof(header)) || memcmp(header, magic, sizeof(magic)))
+        throw std::runtime_error(path + " is not a trace");
+
+    u32 version = u8(header[8]) | u8(header[9]) << 8 | u8(header[10]) << 16 | u32(u8(header[11])) << 24;
+    if (version < 1 || version > currentVersion)
+        throw std::runtime_error(path + " is a trace of version " + std::to_string(version));
+
+    // A closed trace ends in the offset of its index
+    u8 trailer[trailerSize];
+    u64 fileSize = file.seekg(0, std::ios::end).tellg();
+
+    if (fileSize >= headerSize + trailerSize && file.seekg(fileSize - trailerSize) &&
+        file.read(reinterpret_cast<char *>(trailer), sizeof(trailer)) &&
+        !memcmp(trailer + 8, indexMagic, sizeof(indexMagic))) {
+        u64 offset = 0;
+        for (int byte = 0; byte < 8; byte++)
+            offset |= u64(trailer[byte]) << 8 * byte;
+
+        readIndex(offset);
+    }
+
+    moveTo(headerSize);
+}
+
+bool TraceReader::next(TraceRecord &record)
+{
+    u8 tag;
+
+    for (;;) {
+        if (finished || (position == size && !fill())) {
+            finished = true;
+            return false;
+        }
+
+        tag = readByte();
+
+        if (!(tag & 0x80))
+            break;
+
+        if (tag == tagKeyframe) {
+            seen.keyframes.push_back({0, 0, bufferOffset + position - 1, seen.requests.size()});
+            readKeyframe(nullptr);
+            seen.keyframes.back().instructions = instructions;
+            seen.keyframes.back().impulseCount = context.impulseCount;
+        }
+        else if (tag == tagRequest) {
+            seen.requests.push_back(readVarint());
+        }
+        else if (tag == tagIndex) {
+            finished = true;
+            return false;
+        }
+        else {
+            throw std::runtime_error("damaged trace record");
+        }
+    }
+
+    record.interrupt = tag & tagInterrupt;
+
+    u16 pc = context.slots[context.PC >> 1].successor;
+    if (tag & tagPC)
+        pc = context.PC + unzigzag(u16(readVarint()));
+
+    TraceContext::Slot &slot = context.slots[pc >> 1];
+
+    if (!record.interrupt) {
+        context.slots[context.PC >> 1].successor = pc;
+
+        if (tag & tagIR)
+            slot.IR = u16(readVarint());
+
+        IR = slot.IR;
+        instructions++;
+    }
+
+    u64 impulses = record.interrupt ? 0 : slot.impulses;
+    if (tag & tagImpulses) {
+        impulses = readVarint();
+
+        if (!record.interrupt)
+            slot.impulses = u32(impulses);
+    }
+
+    context.PC = pc;
+    context.impulseCount += impulses;
+
+    record.PC = pc;
+    record.IR = IR;
+    record.impulseCount = context.impulseCount;
+    record.instructions = instructions;
+    record.changed = 0;
+
+    if (tag & tagRegisters) {
+        u32 encoded = u32(readVarint());
+
+        if (encoded >> traceRegisterCount)
+            throw std::runtime_error("damaged trace record");
+
+        for (int r = 0; r < traceRegisterCount; r++) {
+            if (!(encoded >> r & 1))
+                continue;
+
+            u16 value = u16(readVarint());
+
+            if (r == traceFLAG)
+                context.registers[r] = value;
+            else
+                context.registers[r] += unzigzag(value);
+        }
+    }
+
+    // Records after a keyframe are encoded against registers of 0, what
+    // they changed comes from the state before them
+    for (int r = 0; r < traceRegisterCount; r++) {
+        if (context.registers[r] != registers[r])
+            record.changed |= 1 << r;
+    }
+
+    memcpy(registers, context.registers, sizeof(registers));
+    memcpy(record.registers, context.registers, sizeof(record.registers));
+
+    record.writeCount = tag >> tagWritesShift & 3;
+
+    for (int write = 0; write < record.writeCount; write++) {
+        context.writeAddress += unzigzag(u16(readVarint()));
+
+        record.writes[write].address = context.writeAddress;
+        record.writes[write].value = u16(readVarint());
+    }
+
+    return true;
+}
+
+const TraceIndex &TraceReader::getIndex()
+{
+    if (!indexed) {
+        TraceReader scanner(path);
+        TraceRecord record;
+
+        while (scanner.next(record))
+            ;
+
+        index = scanner.seen;
+        index.instructions = scanner.instructions;
+        index.impulseCount = scanner.context.impulseCount;
+        indexed = true;
+    }
+
+    return index;
+}
+
+std::vector<u8> TraceReader::seek(const TraceKeyframe &keyframe)
+{
+    std::vector<u8> state;
+
+    moveTo(keyframe.offset);
+
+    if (readByte() != tagKeyframe)
+        throw std::runtime_error("damaged trace index");
+
+    readKeyframe(&state);
+
+    return state;
+}
+
+// Reads the index at offset, which ends before the trailer
+void TraceReader::readIndex(u64 offset)
+{
+    moveTo(offset);
+
+    // Every keyframe and request also has a record before the index
+    auto count = [&](u64 recordBytes) {
+        u64 value = readVarint();
+
+        if (value > offset / recordBytes)
+            throw std::runtime_error("damaged trace index");
+
+        return value;
+    };
+
+    if (readByte() != tagIndex)
+        throw std::runtime_error("damaged trace index");
+
+    index.keyframes.resize(count(4));
+
+    for (TraceKeyframe &keyframe : index.keyframes) {
+        keyframe.instructions = readVarint();
+        keyframe.impulseCount = readVarint();
+        keyframe.offset = readVarint();
+        keyframe.requests = readVarint();
+    }
+
+    index.requests.resize(count(2));
+
+    u64 previous = 0;
+    for (u64 &request : index.requests)
+        previous = request = previous + readVarint();
+
+    index.instructions = readVarint();
+    index.impulseCount = readVarint();
+
+    for (const TraceKeyframe &keyframe : index.keyframes) {
+        if (keyframe.offset < headerSize || keyframe.offset >= offset || keyframe.requests > index.requests.size())
+            throw std::runtime_error("damaged trace index");
+    }
+
+    indexed = true;
+}
+
+// Reads a keyframe record after its tag, the records after it are
+// predicted from scratch. The registers of its state are those before
+// the next record
+void TraceReader::readKeyframe(std::vector<u8> *state)
+{
+    u64 keyframeInstructions = readVarint();
+    u64 impulseCount = readVarint();
+    u64 length = readVarint();
+
+    StateFileHeader header;
+    u8 *headerBytes = reinterpret_cast<u8 *>(&header);
+    u64 headerRead = 0;
+
+    if (length < sizeof(header))
+        throw std::runtime_error("damaged keyframe");
+
+    if (state)
+        state->reserve(std::min<u64>(length, 1 << 20));
+
+    while (length) {
+        if (position == size && !fill())
+            throw std::runtime_error("truncated trace record");
+
+        size_t count = std::min<u64>(length, size - position);
+
+        if (state)
+            state->insert(state->end(), buffer.begin() + position, buffer.begin() + position + count);
+
+        if (headerRead < sizeof(header)) {
+            size_t part = std::min<u64>(count, sizeof(header) - headerRead);
+            memcpy(headerBytes + headerRead, buffer.data() + position, part);
+            headerRead += part;
+        }
+
+        position += count;
+        length -= count;
+    }
+
+    context = TraceContext();
+    context.impulseCount = impulseCount;
+    instructions = keyframeInstructions;
+
+    memcpy(registers, header.R, sizeof(header.R));
+    registers[traceSP] = header.SP;
+    registers[traceFLAG] = header.FLAG;
+}
+
+void TraceReader::moveTo(u64 offset)
+{
+    file.clear();
+    file.seekg(offset);
+
+    bufferOffset = offset;
+    position = 0;
+    size = 0;
+    finished = false;
+}
+
+// Reads the next part of the file into buffer, false at its end
+bool TraceReader::fill()
+{
+    bufferOffset += size;
+
+    file.read(reinterpret_cast<char *>(buffer.data()), buffer.size());
+    position = 0;
+    size = file.gcount();
+
+    return size != 0;
+}
+
+u8 TraceReader::readByte()
+{
+    if (position == size && !fill())
+        throw std::runtime_error("truncated trace record");
+
+    return buffer[position++];
+}
+
+u64 TraceReader::readVarint()
+{
+    u64 value = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        u8 byte = readByte();
+        value |= u64(byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+            return value;
+    }
+
+    throw std::runtime_error("damaged trace record");
+}
@@ -0,0 +1,331 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "assembler/defs.h"
+#include <cpu/spscring.h>
+
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//// Instruction trace files, as written by TraceWriter. After a 16 byte
+//// header, "XASMTRAC", the u32 version and a reserved u32, little endian,
+//// comes one record per completed instruction or interrupt entry:
+////
+////   tag        bit 0 interrupt entry, bits 1-4 whether PC, IR,
+////              impulses and registers follow, bits 5-6 the number of
+////              memory writes, bit 7 is clear
+////   PC         zigzag varint of the difference to the previous PC,
+////              left out when it is the PC that followed the previous one
+////              the last time
+////   IR         varint, left out when it is the IR last seen at PC
+////   impulses   varint of the impulses since the previous record, left
+////              out when it is the count last seen at PC
+////   registers  varint mask of TraceRegister bits, then per bit the
+////              zigzag varint of the change of R or SP or the varint of
+////              FLAG
+////   writes     per write the zigzag varint of the difference to the
+////              previous address written and the varint of the word
+////
+//// Varints hold 7 bits per byte, low bits first. Interrupt entries always
+//// carry PC, their return address, and impulses, never IR. Registers
+//// start out as 0, so the first record holds every one that is not
+////
+//// Tags with bit 7 set start the records of version 2:
+////
+////   0x80       keyframe: varints of the instructions recorded before it,
+////              of the impulse count and of the length of the machine
+////              state that follows, in the state file format. The records
+////              after it are predicted as if the trace started there
+////   0x81       interrupt request: varint of its impulse count
+////   0x82       index, which ends the records: varint of the number of
+////              keyframes, per keyframe the varints of TraceKeyframe,
+////              varint of the number of requests, per request the varint
+////              of the difference to the one before it, then the varints
+////              of the instructions and of the impulse count at the end
+////
+//// A closed trace ends in 16 bytes, the u64 offset of the index and
+//// "XASMINDX". The trace of a run that did not close it has no index, it
+//// is rebuilt from the keyframe and request records
+
+//// Bits of the registers mask, R0 to R15 are bits 0 to 15
+enum TraceRegister {
+    traceSP = 16,
+    traceFLAG = 17,
+    traceRegisterCount = 18
+};
+
+//// Words stored by one instruction, two for an interrupt entry
+static const int maxTraceWrites = 3;
+
+struct TraceWrite
+{
+    u16 address;
+    u16 value;
+};
+
+//// One record of a trace with the registers as they are after it
+struct TraceRecord
+{
+    bool interrupt;
+    u16 PC;           // of the instruction, or the return address
+    u16 IR;           // of the last instruction for interrupt entries
+    u64 impulseCount; // after the record
+    u64 instructions; // recorded since the trace started, this one included
+    u32 changed;      // TraceRegister bits of the registers it changed
+    u16 registers[traceRegisterCount];
+    int writeCount;
+    TraceWrite writes[maxTraceWrites];
+};
+
+//// Where a trace can be entered
+struct TraceKeyframe
+{
+    u64 instructions; // recorded before it
+    u64 impulseCount;
+    u64 offset;       // of its record in the file
+    u64 requests;     // interrupt requests before it
+};
+
+//// Seek table of a trace
+struct TraceIndex
+{
+    std::vector<TraceKeyframe> keyframes;
+
+    // Impulse counts of the interrupt requests, in order
+    std::vector<u64> requests;
+
+    // At the end of the trace
+    u64 instructions;
+    u64 impulseCount;
+};
+
+//// What encoder and decoder predict the next record from
+struct TraceContext
+{
+    TraceContext();
+
+    u16 PC;
+    u16 writeAddress;
+    u64 impulseCount;
+    u16 registers[traceRegisterCount];
+
+    // Per word address of PC, what came last at it
+    struct Slot
+    {
+        u16 successor;
+        u16 IR;
+        u32 impulses;
+    };
+
+    std::vector<Slot> slots;
+};
+
+//// Streams a trace into a file. record() and write() are called by the
+//// thread that executes, a thread of the writer encodes the records they
+//// queue in a lock-free ring and writes them. When the ring is full the
+//// executing thread waits, so nothing is dropped
+class TraceWriter
+{
+public:
+    static const int anyRegister = -1;
+    static const u64 defaultKeyframeInterval = 1 << 20;
+
+    //// Asks for a keyframe every keyframeInterval instructions. Throws
+    //// std::runtime_error if path cannot be written
+    explicit TraceWriter(const std::string &path, u64 keyframeInterval = defaultKeyframeInterval);
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    //// A word stored by the instruction that record() ends next
+    void write(u16 address, u16 value)
+    {
+        if (writeCount < maxTraceWrites)
+            writes[writeCount++] = {address, value};
+    }
+
+    //// Ends the instruction at pc or the interrupt entry returning to pc,
+    //// with the registers and impulse count after it. written is the one
+    //// general register it may have changed, if known, which spares
+    //// queueing all of them
+    void record(bool interrupt, u16 pc, u16 ir, u64 impulseCount, const u16 *R, u16 SP, u16 FLAG,
+                int written = anyRegister);
+
+    //// Whether the next keyframe is due, and how many instructions may be
+    //// recorded until it is
+    bool keyframeDue() const { return recordedInstructions >= nextKeyframe; }
+    u64 instructionsToKeyframe() const
+    {
+        return keyframeDue() ? 0 : nextKeyframe - recordedInstructions;
+    }
+
+    //// The machine state as of impulseCount, after the records so far,
+    //// in the state file format. The first keyframe is where the trace
+    //// starts
+    void keyframe(std::vector<u8> state, u64 impulseCount);
+
+    //// An interrupt request at impulseCount
+    void request(u64 impulseCount);
+
+    //// Waits until everything recorded is written and closes the file.
+    //// Throws std::runtime_error if writing failed
+    void close();
+
+private:
+    // Records in the ring: pc | ir << 16, SP | FLAG << 16 and the impulse
+    // count in two words, then a word of value | written << 16 for the
+    // register written, or of allRegisters followed by R0 to R15 two to a
+    // word, which also holds interrupt << 21 and the writes << 22, and
+    // address | value << 16 per write. The writer thread finds what
+    // changed. Keyframes and requests are the impulse count after two
+    // unused words and a word of their marker, the states of keyframes
+    // wait in states
+    static const u32 allRegisters = 1 << 20;
+    static const u32 keyframeMarker = 1 << 24;
+    static const u32 requestMarker = 1 << 25;
+    static const size_t maxRecordWords = 5 + 8 + maxTraceWrites;
+    static const size_t ringWords = 1 << 20;
+
+    void run();
+    size_t encode(size_t index, u8 *&output);
+    void mark(u32 marker, u64 impulseCount);
+    void flush(u8 *&output);
+    void writeIndex(u8 *&output);
+
+    SpscRing<u32> ring;
+    std::string path;
+
+    std::mutex statesLock;
+    std::deque<std::vector<u8>> states;
+
+    // Executing thread
+    TraceWrite writes[maxTraceWrites];
+    int writeCount;
+    u64 keyframeInterval;
+    u64 recordedInstructions;
+    u64 nextKeyframe;
+    bool keyframed; // the next record holds all registers, which are
+                    // predicted from scratch after a keyframe
+
+    // Writer thread
+    TraceContext context;
+    TraceIndex positions;
+    std::ofstream file;
+    std::vector<u8> buffer;
+    u64 written; // bytes handed to file
+    bool failed;
+
+    std::atomic<bool> closing;
+    std::thread thread;
+};
+
+//// Reads the records of a trace file in order, from the start or from a
+//// keyframe on
+class TraceReader
+{
+public:
+    //// Throws std::runtime_error if path is not a trace of a version
+    //// this build reads, or if its index is damaged
+    explicit TraceReader(const std::string &path);
+
+    //// False at the end of the trace. Throws std::runtime_error on a
+    //// truncated or damaged record
+    bool next(TraceRecord &record);
+
+    //// The keyframes and requests of the trace. Reads through all of it
+    //// first if it has no index. Throws std::runtime_error like next()
+    const TraceIndex &getIndex();
+
+    //// Goes on reading after keyframe, whose machine state it returns.
+    //// Throws std::runtime_error like next()
+    std::vector<u8> seek(const TraceKeyframe &keyframe);
+
+private:
+    u8 readByte();
+    u64 readVarint();
+    void readIndex(u64 offset);
+    void readKeyframe(std::vector<u8> *state);
+    void moveTo(u64 offset);
+    bool fill();
+
+    std::string path;
+    std::ifstream file;
+    std::vector<u8> buffer;
+    u64 bufferOffset; // in the file
+    size_t position;
+    size_t size;
+    bool finished;
+
+    TraceContext context;
+    u16 IR;
+    u64 instructions;
+    u16 registers[traceRegisterCount]; // before the next record
+
+    TraceIndex index;
+    bool indexed;
+
+    // Keyframes and requests read by next() so far
+    TraceIndex seen;
+};
+
+inline void TraceWriter::record(bool interrupt, u16 pc, u16 ir, u64 impulseCount, const u16 *R, u16 SP,
+                                u16 FLAG, int written)
+{
+    ring.reserve(maxRecordWords);
+
+    size_t index = ring.producerIndex();
+    u32 info = u32(writeCount) << 22 | u32(interrupt) << 21;
+
+    if (!interrupt)
+        recordedInstructions++;
+
+    ring.at(index++) = pc | u32(ir) << 16;
+    ring.at(index++) = SP | u32(FLAG) << 16;
+    ring.at(index++) = u32(impulseCount);
+    ring.at(index++) = u32(impulseCount >> 32);
+
+    if (written != anyRegister && !keyframed) {
+        ring.at(index++) = R[written] | u32(written) << 16 | info;
+    }
+    else {
+        ring.at(index++) = info | allRegisters;
+
+        for (int r = 0; r < 16; r += 2)
+            ring.at(index++) = R[r] | u32(R[r + 1]) << 16;
+    }
+
+    for (int write = 0; write < writeCount; write++)
+        ring.at(index++) = writes[write].address | u32(writes[write].value) << 16;
+
+    writeCount = 0;
+    keyframed = false;
+    ring.commit(index);
+}
+
+inline void TraceWriter::request(u64 impulseCount)
+{
+    mark(requestMarker, impulseCount);
+}
+
+inline void TraceWriter::mark(u32 marker, u64 impulseCount)
+{
+    ring.reserve(maxRecordWords);
+
+    size_t index = ring.producerIndex();
+
+    ring.at(index++) = 0;
+    ring.at(index++) = 0;
+    ring.at(index++) = u32(impulseCount);
+    ring.at(index++) = u32(impulseCount >> 32);
+    ring.at(index++) = marker;
+
+    ring.commit(index);
+}
+
+#endif // TRACE_H
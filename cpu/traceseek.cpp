@@ -0,0 +1,84 @@
+#include "traceseek.h"
+
+#include <cpu/cpucore.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// Impulse count after instruction position, read from the records
+// between the keyframe before it and it
+u64 instructionImpulse(TraceReader &reader, const TraceIndex &index, u64 position)
+{
+    const std::vector<TraceKeyframe> &keyframes = index.keyframes;
+
+    if (!position)
+        return keyframes.front().impulseCount;
+
+    auto keyframe = std::lower_bound(keyframes.begin(), keyframes.end(), position,
+                                     [](const TraceKeyframe &keyframe, u64 position) {
+        return keyframe.instructions < position;
+    }) - 1;
+
+    reader.seek(*keyframe);
+
+    TraceRecord record;
+
+    do {
+        if (!reader.next(record))
+            throw std::runtime_error("the trace ends before its index does");
+    } while (record.interrupt || record.instructions < position);
+
+    return record.impulseCount;
+}
+
+}
+
+std::vector<u8> seekTrace(TraceReader &reader, TracePosition unit, u64 position)
+{
+    const TraceIndex &index = reader.getIndex();
+    const std::vector<TraceKeyframe> &keyframes = index.keyframes;
+
+    if (keyframes.empty())
+        throw std::runtime_error("the trace has no keyframes");
+
+    u64 impulse = position;
+
+    if (unit == TracePosition::instruction) {
+        if (position > index.instructions)
+            throw std::runtime_error("the trace ends after instruction " + std::to_string(index.instructions));
+
+        impulse = instructionImpulse(reader, index, position);
+    }
+    else if (position < keyframes.front().impulseCount || position > index.impulseCount) {
+        throw std::runtime_error("the trace covers impulses " + std::to_string(keyframes.front().impulseCount) +
+                                 " to " + std::to_string(index.impulseCount));
+    }
+
+    // The latest keyframe before impulse, or at it and ahead of the
+    // requests that arrive at it. The first one always is
+    size_t nearest = std::upper_bound(keyframes.begin(), keyframes.end(), impulse,
+                                      [](u64 impulse, const TraceKeyframe &keyframe) {
+        return impulse < keyframe.impulseCount;
+    }) - keyframes.begin() - 1;
+
+    while (nearest && keyframes[nearest].impulseCount == impulse && keyframes[nearest].requests &&
+           index.requests[keyframes[nearest].requests - 1] == impulse)
+        nearest--;
+
+    const TraceKeyframe &keyframe = keyframes[nearest];
+    std::vector<u8> state = reader.seek(keyframe);
+
+    CpuCore<NullCpuObserver> core;
+
+    if (!core.restoreState(state.data(), state.size()))
+        throw std::runtime_error("damaged keyframe");
+
+    core.setJitMode(JitMode::on);
+    core.replayInterrupts(std::vector<u64>(index.requests.begin() + keyframe.requests, index.requests.end()));
+    core.runTo(impulse);
+
+    return core.saveState();
+}
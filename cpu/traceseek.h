@@ -0,0 +1,24 @@
+#ifndef TRACESEEK_H
+#define TRACESEEK_H
+
+#include "assembler/defs.h"
+#include <cpu/trace.h>
+
+#include <vector>
+
+//// What a position in a trace counts
+enum class TracePosition {
+    instruction, // instructions recorded since the trace started
+    impulse      // the impulse count of the core
+};
+
+//// Machine state at position of the trace that reader reads, in the
+//// state file format of statefile.h. Restores the nearest keyframe before
+//// it and runs forward, replaying the interrupt requests of the trace.
+//// The state after instruction N is the one before the interrupt entry
+//// that may follow it, the state at an impulse count the one before the
+//// requests that arrive at it. Throws std::runtime_error if the trace has
+//// no keyframes or does not reach position
+std::vector<u8> seekTrace(TraceReader &reader, TracePosition unit, u64 position);
+
+#endif // TRACESEEK_H
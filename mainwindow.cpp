@@ -3,10 +3,19 @@
 
 #include <editor/codeeditor.h>
 #include <QToolBar>
+#include <QActionGroup>
 #include <QProcess>
 #include <QMessageBox>
+#include <QStatusBar>
+#include <QFileDialog>
+#include <QInputDialog>
+
+#include <fstream>
+#include <stdexcept>
 
 #include <cpu/cpu.h>
+#include <cpu/interruptlog.h>
+#include <cpu/traceseek.h>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -16,11 +25,16 @@ MainWindow::MainWindow(QWidget *parent)
 
     memoryViewerDialog = new MemoryViewerDialog(this);
 
+    frameRate = 30;
+    historySize = 64;
     createActions();
     cpuWindow = new CPUwindow(this);
     cpu = new Cpu(this);
+    cpu->setFrameRate(frameRate);
+    cpu->setHistorySize(historySize);
     cpuWindow->setCpu(cpu);
     memoryViewerDialog->setCpu(cpu);
+    connectCpu();
 }
 
 MainWindow::~MainWindow()
@@ -81,7 +95,6 @@ void MainWindow::createActions() {
 
     connect(viewMemoryAction, &QAction::triggered, this->memoryViewerDialog,
             [this]() {
-        memoryViewerDialog->setMemoryViewerData({reinterpret_cast<char*>(cpu->getMemory().data()), (int)cpu->getMemory().size()});
         memoryViewerDialog->show();
     });
 
@@ -89,6 +102,24 @@ void MainWindow::createActions() {
     viewMenu->addAction(viewMemoryAction);
     viewToolBar->addAction(viewMemoryAction);
 
+    // Refresh rate actions
+    QMenu *refreshRateMenu = viewMenu->addMenu(tr("&Refresh Rate"));
+    QActionGroup *refreshRateGroup = new QActionGroup(this);
+
+    for (int rate : {30, 60}) {
+        QAction *refreshRateAction = new QAction(tr("%1 Hz").arg(rate), refreshRateGroup);
+        refreshRateAction->setCheckable(true);
+        refreshRateAction->setChecked(rate == frameRate);
+        refreshRateAction->setStatusTip(tr("Update the views %1 times per second while running").arg(rate));
+
+        connect(refreshRateAction, &QAction::triggered, this, [=]() {
+            frameRate = rate;
+            cpu->setFrameRate(frameRate);
+        });
+
+        refreshRateMenu->addAction(refreshRateAction);
+    }
+
     // Assemble action
     QAction *assembleAction = new QAction(tr("&Assemble"), this);
     assembleAction->setIcon(QPixmap(":/rec/resources/icons/assembler.svg"));
@@ -110,16 +141,18 @@ void MainWindow::createActions() {
         QMessageBox messageBox;
         if (output.endsWith("generated successfully\n")) {
             //reinitialize cpu if reassembled
-            delete cpu;
-            cpu = new Cpu(this);
-            cpuWindow->setCpu(cpu);
-            memoryViewerDialog->setCpu(cpu);
+            resetCpu();
 
             messageBox.information(this, "Success", "Assembled successfully!\nNow you can start the simulation.");
 
-            stepAction->setEnabled(true);
-            runAction->setEnabled(true);
+            updateActions(CpuStatus::paused);
             interruptAction->setEnabled(true);
+            saveInterruptsAction->setEnabled(true);
+            replayInterruptsAction->setEnabled(true);
+            breakpointAction->setEnabled(true);
+            clearBreakpointsAction->setEnabled(true);
+            watchpointAction->setEnabled(true);
+            clearWatchpointsAction->setEnabled(true);
             viewMemoryAction->setEnabled(true);
 
             QFile machineCodeFile {"output.out"};
@@ -147,18 +180,44 @@ void MainWindow::createActions() {
     stepAction->setStatusTip(tr("Execute one impulse"));
 
     connect(stepAction, &QAction::triggered, this, [=]() {
-        if(!cpu->advance()) {
-            QMessageBox messageBox;
-            messageBox.information(this, "Processor halted", cpu->getReason());
-            stepAction->setEnabled(false);
-            runAction->setEnabled(false);
-        }
+        cpu->step();
     });
 
     stepAction->setEnabled(false);
     executeMenu->addAction(stepAction);
     executeToolBar->addAction(stepAction);
 
+    // Step back action
+    stepBackAction = new QAction(tr("Step &Back"), this);
+    stepBackAction->setShortcut(QKeySequence(tr("Shift+F7")));
+    stepBackAction->setStatusTip(tr("Go back one impulse"));
+
+    connect(stepBackAction, &QAction::triggered, this, [=]() {
+        cpu->stepBack();
+    });
+
+    stepBackAction->setEnabled(false);
+    executeMenu->addAction(stepBackAction);
+
+    // History size actions
+    QMenu *historySizeMenu = executeMenu->addMenu(tr("Step Back &History"));
+    QActionGroup *historySizeGroup = new QActionGroup(this);
+
+    for (int size : {0, 16, 64, 256}) {
+        QAction *historySizeAction = new QAction(size ? tr("%1 MB").arg(size) : tr("Off"), historySizeGroup);
+        historySizeAction->setCheckable(true);
+        historySizeAction->setChecked(size == historySize);
+        historySizeAction->setStatusTip(size ? tr("Keep up to %1 MB of checkpoints to step back to").arg(size)
+                                             : tr("Do not keep checkpoints to step back to"));
+
+        connect(historySizeAction, &QAction::triggered, this, [=]() {
+            historySize = size;
+            cpu->setHistorySize(historySize);
+        });
+
+        historySizeMenu->addAction(historySizeAction);
+    }
+
     // Run action
     runAction = new QAction(tr("&Run"), this);
     runAction->setIcon(QPixmap(":/rec/resources/icons/run.svg"));
@@ -166,18 +225,52 @@ void MainWindow::createActions() {
     runAction->setStatusTip(tr("Run the simulation"));
 
     connect(runAction, &QAction::triggered, this, [=]() {
-        while(cpu->advance());
-
-        QMessageBox messageBox;
-        messageBox.information(this, "Processor halted", cpu->getReason());
-        stepAction->setEnabled(false);
-        runAction->setEnabled(false);
+        cpu->run();
     });
 
     runAction->setEnabled(false);
     executeMenu->addAction(runAction);
     executeToolBar->addAction(runAction);
 
+    // Pause action
+    pauseAction = new QAction(tr("&Pause"), this);
+    pauseAction->setIcon(QPixmap(":/rec/resources/icons/pause.svg"));
+    pauseAction->setShortcut(QKeySequence(tr("F9")));
+    pauseAction->setStatusTip(tr("Pause the simulation"));
+
+    connect(pauseAction, &QAction::triggered, this, [=]() {
+        cpu->pause();
+    });
+
+    pauseAction->setEnabled(false);
+    executeMenu->addAction(pauseAction);
+    executeToolBar->addAction(pauseAction);
+
+    // Stop action
+    stopAction = new QAction(tr("St&op"), this);
+    stopAction->setIcon(QPixmap(":/rec/resources/icons/stop.svg"));
+    stopAction->setShortcut(QKeySequence(tr("Shift+F8")));
+    stopAction->setStatusTip(tr("End the simulation"));
+
+    connect(stopAction, &QAction::triggered, this, [=]() {
+        cpu->stop();
+    });
+
+    stopAction->setEnabled(false);
+    executeMenu->addAction(stopAction);
+    executeToolBar->addAction(stopAction);
+
+    // JIT action
+    jitAction = new QAction(tr("&JIT"), this);
+    jitAction->setCheckable(true);
+    jitAction->setStatusTip(tr("Run translated native code instead of interpreting"));
+
+    connect(jitAction, &QAction::toggled, this, [=](bool checked) {
+        cpu->setJitMode(checked ? JitMode::on : JitMode::off);
+    });
+
+    executeMenu->addAction(jitAction);
+
     // Interrupt action
     interruptAction = new QAction(tr("Trigger &IRQ"), this);
     interruptAction->setIcon(QPixmap(":/rec/resources/icons/interrupt.svg"));
@@ -191,4 +284,269 @@ void MainWindow::createActions() {
     interruptAction->setEnabled(false);
     executeMenu->addAction(interruptAction);
     executeToolBar->addAction(interruptAction);
+
+    // Save interrupt log action
+    saveInterruptsAction = new QAction(tr("&Save Interrupt Log..."), this);
+    saveInterruptsAction->setStatusTip(tr("Save the impulse counts at which interrupts were requested"));
+
+    connect(saveInterruptsAction, &QAction::triggered, this, [=]() {
+        QString fileName = QFileDialog::getSaveFileName(this, tr("Save Interrupt Log"));
+        if (fileName.isEmpty())
+            return;
+
+        std::ofstream file(fileName.toStdString());
+        writeInterruptLog(file, cpu->getInterruptLog());
+
+        if (!file)
+            QMessageBox::critical(this, "Interrupt Log", tr("Cannot write %1").arg(fileName));
+    });
+
+    saveInterruptsAction->setEnabled(false);
+    executeMenu->addAction(saveInterruptsAction);
+
+    // Replay interrupt log action
+    replayInterruptsAction = new QAction(tr("Re&play Interrupt Log..."), this);
+    replayInterruptsAction->setStatusTip(tr("Request interrupts at the impulse counts of a saved log"));
+
+    connect(replayInterruptsAction, &QAction::triggered, this, [=]() {
+        QString fileName = QFileDialog::getOpenFileName(this, tr("Replay Interrupt Log"));
+        if (fileName.isEmpty())
+            return;
+
+        std::ifstream file(fileName.toStdString());
+        if (!file) {
+            QMessageBox::critical(this, "Interrupt Log", tr("Cannot open %1").arg(fileName));
+            return;
+        }
+
+        try {
+            std::vector<u64> impulses = readInterruptLog(file);
+            cpu->replayInterrupts(impulses);
+            statusBar()->showMessage(tr("Replaying %1 interrupts").arg(impulses.size()));
+        } catch (std::runtime_error &e) {
+            QMessageBox::critical(this, "Interrupt Log", QString::fromStdString(e.what()));
+        }
+    });
+
+    replayInterruptsAction->setEnabled(false);
+    executeMenu->addAction(replayInterruptsAction);
+
+    // Breakpoint actions
+    breakpointAction = new QAction(tr("Add &Breakpoint..."), this);
+    breakpointAction->setShortcut(QKeySequence(tr("Ctrl+B")));
+    breakpointAction->setStatusTip(tr("Pause running before the instruction at an address"));
+
+    connect(breakpointAction, &QAction::triggered, this, [=]() {
+        bool accepted = false;
+        QString text = QInputDialog::getText(this, tr("Add Breakpoint"),
+                                             tr("Address, optionally followed by : and a condition "
+                                                "like R3 == 0 && FLAG.Z:"),
+                                             QLineEdit::Normal, "", &accepted);
+        if (!accepted)
+            return;
+
+        int colon = text.indexOf(':');
+        QString location = text.left(colon).trimmed();
+        QString condition = colon < 0 ? QString() : text.mid(colon + 1);
+
+        bool valid = false;
+        uint address = location.toUInt(&valid, 0);
+
+        if (!valid || address > 0xffff) {
+            QMessageBox::critical(this, "Breakpoint", tr("%1 is not an address").arg(location));
+            return;
+        }
+
+        try {
+            cpu->setBreakpoint(address, condition);
+            statusBar()->showMessage(tr("Breakpoint at 0x%1").arg(address, 4, 16, QChar('0')));
+        } catch (std::invalid_argument &e) {
+            QMessageBox::critical(this, "Breakpoint", QString::fromStdString(e.what()));
+        }
+    });
+
+    breakpointAction->setEnabled(false);
+    executeMenu->addAction(breakpointAction);
+
+    clearBreakpointsAction = new QAction(tr("&Clear Breakpoints"), this);
+    clearBreakpointsAction->setStatusTip(tr("Remove every breakpoint"));
+
+    connect(clearBreakpointsAction, &QAction::triggered, this, [=]() {
+        cpu->clearBreakpoints();
+    });
+
+    clearBreakpointsAction->setEnabled(false);
+    executeMenu->addAction(clearBreakpointsAction);
+
+    // Watchpoint actions
+    watchpointAction = new QAction(tr("Add &Watchpoint..."), this);
+    watchpointAction->setShortcut(QKeySequence(tr("Ctrl+Shift+B")));
+    watchpointAction->setStatusTip(tr("Pause running after the instruction that accesses a range of memory"));
+
+    connect(watchpointAction, &QAction::triggered, this, [=]() {
+        bool accepted = false;
+        QString text = QInputDialog::getText(this, tr("Add Watchpoint"),
+                                             tr("Address:length of the bytes whose writes pause, optionally "
+                                                "followed by :r for reads or :rw for both:"),
+                                             QLineEdit::Normal, "", &accepted);
+        if (!accepted)
+            return;
+
+        QStringList parts = text.split(':');
+        bool validAddress = false;
+        bool validLength = false;
+        uint address = parts[0].trimmed().toUInt(&validAddress, 0);
+        uint length = parts.size() > 1 ? parts[1].trimmed().toUInt(&validLength, 0) : 0;
+        QString accessText = parts.size() > 2 ? parts[2].trimmed() : "w";
+        u8 access = accessText == "r" ? watchRead : accessText == "w" ? watchWrite
+                  : accessText == "rw" ? watchRead | watchWrite : 0;
+
+        if (!validAddress || !validLength || parts.size() > 3 || !length || address + length > 0x10000) {
+            QMessageBox::critical(this, "Watchpoint", tr("%1 is not a range of memory").arg(text));
+            return;
+        }
+
+        if (!access) {
+            QMessageBox::critical(this, "Watchpoint", tr("Expected r, w or rw, found %1").arg(accessText));
+            return;
+        }
+
+        cpu->setWatchpoint(address, length, access);
+        statusBar()->showMessage(tr("Watchpoint on 0x%1 to 0x%2")
+                                 .arg(address, 4, 16, QChar('0'))
+                                 .arg(address + length - 1, 4, 16, QChar('0')));
+    });
+
+    watchpointAction->setEnabled(false);
+    executeMenu->addAction(watchpointAction);
+
+    clearWatchpointsAction = new QAction(tr("C&lear Watchpoints"), this);
+    clearWatchpointsAction->setStatusTip(tr("Remove every watchpoint"));
+
+    connect(clearWatchpointsAction, &QAction::triggered, this, [=]() {
+        cpu->clearWatchpoints();
+    });
+
+    clearWatchpointsAction->setEnabled(false);
+    executeMenu->addAction(clearWatchpointsAction);
+
+    // Open trace action
+    QAction *openTraceAction = new QAction(tr("Open &Trace..."), this);
+    openTraceAction->setStatusTip(tr("Continue from a position of a trace written by xasm-run"));
+
+    connect(openTraceAction, &QAction::triggered, this, [=]() {
+        QString fileName = QFileDialog::getOpenFileName(this, tr("Open Trace"));
+        if (fileName.isEmpty())
+            return;
+
+        bool accepted = false;
+        QString text = QInputDialog::getText(this, tr("Open Trace"),
+                                             tr("Instruction number, or impulse count followed by i:"),
+                                             QLineEdit::Normal, "0", &accepted).trimmed();
+        if (!accepted)
+            return;
+
+        TracePosition unit = text.endsWith('i') ? TracePosition::impulse : TracePosition::instruction;
+        if (unit == TracePosition::impulse)
+            text.chop(1);
+
+        bool valid = false;
+        u64 position = text.toULongLong(&valid, 0);
+
+        if (!valid) {
+            QMessageBox::critical(this, "Trace", tr("%1 is not a position").arg(text));
+            return;
+        }
+
+        std::vector<u8> state;
+
+        QApplication::setOverrideCursor(Qt::WaitCursor);
+
+        try {
+            TraceReader reader(fileName.toStdString());
+            state = seekTrace(reader, unit, position);
+        } catch (std::runtime_error &e) {
+            QApplication::restoreOverrideCursor();
+            QMessageBox::critical(this, "Trace", QString::fromStdString(e.what()));
+            return;
+        }
+
+        QApplication::restoreOverrideCursor();
+
+        resetCpu();
+        cpu->restoreState(state);
+
+        updateActions(CpuStatus::paused);
+        interruptAction->setEnabled(true);
+        saveInterruptsAction->setEnabled(true);
+        replayInterruptsAction->setEnabled(true);
+        breakpointAction->setEnabled(true);
+        clearBreakpointsAction->setEnabled(true);
+        watchpointAction->setEnabled(true);
+        clearWatchpointsAction->setEnabled(true);
+        viewMemoryAction->setEnabled(true);
+    });
+
+    fileMenu->insertAction(quitAction, openTraceAction);
+}
+
+// A new Cpu with the settings of the previous one
+void MainWindow::resetCpu()
+{
+    delete cpu;
+    cpu = new Cpu(this);
+    cpu->setJitMode(jitAction->isChecked() ? JitMode::on : JitMode::off);
+    cpu->setFrameRate(frameRate);
+    cpu->setHistorySize(historySize);
+    cpuWindow->setCpu(cpu);
+    memoryViewerDialog->setCpu(cpu);
+    connectCpu();
+}
+
+void MainWindow::connectCpu()
+{
+    // Commands return at once, their outcome arrives here
+    connect(cpu, &Cpu::statusChanged, this, [=](CpuStatus status) {
+        updateActions(status);
+
+        switch (status) {
+        case CpuStatus::running:
+            statusBar()->showMessage(tr("Running"));
+            return;
+        case CpuStatus::waiting:
+            statusBar()->showMessage(tr("Processor is waiting for an interrupt"));
+            return;
+        default:
+            break;
+        }
+
+        JitStatistics statistics = cpu->getJitStatistics();
+        if(statistics.instructions)
+            statusBar()->showMessage(tr("%1% of instructions ran in superblocks")
+                                     .arg(100 * statistics.superblockInstructions / statistics.instructions));
+        else
+            statusBar()->clearMessage();
+
+        if (status == CpuStatus::paused && cpu->atBreakpoint())
+            statusBar()->showMessage(tr("Paused at a breakpoint"));
+
+        if (status == CpuStatus::paused && !cpu->getWatchpoint().isEmpty())
+            statusBar()->showMessage(tr("Paused at a watchpoint, %1").arg(cpu->getWatchpoint()));
+
+        if(status == CpuStatus::halted) {
+            QMessageBox messageBox;
+            messageBox.information(this, "Processor halted", cpu->getReason());
+        }
+    });
+}
+
+void MainWindow::updateActions(CpuStatus status)
+{
+    bool running = status == CpuStatus::running || status == CpuStatus::waiting;
+
+    stepAction->setEnabled(status == CpuStatus::paused);
+    stepBackAction->setEnabled(status == CpuStatus::paused || status == CpuStatus::halted);
+    runAction->setEnabled(status == CpuStatus::paused);
+    pauseAction->setEnabled(running);
+    stopAction->setEnabled(status != CpuStatus::halted);
 }
@@ -21,13 +21,32 @@ public:
 
 private:
     void createActions();
+    void resetCpu();
+    void connectCpu();
+    void updateActions(CpuStatus status);
 
     Ui::MainWindow *ui;
     MemoryViewerDialog *memoryViewerDialog;
     CPUwindow *cpuWindow;
     QAction *stepAction;
+    QAction *stepBackAction;
     QAction *runAction;
+    QAction *pauseAction;
+    QAction *stopAction;
     QAction *interruptAction;
+    QAction *saveInterruptsAction;
+    QAction *replayInterruptsAction;
+    QAction *breakpointAction;
+    QAction *clearBreakpointsAction;
+    QAction *watchpointAction;
+    QAction *clearWatchpointsAction;
+    QAction *jitAction;
+
+    // Frames per second of the views while running
+    int frameRate;
+
+    // Memory kept for stepping back
+    int historySize;
 
     Cpu *cpu;
 };
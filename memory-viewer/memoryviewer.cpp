@@ -78,6 +78,11 @@ bool MemoryViewer::setData(QIODevice &device) {
     return ok;
 }
 
+void MemoryViewer::dataChanged(qint64 pos, qint64 count) {
+    if (pos < startPos + dataVisible.size() && pos + count > startPos)
+        adjustContent();
+}
+
 void MemoryViewer::resizeEvent(QResizeEvent *) {
     adjustContent();
 }
@@ -13,6 +13,9 @@ public:
   void setData(const QByteArray &ba);
   bool setData(QIODevice &device);
 
+  // Refreshes the view if the changed bytes are visible
+  void dataChanged(qint64 pos, qint64 count);
+
 protected:
   void paintEvent(QPaintEvent *);
   void resizeEvent(QResizeEvent *);
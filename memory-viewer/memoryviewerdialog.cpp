@@ -28,7 +28,13 @@ void MemoryViewerDialog::setMemoryViewerData (const QByteArray &ba) {
 
 void MemoryViewerDialog::connectBackend()
 {
-    connect(this->cpu, &Cpu::PmMem, this, [&](std::vector<u8> mem) {
-        this->setMemoryViewerData({reinterpret_cast<char*>(mem.data()), (int)mem.size()});
+    // The viewer reads the memory of the cpu in place and only refreshes
+    // when a written range is visible
+    const std::vector<u8> &memory = cpu->getMemoryView();
+    setMemoryViewerData(QByteArray::fromRawData(reinterpret_cast<const char*>(memory.data()), (int)memory.size()));
+
+    connect(this->cpu, &Cpu::PmMem, this, [this](const std::vector<MemoryRange> &ranges) {
+        for (const MemoryRange &range : ranges)
+            memoryViewer->dataChanged(range.address, range.length);
     });
 }
@@ -0,0 +1,68 @@
+// Nesting of breakpoint conditions up to and past the limit
+
+#include "tests.h"
+
+#include <cpu/breakpoint.h>
+
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// Condition nested depth times by open, around 1, closed by close
+std::string nested(size_t depth, const std::string &open, const std::string &close)
+{
+    std::string text;
+
+    for (size_t level = 0; level < depth; level++)
+        text += open;
+
+    text += "1";
+
+    for (size_t level = 0; level < depth; level++)
+        text += close;
+
+    return text;
+}
+
+// Whether the condition compiles
+bool compiles(const std::string &text)
+{
+    try {
+        BreakpointCondition condition(text);
+    } catch (std::invalid_argument &) {
+        return false;
+    }
+
+    return true;
+}
+
+}
+
+bool checkConditionNesting()
+{
+    const struct
+    {
+        const char *open;
+        const char *close;
+    } kinds[] = {{"(", ")"}, {"[", "]"}, {"!", ""}, {"-", ""}, {"~(", ")"}};
+
+    const size_t limit = BreakpointCondition::maxNesting;
+
+    for (const auto &kind : kinds) {
+        if (!compiles(nested(limit / 2, kind.open, kind.close))) {
+            std::cerr << "nesting " << kind.open << " " << limit / 2 << " deep is refused" << std::endl;
+            return false;
+        }
+
+        // Deep enough to overflow the stack of the compiler without a limit
+        for (size_t depth : {limit + 1, (size_t)1000000}) {
+            if (compiles(nested(depth, kind.open, kind.close))) {
+                std::cerr << "nesting " << kind.open << " " << depth << " deep is accepted" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,328 @@
+// The deferred C, Z, S and V of add, sub, cmp, inc and dec against the
+// eager bitwise ALU they replaced
+
+#include "tests.h"
+
+#include <cpu/cpucore.h>
+
+#include <iostream>
+#include <random>
+
+namespace {
+
+// The EX impulse of add, sub, cmp, inc and dec as it set FLAG before the
+// flags were deferred, checkV's increment of SBUS included
+struct EagerAlu
+{
+    u16 FLAG;
+    u16 SBUS;
+    u16 DBUS;
+    u16 RBUS;
+
+    void setC(bool value)
+    {
+        if (value)
+            FLAG |= 0b1000;
+        else
+            FLAG &= 0b0111;
+    }
+
+    void setZ()
+    {
+        if (RBUS == 0)
+            FLAG |= 0b0100;
+        else
+            FLAG &= 0b1011;
+    }
+
+    void setS()
+    {
+        if (RBUS >> 15)
+            FLAG |= 0b0010;
+        else
+            FLAG &= 0b1101;
+    }
+
+    void setV(bool isAdding)
+    {
+        if (checkV(isAdding))
+            FLAG |= 0b0001;
+        else
+            FLAG &= 0b1110;
+    }
+
+    bool checkC(bool isAdding)
+    {
+        bool carry = false;
+        u16 cin = (!isAdding);
+
+        for (int i = 0; i < 16; ++i) {
+            bool sum = (((DBUS ^ SBUS) & u16(1 << i)) >> i) ^ cin;
+            u16 mask = 1 << i;
+
+            if (i == 15 && !isAdding)
+                return sum;
+
+            carry = (((DBUS & SBUS) & mask) >> i) ||
+                    ((((DBUS ^ SBUS) & mask) >> i) && cin);
+
+            cin = carry;
+        }
+
+        return carry;
+    }
+
+    bool checkV(bool isAdding)
+    {
+        bool dcr;
+        bool carry = checkC(isAdding);
+
+        SBUS++;
+
+        if (isAdding)
+            dcr = ((~(SBUS ^ DBUS)) >> 15) & ((RBUS >> 15) ^ carry);
+        else
+            dcr = ((SBUS >> 15) ^ (DBUS >> 15)) & ((RBUS >> 15) ^ carry);
+
+        return dcr;
+    }
+
+    void setFlags(bool isAdding)
+    {
+        setC(checkC(isAdding));
+        setZ();
+        setS();
+        setV(isAdding);
+    }
+
+    // T is the source, MDR the destination, RBUS the result
+    void run(FlagOperation operation, u16 T, u16 MDR)
+    {
+        DBUS = MDR;
+
+        switch (operation) {
+        case FlagOperation::add:
+            SBUS = T;
+            RBUS = (short)SBUS + (short)DBUS;
+            setFlags(true);
+            break;
+        case FlagOperation::subtract:
+            SBUS = ~T;
+            RBUS = DBUS + SBUS + 1;
+            setFlags(false);
+            break;
+        case FlagOperation::increment:
+            SBUS = 0;
+            RBUS = SBUS + DBUS + 1;
+            setFlags(true);
+            break;
+        default:
+            SBUS = (short)-1;
+            RBUS = SBUS + DBUS;
+            setFlags(false);
+            break;
+        }
+    }
+};
+
+const char *operationName(FlagOperation operation)
+{
+    switch (operation) {
+    case FlagOperation::add:
+        return "add";
+    case FlagOperation::subtract:
+        return "sub";
+    case FlagOperation::increment:
+        return "inc";
+    default:
+        return "dec";
+    }
+}
+
+const FlagOperation operations[] = {
+    FlagOperation::add, FlagOperation::subtract, FlagOperation::increment, FlagOperation::decrement
+};
+
+// The sources checkAllOperands() runs against every destination. Those
+// with the high byte of 0, 1, -1 or a sign change, where carries and
+// overflows change, and a spread of others. All of them when exhaustive
+bool checkedSource(u16 source)
+{
+    u8 high = source >> 8;
+    return exhaustive || high == 0x00 || high == 0x7f || high == 0x80 || high == 0xff || source % 251 == 0;
+}
+
+// Compares deferredFlagValue() with the eager ALU for every destination,
+// after a FLAG of all zeros or, alternately, all ones
+bool checkAllOperands()
+{
+    for (FlagOperation operation : operations) {
+        // inc and dec have the constant 1 as their source
+        u32 sources = operation == FlagOperation::add || operation == FlagOperation::subtract ? 1 << 16 : 1;
+
+        for (u32 source = 0; source < sources; source++) {
+            u16 T = sources == 1 ? 1 : source;
+
+            if (!checkedSource(T))
+                continue;
+
+            for (u32 destination = 0; destination < 1 << 16; destination++) {
+                EagerAlu alu;
+                alu.FLAG = (source ^ destination) & 1 ? 0xffff : 0;
+                alu.run(operation, T, destination);
+
+                u16 deferred = deferredFlagValue(operation, T, destination, alu.RBUS);
+
+                if (deferred != alu.FLAG) {
+                    std::cerr << operationName(operation) << " T=" << T << " MDR=" << destination << ": FLAG "
+                              << deferred << ", eagerly " << alu.FLAG << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+const char branches[][4] = {"bne", "beq", "bpl", "bcs", "bcc", "bvs", "bvc"};
+
+// Whether branch is taken with FLAG
+bool branchTaken(int branch, u16 FLAG)
+{
+    switch (branch) {
+    case 0:
+        return !(FLAG & 0b0100);
+    case 1:
+        return FLAG & 0b0100;
+    case 2:
+        return !(FLAG & 0b0010);
+    case 3:
+        return FLAG & 0b1000;
+    case 4:
+        return !(FLAG & 0b1000);
+    case 5:
+        return FLAG & 0b0001;
+    default:
+        return !(FLAG & 0b0001);
+    }
+}
+
+// Every flag producing instruction followed by every conditional branch,
+// for R1 op R2
+std::string branchProgram()
+{
+    const char *instructions[] = {"add $r1, $r2", "sub $r1, $r2", "cmp $r1, $r2", "inc $r1", "dec $r1"};
+    std::string source;
+
+    for (int instruction = 0; instruction < 5; instruction++) {
+        for (int branch = 0; branch < 7; branch++) {
+            std::string label = "s" + std::to_string(instruction * 7 + branch);
+
+            source += label + ":\n\t" + instructions[instruction] + "\n\t" + branches[branch] + " " + label + "t\n"
+                      "\tnop\n" + label + "t:\n\tnop\n";
+        }
+    }
+
+    return source + "\thalt\n";
+}
+
+enum class Engine {
+    impulses,
+    interpreter,
+    jit
+};
+
+const char *engineName(Engine engine)
+{
+    switch (engine) {
+    case Engine::impulses:
+        return "advance()";
+    case Engine::interpreter:
+        return "interpreter";
+    default:
+        return "JIT";
+    }
+}
+
+// Runs the flag producing instruction and the branch of every snippet in
+// the three engines and compares FLAG and the branch with the eager ALU.
+// Branches test the deferred flags, or with the JIT the fused conditions
+bool checkEngines()
+{
+    Labels labels;
+    std::vector<u8> image = assembleSource(branchProgram(), labels);
+
+    std::vector<std::pair<u16, u16>> operands;
+    const u16 edges[] = {0, 1, 2, 0x7ffe, 0x7fff, 0x8000, 0x8001, 0xfffe, 0xffff};
+
+    for (u16 T : edges)
+        for (u16 MDR : edges)
+            operands.push_back({T, MDR});
+
+    std::mt19937 random(2021);
+    for (int sample = 0; sample < 2000; sample++)
+        operands.push_back({(u16)random(), (u16)random()});
+
+    const FlagOperation snippetOperations[] = {
+        FlagOperation::add, FlagOperation::subtract, FlagOperation::subtract, FlagOperation::increment,
+        FlagOperation::decrement
+    };
+
+    for (Engine engine : {Engine::impulses, Engine::interpreter, Engine::jit}) {
+        CpuCore<NullCpuObserver> core;
+        core.setMachineCodeInMemory(image.data(), image.size());
+
+        if (engine == Engine::jit)
+            core.setJitMode(JitMode::on);
+
+        for (size_t pair = 0; pair < operands.size(); pair++) {
+            for (int instruction = 0; instruction < 5; instruction++) {
+                for (int branch = 0; branch < 7; branch++) {
+                    std::string label = "s" + std::to_string(instruction * 7 + branch);
+                    FlagOperation operation = snippetOperations[instruction];
+                    u16 T = operation == FlagOperation::add || operation == FlagOperation::subtract
+                                ? operands[pair].first : 1;
+                    u16 MDR = operands[pair].second;
+
+                    CpuRegisters registers = core.getRegisters();
+                    registers.R[1] = MDR;
+                    registers.R[2] = operands[pair].first;
+                    registers.PC = labels[label];
+                    registers.FLAG = pair & 1 ? 0xffff : 0;
+                    core.setRegisters(registers);
+
+                    if (engine == Engine::impulses) {
+                        core.stepInstruction();
+                        core.stepInstruction();
+                    } else {
+                        core.runInstructions(2);
+                    }
+
+                    EagerAlu alu;
+                    alu.FLAG = registers.FLAG;
+                    alu.run(operation, T, MDR);
+
+                    registers = core.getRegisters();
+                    bool taken = registers.PC == labels[label + "t"];
+
+                    if (registers.FLAG != alu.FLAG || taken != branchTaken(branch, alu.FLAG)) {
+                        std::cerr << engineName(engine) << ": " << operationName(operation) << " T=" << T
+                                  << " MDR=" << MDR << " then " << branches[branch] << ": FLAG " << registers.FLAG
+                                  << (taken ? " taken" : " not taken") << ", eagerly " << alu.FLAG << std::endl;
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+}
+
+bool checkDeferredFlags()
+{
+    return checkAllOperands() && checkEngines();
+}
@@ -0,0 +1,79 @@
+// Checks of the simulator core that run without Qt. Prints the checks
+// that fail and exits with 1 if there are any. --exhaustive makes the
+// checks that sample their inputs try all of them, which takes minutes
+
+#include "tests.h"
+
+#include "assembler/XASMGenerator.h"
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+struct Check
+{
+    const char *name;
+    bool (*run)();
+};
+
+const Check checks[] = {
+    {"deferred flags", checkDeferredFlags},
+    {"VCD widths", checkVcdWidths},
+    {"sampled profile", checkSampledProfile},
+    {"condition nesting", checkConditionNesting},
+    {"limited instruction count", checkLimitedCount},
+};
+
+}
+
+bool exhaustive = false;
+
+std::vector<u8> assembleSource(const std::string &source, Labels &labels)
+{
+    std::string text = source;
+    Lexer lexer(text);
+    XASMParser parser(lexer);
+    parser.parse();
+
+    labels = parser.getLabels();
+    XASMGenerator generator(lexer, labels);
+
+    std::vector<u8> image;
+    for (u16 word : generator.assemble()) {
+        image.push_back(word & 0xff);
+        image.push_back(word >> 8);
+    }
+
+    return image;
+}
+
+int main(int argc, char *argv[])
+{
+    int failed = 0;
+
+    for (int index = 1; index < argc; index++) {
+        if (strcmp(argv[index], "--exhaustive") != 0) {
+            std::cerr << "usage: xasm-test [--exhaustive]" << std::endl;
+            return 2;
+        }
+
+        exhaustive = true;
+    }
+
+    for (const Check &check : checks) {
+        bool passed = false;
+
+        try {
+            passed = check.run();
+        } catch (std::exception &e) {
+            std::cerr << e.what() << std::endl;
+        }
+
+        std::cout << check.name << ": " << (passed ? "ok" : "FAILED") << std::endl;
+        failed += !passed;
+    }
+
+    return failed ? 1 : 0;
+}
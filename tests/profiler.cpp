@@ -0,0 +1,113 @@
+// Sampled profiles with a period of one impulse against the full profile
+// of the same run
+
+#include "tests.h"
+
+#include <cpu/cpucore.h>
+
+#include <iostream>
+
+namespace {
+
+// Calls two deep, so that samples fall on call and ret in both directions
+const char program[] =
+    "start:\n"
+    "\tmov $r1, 5\n"
+    "loop:\n"
+    "\tcall f\n"
+    "\tdec $r1\n"
+    "\tbne loop\n"
+    "\thalt\n"
+    "f:\n"
+    "\tmov $r2, 3\n"
+    "inner:\n"
+    "\tcall g\n"
+    "\tdec $r2\n"
+    "\tbne inner\n"
+    "\tret\n"
+    "g:\n"
+    "\tadd $r3, 1\n"
+    "\tret\n";
+
+// Runs the program to halt under profiler, impulse by impulse or through
+// runInstructions()
+void profileRun(std::vector<u8> image, Profiler &profiler, bool impulses)
+{
+    CpuCore<NullCpuObserver> core;
+    core.setMachineCodeInMemory(image.data(), image.size());
+    core.setProfiler(&profiler);
+
+    while (!core.isHalted()) {
+        if (impulses)
+            core.advance();
+        else
+            core.runInstructions(1000);
+    }
+
+    core.setProfiler(nullptr);
+}
+
+// Impulses per frame and per address, and the calls of every frame. The
+// counts differ, the full profile counts instructions, the sampled one
+// impulses
+bool sameImpulses(const Profiler &full, const Profiler &sampled, const char *engine)
+{
+    const std::vector<ProfileFrame> &frames = full.getFrames();
+    const std::vector<ProfileFrame> &sampledFrames = sampled.getFrames();
+
+    if (frames.size() != sampledFrames.size()) {
+        std::cerr << engine << ": " << sampledFrames.size() << " frames, fully " << frames.size() << std::endl;
+        return false;
+    }
+
+    for (size_t index = 0; index < frames.size(); index++) {
+        const ProfileFrame &frame = frames[index];
+        const ProfileFrame &sampledFrame = sampledFrames[index];
+
+        if (frame.function != sampledFrame.function || frame.parent != sampledFrame.parent ||
+            frame.calls != sampledFrame.calls || frame.impulses != sampledFrame.impulses) {
+            std::cerr << engine << ": frame of " << sampledFrame.function << " has " << sampledFrame.calls
+                      << " calls and " << sampledFrame.impulses << " impulses, fully " << frame.function << " with "
+                      << frame.calls << " and " << frame.impulses << std::endl;
+            return false;
+        }
+    }
+
+    const std::vector<ProfileCounter> &counters = full.getCounters();
+    const std::vector<ProfileCounter> &sampledCounters = sampled.getCounters();
+
+    for (size_t word = 0; word < counters.size(); word++) {
+        if (counters[word].impulses != sampledCounters[word].impulses) {
+            std::cerr << engine << ": " << sampledCounters[word].impulses << " impulses at " << (word << 1)
+                      << ", fully " << counters[word].impulses << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}
+
+bool checkSampledProfile()
+{
+    Labels labels;
+    std::vector<u8> image = assembleSource(program, labels);
+
+    Profiler full(labels["start"]);
+    profileRun(image, full, false);
+
+    if (full.getFrames().size() != 3) {
+        std::cerr << "the full profile has " << full.getFrames().size() << " frames" << std::endl;
+        return false;
+    }
+
+    Profiler sampledImpulses(labels["start"], 1);
+    profileRun(image, sampledImpulses, true);
+
+    Profiler sampledInstructions(labels["start"], 1);
+    profileRun(image, sampledInstructions, false);
+
+    return sameImpulses(full, sampledImpulses, "advance()") &&
+           sameImpulses(full, sampledInstructions, "runInstructions()");
+}
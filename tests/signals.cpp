@@ -0,0 +1,125 @@
+// The VCD waveforms of signal captures against the widths they declare
+
+#include "tests.h"
+
+#include <cpu/signaltrace.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include <unistd.h>
+
+namespace {
+
+// Both operands in memory, so that OF runs up to its last impulse, and
+// every kind of instruction around them
+const char program[] =
+    "start:\n"
+    "\tmov $r1, 256\n"
+    "\tmov $r2, 512\n"
+    "\tmov 2($r1), 4($r2)\n"
+    "\tadd ($r1), 6($r2)\n"
+    "\tcall f\n"
+    "\tpushflag\n"
+    "\tpopflag\n"
+    "\thalt\n"
+    "f:\n"
+    "\tinc 8($r2)\n"
+    "\tret\n";
+
+}
+
+bool checkVcdWidths()
+{
+    Labels labels;
+    std::vector<u8> image = assembleSource(program, labels);
+
+    char path[] = "/tmp/xasm-test-XXXXXX";
+    int descriptor = mkstemp(path);
+    if (descriptor < 0) {
+        std::cerr << "cannot create a signal capture" << std::endl;
+        return false;
+    }
+    close(descriptor);
+
+    std::ostringstream vcd;
+
+    try {
+        SignalWriter writer(path);
+        CpuCore<SignalObserver> core{SignalObserver(&writer)};
+
+        core.setMachineCodeInMemory(image.data(), image.size());
+        while (!core.isHalted())
+            core.advance();
+
+        writer.close();
+
+        SignalReader reader(path);
+        writeVcd(vcd, reader);
+    } catch (std::runtime_error &e) {
+        std::cerr << e.what() << std::endl;
+        remove(path);
+        return false;
+    }
+
+    remove(path);
+
+    // Declared width per identifier, then every value change against it
+    std::map<char, int> widths;
+    std::map<char, std::string> names;
+    std::istringstream lines(vcd.str());
+    std::string line;
+    u16 highestImpulse = 0;
+
+    while (std::getline(lines, line)) {
+        std::istringstream words(line);
+        std::string word;
+        words >> word;
+
+        if (word == "$var") {
+            std::string type;
+            int width;
+            char identifier;
+            std::string name;
+
+            words >> type >> width >> identifier >> name;
+            widths[identifier] = width;
+            names[identifier] = name;
+            continue;
+        }
+
+        std::string value;
+        char identifier;
+
+        if (word.empty() || word[0] == '$' || word[0] == '#')
+            continue;
+
+        if (word[0] == 'b') {
+            value = word.substr(1);
+            words >> identifier;
+        } else {
+            value = word.substr(0, 1);
+            identifier = word[1];
+        }
+
+        if (!widths.count(identifier) || (int)value.size() > widths[identifier]) {
+            std::cerr << "value " << value << " of " << names[identifier] << " is wider than "
+                      << widths[identifier] << " bits" << std::endl;
+            return false;
+        }
+
+        if (names[identifier] == "impulse")
+            highestImpulse = std::max<u16>(highestImpulse, (u16)std::stoul(value, nullptr, 2));
+    }
+
+    if (highestImpulse != CGB::maxImpulse) {
+        std::cerr << "the capture reaches impulse " << highestImpulse << " only" << std::endl;
+        return false;
+    }
+
+    return true;
+}
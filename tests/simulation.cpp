@@ -0,0 +1,108 @@
+// Instruction counts of runs that end at the impulse limit against those
+// of runs that go on to halt
+
+#include "tests.h"
+
+#include <xasm-run/simulation.h>
+
+#include <iostream>
+
+namespace {
+
+// Long enough for limits far from either end, with instructions of
+// different lengths and a call
+const char program[] =
+    "start:\n"
+    "\tmov $r1, 6\n"
+    "\tmov $r2, 256\n"
+    "loop:\n"
+    "\tcall f\n"
+    "\tadd 2($r2), $r1\n"
+    "\tdec $r1\n"
+    "\tbne loop\n"
+    "\thalt\n"
+    "f:\n"
+    "\tinc ($r2)\n"
+    "\tret\n";
+
+// Impulse count at the end of every instruction of a run to halt
+std::vector<u64> instructionEnds(const std::vector<u8> &image)
+{
+    CpuCore<NullCpuObserver> core;
+    core.setMachineCodeInMemory(const_cast<u8 *>(image.data()), image.size());
+
+    std::vector<u64> ends;
+    while (!core.isHalted()) {
+        if (core.stepInstruction())
+            ends.push_back(core.getImpulseCount());
+    }
+
+    ends.push_back(core.getImpulseCount());
+    return ends;
+}
+
+// Instructions a run reports when limited to impulses, through
+// simulate() or, with impulses, simulateImpulses()
+u64 limitedCount(const std::vector<u8> &image, u64 impulses, bool single, u64 &end)
+{
+    SimulationOptions options;
+    options.maxImpulses = impulses;
+
+    u64 instructions = 0;
+
+    if (single) {
+        CpuCore<SignalObserver> core;
+        core.setMachineCodeInMemory(const_cast<u8 *>(image.data()), image.size());
+        simulateImpulses(core, options, instructions);
+        end = core.getImpulseCount();
+    } else {
+        CpuCore<NullCpuObserver> core;
+        core.setMachineCodeInMemory(const_cast<u8 *>(image.data()), image.size());
+        simulate(core, options, instructions);
+        end = core.getImpulseCount();
+    }
+
+    return instructions;
+}
+
+}
+
+bool checkLimitedCount()
+{
+    Labels labels;
+    std::vector<u8> image = assembleSource(program, labels);
+
+    // The last entry is the impulse the run halts at
+    std::vector<u64> ends = instructionEnds(image);
+    u64 halted = ends.back();
+    ends.pop_back();
+
+    for (bool single : {false, true}) {
+        const char *engine = single ? "simulateImpulses()" : "simulate()";
+
+        u64 end;
+        u64 unlimited = limitedCount(image, ~0ull, single, end);
+
+        if (unlimited != ends.size() || end != halted) {
+            std::cerr << engine << ": " << unlimited << " instructions to impulse " << end << ", stepped "
+                      << ends.size() << " to " << halted << std::endl;
+            return false;
+        }
+
+        for (u64 impulses = 1; impulses <= halted; impulses++) {
+            u64 expected = 0;
+            while (expected < ends.size() && ends[expected] <= impulses)
+                expected++;
+
+            u64 count = limitedCount(image, impulses, single, end);
+
+            if (count != expected || end != impulses) {
+                std::cerr << engine << ": " << count << " instructions to impulse " << end << " of at most "
+                          << impulses << ", " << expected << " by then when stepped" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,24 @@
+#ifndef TESTS_H
+#define TESTS_H
+
+#include "assembler/defs.h"
+
+#include <string>
+#include <vector>
+
+//// Set by --exhaustive, checks then try every input instead of a sample
+extern bool exhaustive;
+
+//// Object code of an XASM source as the bytes of a memory image, and its
+//// labels. Throws like the assembler does
+std::vector<u8> assembleSource(const std::string &source, Labels &labels);
+
+//// Every check prints what differs to std::cerr and returns whether
+//// nothing did
+bool checkDeferredFlags();
+bool checkVcdWidths();
+bool checkSampledProfile();
+bool checkConditionNesting();
+bool checkLimitedCount();
+
+#endif // TESTS_H
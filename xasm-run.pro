@@ -0,0 +1,58 @@
+# Headless simulator, builds without Qt
+
+TEMPLATE = app
+TARGET = xasm-run
+
+CONFIG += console c++14 thread
+CONFIG -= qt app_bundle
+
+SOURCES += \
+    assembler/XASMGenerator.cpp \
+    assembler/lexer.cpp \
+    assembler/parser.cpp \
+    assembler/verifier.cpp \
+    cgb/cgb.cpp \
+    cpu/breakpoint.cpp \
+    cpu/coverage.cpp \
+    cpu/cpucore.cpp \
+    cpu/interruptlog.cpp \
+    cpu/jit.cpp \
+    cpu/pagedmemory.cpp \
+    cpu/profiler.cpp \
+    cpu/signaltrace.cpp \
+    cpu/trace.cpp \
+    xasm-run/batch.cpp \
+    xasm-run/main.cpp \
+    xasm-run/simulation.cpp \
+    xasm-run/sweep.cpp \
+    xasm-run/workstealingpool.cpp
+
+HEADERS += \
+    assembler/XASMGenerator.h \
+    assembler/defs.h \
+    assembler/encoding.h \
+    assembler/lexer.h \
+    assembler/parser.h \
+    assembler/token.h \
+    assembler/verifier.h \
+    cgb/cgb.h \
+    cpu/breakpoint.h \
+    cpu/coverage.h \
+    cpu/cpucore.h \
+    cpu/cpucoreimpl.h \
+    cpu/interruptlog.h \
+    cpu/jit.h \
+    cpu/pagedmemory.h \
+    cpu/profiler.h \
+    cpu/signaltrace.h \
+    cpu/spscring.h \
+    cpu/statefile.h \
+    cpu/trace.h \
+    xasm-run/batch.h \
+    xasm-run/simulation.h \
+    xasm-run/sweep.h \
+    xasm-run/workstealingpool.h
+
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,273 @@
+#include "batch.h"
+#include "workstealingpool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace {
+
+struct BatchResult
+{
+    // Set when the program could not be loaded or assembled
+    std::string error;
+
+    SimulationStatus status = SimulationStatus::halted;
+    std::string reason;
+    u64 instructions = 0;
+    u64 impulses = 0;
+    double seconds = 0;
+    CpuRegisters registers = {};
+    std::vector<std::vector<u8>> memory;
+
+    // lcov record, for .s programs while covering
+    std::string coverage;
+};
+
+bool isDirectory(const std::string &path)
+{
+    struct stat status;
+    return stat(path.c_str(), &status) == 0 && S_ISDIR(status.st_mode);
+}
+
+bool endsWith(const std::string &text, const std::string &suffix)
+{
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+BatchResult simulateProgram(const std::string &program, const SimulationOptions &options,
+                            const std::vector<MemoryRange> &ranges, const ProfileOptions &profile, bool covering)
+{
+    BatchResult result;
+    auto start = std::chrono::steady_clock::now();
+
+    CpuCore<NullCpuObserver> core;
+    Labels labels;
+    LineTable lines;
+    try {
+        loadProgram(core, program, &labels, &lines);
+    } catch (std::exception &e) {
+        result.error = e.what();
+        return result;
+    }
+
+    if (options.jit)
+        core.setJitMode(JitMode::on);
+
+    std::unique_ptr<Profiler> profiler;
+    if (!profile.path.empty()) {
+        profiler.reset(new Profiler(core.getRegisters().PC, profile.samplePeriod, profile.randomized));
+        core.setProfiler(profiler.get());
+    }
+
+    std::unique_ptr<Coverage> coverage;
+    PagedMemory code;
+    if (covering && isSource(program)) {
+        coverage.reset(new Coverage());
+        code = core.getMemoryView();
+        core.setCoverage(coverage.get());
+    }
+
+    result.status = simulate(core, options, result.instructions);
+    if (core.isHalted())
+        result.reason = core.getReason();
+    result.impulses = core.getImpulseCount();
+    result.registers = core.getRegisters();
+
+    for (const MemoryRange &range : ranges) {
+        result.memory.emplace_back(range.length);
+        core.getMemoryView().read(range.address, range.length, result.memory.back().data());
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (coverage) {
+        std::ostringstream record;
+        writeLcov(record, *coverage, program, lines, code);
+        result.coverage = record.str();
+    }
+
+    if (profiler) {
+        core.setProfiler(nullptr);
+
+        size_t slash = program.rfind('/');
+        std::string name = slash == std::string::npos ? program : program.substr(slash + 1);
+
+        try {
+            saveProfile(profile.path + "/" + name + profileExtension(profile.format), *profiler, labels,
+                        profile.format);
+        } catch (std::runtime_error &e) {
+            result.error = e.what();
+        }
+    }
+
+    return result;
+}
+
+std::string quote(const std::string &text)
+{
+    std::string quoted = "\"";
+
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if ((unsigned char)c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            quoted += escape;
+        } else {
+            quoted += c;
+        }
+    }
+
+    return quoted + "\"";
+}
+
+void writeResult(std::ostream &report, const std::string &program, const BatchResult &result,
+                 const std::vector<MemoryRange> &ranges)
+{
+    report << "    {\"program\": " << quote(program);
+
+    if (!result.error.empty()) {
+        report << ", \"status\": \"error\", \"error\": " << quote(result.error) << "}";
+        return;
+    }
+
+    const CpuRegisters &registers = result.registers;
+
+    report << ", \"status\": " << quote(statusName(result.status));
+    if (result.status == SimulationStatus::halted)
+        report << ", \"reason\": " << quote(result.reason);
+    report << ", \"instructions\": " << result.instructions
+           << ", \"impulses\": " << result.impulses
+           << ", \"seconds\": " << result.seconds;
+
+    report << ", \"registers\": {";
+    for (int index = 0; index < 16; index++)
+        report << "\"R" << index << "\": " << registers.R[index] << ", ";
+    report << "\"PC\": " << registers.PC << ", \"SP\": " << registers.SP
+           << ", \"FLAG\": " << registers.FLAG << ", \"T\": " << registers.T
+           << ", \"IR\": " << registers.IR << ", \"MDR\": " << registers.MDR
+           << ", \"ADR\": " << registers.ADR << ", \"IVR\": " << registers.IVR << "}";
+
+    if (!ranges.empty()) {
+        report << ", \"memory\": [";
+
+        for (size_t index = 0; index < ranges.size(); index++) {
+            std::string bytes;
+            for (u8 byte : result.memory[index]) {
+                char hex[3];
+                snprintf(hex, sizeof(hex), "%02x", byte);
+                bytes += hex;
+            }
+
+            report << (index ? ", " : "") << "{\"address\": " << ranges[index].address
+                   << ", \"bytes\": \"" << bytes << "\"}";
+        }
+
+        report << "]";
+    }
+
+    report << "}";
+}
+
+}
+
+std::vector<std::string> listPrograms(const std::string &path)
+{
+    std::vector<std::string> programs;
+
+    if (isDirectory(path)) {
+        DIR *directory = opendir(path.c_str());
+        if (!directory)
+            throw std::runtime_error("cannot read " + path);
+
+        while (dirent *entry = readdir(directory)) {
+            std::string name = entry->d_name;
+
+            if (endsWith(name, ".s") || endsWith(name, ".out") || endsWith(name, ".state"))
+                programs.push_back(path + "/" + name);
+        }
+
+        closedir(directory);
+        std::sort(programs.begin(), programs.end());
+        return programs;
+    }
+
+    std::ifstream manifest(path);
+    if (!manifest)
+        throw std::runtime_error("cannot open " + path);
+
+    std::string base;
+    size_t slash = path.rfind('/');
+    if (slash != std::string::npos)
+        base = path.substr(0, slash + 1);
+
+    std::string line;
+    while (std::getline(manifest, line)) {
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        programs.push_back(line[0] == '/' ? line : base + line);
+    }
+
+    return programs;
+}
+
+bool runBatch(const std::vector<std::string> &programs, const SimulationOptions &options,
+              const std::vector<MemoryRange> &ranges, const ProfileOptions &profile, const std::string &coverage,
+              unsigned threads, std::ostream &report)
+{
+    WorkStealingPool pool(threads);
+    std::vector<BatchResult> results(programs.size());
+    std::vector<std::function<void()>> tasks;
+
+    // Every task only writes its own result
+    for (size_t index = 0; index < programs.size(); index++) {
+        tasks.push_back([&, index]() {
+            results[index] = simulateProgram(programs[index], options, ranges, profile, !coverage.empty());
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    pool.run(std::move(tasks));
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    bool halted = true;
+
+    report << "{\n  \"threads\": " << pool.threadCount() << ",\n  \"seconds\": " << seconds
+           << ",\n  \"programs\": [\n";
+
+    for (size_t index = 0; index < programs.size(); index++) {
+        writeResult(report, programs[index], results[index], ranges);
+        report << (index + 1 < programs.size() ? ",\n" : "\n");
+
+        if (!results[index].error.empty() || results[index].status != SimulationStatus::halted)
+            halted = false;
+    }
+
+    report << "  ]\n}\n";
+
+    if (!coverage.empty()) {
+        std::ofstream file(coverage);
+
+        for (const BatchResult &result : results)
+            file << result.coverage;
+
+        if (!file.flush())
+            throw std::runtime_error("cannot write " + coverage);
+    }
+
+    return halted;
+}
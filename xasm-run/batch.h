@@ -0,0 +1,26 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "simulation.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+//// Programs of a batch: the .s, .out and .state files of a directory, sorted, or
+//// the lines of a manifest, relative to the manifest. Empty lines and lines
+//// starting with # are skipped. Throws std::runtime_error
+std::vector<std::string> listPrograms(const std::string &path);
+
+//// Simulates every program on a core of its own, on threads threads, and
+//// writes one JSON report with a result per program, in order. ranges
+//// selects the memory included in every result. With a profile path, the
+//// profile of every program goes to that directory, named after the
+//// program. With a coverage path, the lcov records of the .s programs go
+//// to that file, in order. Returns whether every program halted. Throws
+//// std::runtime_error if coverage cannot be written
+bool runBatch(const std::vector<std::string> &programs, const SimulationOptions &options,
+              const std::vector<MemoryRange> &ranges, const ProfileOptions &profile, const std::string &coverage,
+              unsigned threads, std::ostream &report);
+
+#endif // BATCH_H
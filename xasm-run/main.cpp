@@ -0,0 +1,572 @@
+// Headless simulator. Assembles a source, loads an image or restores a
+// saved state, runs it without Qt and prints the final state. In batch
+// mode runs many programs in parallel and writes one report, in sweep mode
+// runs one program from many initial states and writes a row per run
+
+#include "batch.h"
+#include "simulation.h"
+#include "sweep.h"
+
+#include <cpu/breakpoint.h>
+#include <cpu/interruptlog.h>
+#include <cpu/signaltrace.h>
+#include <cpu/trace.h>
+
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options
+{
+    std::string program;
+    SimulationOptions simulation;
+    std::vector<MemoryRange> ranges;
+    std::vector<std::string> breakpoints;
+    std::vector<std::string> watchpoints;
+    std::string dumpFile;
+    std::string stateFile;
+    std::string traceFile;
+    u64 keyframeInterval = TraceWriter::defaultKeyframeInterval;
+    std::string signalsFile;
+    ProfileOptions profile;
+    std::string coverageFile;
+
+    std::string batch;
+    std::string sweep;
+    unsigned jobs = 0;
+    std::string reportFile;
+};
+
+const char usage[] =
+    "usage: xasm-run [options] program.s|image.out|machine.state\n"
+    "       xasm-run [options] --batch DIRECTORY|MANIFEST\n"
+    "       xasm-run [options] --sweep INPUTS program.s|image.out|machine.state\n"
+    "\n"
+    "  --max-instructions N  stop after N instructions\n"
+    "  --max-impulses N      stop after N impulses\n"
+    "  --jit                 run translated native code\n"
+    "  --interrupts FILE     request interrupts at the impulse counts of an\n"
+    "                        interrupt log saved by the simulator\n"
+    "  --memory ADDR:LEN     print LEN bytes of memory from ADDR, repeatable\n"
+    "  --break LOC[:COND]    stop before the instruction at LOC, a label or an\n"
+    "                        even address, whenever the condition COND holds, like\n"
+    "                        'loop:R3 == 0 && FLAG.Z', repeatable\n"
+    "  --watch LOC:LEN[:rw]  stop after the instruction that writes, reads\n"
+    "                        with r or does either with rw, any of LEN bytes\n"
+    "                        from LOC, a label or an address, repeatable\n"
+    "  --dump FILE           write all of memory to FILE\n"
+    "  --save-state FILE     write the final machine state to FILE, which runs\n"
+    "                        resume from when given as the program\n"
+    "  --trace FILE          write a binary trace of every instruction to FILE,\n"
+    "                        which xasm-trace prints\n"
+    "  --keyframes N         keep the machine state every N instructions in\n"
+    "                        the trace, where xasm-trace can start from,\n"
+    "                        1048576 by default\n"
+    "  --signals FILE        write the control signals and buses of every\n"
+    "                        impulse to FILE, which xasm-trace --vcd turns\n"
+    "                        into a waveform\n"
+    "  --profile PATH        write the instructions and impulses per address\n"
+    "                        and per function to PATH, for a batch one file\n"
+    "                        per program into the directory PATH\n"
+    "  --profile-format F    text, json or collapsed stacks for flame graphs,\n"
+    "                        text by default\n"
+    "  --sample N            profile a sample every N impulses instead of\n"
+    "                        every instruction, leaving --jit on\n"
+    "  --sample-random       sample after random intervals of N impulses on\n"
+    "                        average, which do not fall into step with loops\n"
+    "  --coverage FILE       write the lines of the .s program that ran and\n"
+    "                        the ways its conditional branches went to FILE in\n"
+    "                        lcov format, for a batch those of every .s\n"
+    "                        program\n"
+    "  --batch PATH          run the .s, .out and .state files of a directory,\n"
+    "                        or the programs listed in a manifest, one per\n"
+    "                        line\n"
+    "  --sweep INPUTS        run the program once per line of INPUTS, - for\n"
+    "                        stdin, each line setting registers and memory\n"
+    "                        like R1=0x10 SP=0x8000 [0x200]=0a00ff01\n"
+    "  --jobs N              run a batch or sweep on N threads, one per core\n"
+    "                        by default\n"
+    "  --report FILE         write the JSON report of a batch or the CSV rows\n"
+    "                        of a sweep to FILE\n"
+    "\n"
+    "Exits with 0 when the program halts, 2 when it stops at a limit, a\n"
+    "breakpoint or a watchpoint or waits for an interrupt, 1 on errors.\n"
+    "Batches and sweeps exit with 0 when every run halts.\n";
+
+MemoryRange parseRange(const std::string &text)
+{
+    size_t colon = text.find(':');
+    if (colon == std::string::npos)
+        throw std::invalid_argument("expected ADDR:LEN, found " + text);
+
+    u64 address = parseNumber(text.substr(0, colon));
+    u64 length = parseNumber(text.substr(colon + 1));
+
+    if (address + length > 1 << 16)
+        throw std::invalid_argument("range outside of memory: " + text);
+
+    return {(u16)address, (u32)length};
+}
+
+// A label of the program or an address
+u64 parseLocation(const std::string &location, const Labels &labels)
+{
+    auto label = labels.find(location);
+
+    if (label != labels.end())
+        return label->second;
+
+    if (location.empty() || !isdigit((unsigned char)location[0]))
+        throw std::invalid_argument("no label " + location);
+
+    return parseNumber(location);
+}
+
+// LOC or LOC:COND
+void setBreakpoint(CpuCore<NullCpuObserver> &core, const std::string &text, const Labels &labels)
+{
+    size_t colon = text.find(':');
+    std::string location = text.substr(0, colon);
+    u64 address = parseLocation(location, labels);
+
+    if (address > 0xffff)
+        throw std::invalid_argument("breakpoint outside of memory: " + location);
+
+    // Instructions start at even addresses only
+    if (address & 1)
+        throw std::invalid_argument("breakpoint at an odd address: " + location);
+
+    BreakpointCondition condition;
+
+    if (colon != std::string::npos) {
+        try {
+            condition = BreakpointCondition(text.substr(colon + 1));
+        } catch (std::invalid_argument &e) {
+            throw std::invalid_argument("condition of " + location + ", " + e.what());
+        }
+    }
+
+    core.setBreakpoint((u16)address, condition);
+}
+
+// LOC:LEN, LOC:LEN:r, LOC:LEN:w or LOC:LEN:rw
+void setWatchpoint(CpuCore<NullCpuObserver> &core, const std::string &text, const Labels &labels)
+{
+    size_t colon = text.find(':');
+    if (colon == std::string::npos)
+        throw std::invalid_argument("expected LOC:LEN, found " + text);
+
+    size_t accessColon = text.find(':', colon + 1);
+    u64 address = parseLocation(text.substr(0, colon), labels);
+    u64 length = parseNumber(text.substr(colon + 1, accessColon - colon - 1));
+    std::string accessText = accessColon == std::string::npos ? "w" : text.substr(accessColon + 1);
+    u8 access;
+
+    if (accessText == "w")
+        access = watchWrite;
+    else if (accessText == "r")
+        access = watchRead;
+    else if (accessText == "rw")
+        access = watchRead | watchWrite;
+    else
+        throw std::invalid_argument("expected r, w or rw, found " + accessText);
+
+    if (!length || address + length > 1 << 16)
+        throw std::invalid_argument("watchpoint outside of memory: " + text);
+
+    core.setWatchpoint((u16)address, (u32)length, access);
+}
+
+std::vector<u64> readInterrupts(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("cannot open " + path);
+
+    try {
+        return readInterruptLog(file);
+    } catch (std::runtime_error &e) {
+        throw std::runtime_error(path + ", " + e.what());
+    }
+}
+
+Options parseArguments(int argc, char **argv)
+{
+    Options options;
+
+    for (int index = 1; index < argc; index++) {
+        std::string argument = argv[index];
+
+        auto value = [&]() -> std::string {
+            if (index + 1 == argc)
+                throw std::invalid_argument(argument + " needs a value");
+
+            return argv[++index];
+        };
+
+        if (argument == "--max-instructions")
+            options.simulation.maxInstructions = parseNumber(value());
+        else if (argument == "--max-impulses")
+            options.simulation.maxImpulses = parseNumber(value());
+        else if (argument == "--jit")
+            options.simulation.jit = true;
+        else if (argument == "--interrupts")
+            options.simulation.interrupts = readInterrupts(value());
+        else if (argument == "--memory")
+            options.ranges.push_back(parseRange(value()));
+        else if (argument == "--break")
+            options.breakpoints.push_back(value());
+        else if (argument == "--watch")
+            options.watchpoints.push_back(value());
+        else if (argument == "--dump")
+            options.dumpFile = value();
+        else if (argument == "--save-state")
+            options.stateFile = value();
+        else if (argument == "--trace")
+            options.traceFile = value();
+        else if (argument == "--keyframes")
+            options.keyframeInterval = parseNumber(value());
+        else if (argument == "--signals")
+            options.signalsFile = value();
+        else if (argument == "--profile")
+            options.profile.path = value();
+        else if (argument == "--profile-format")
+            options.profile.format = parseProfileFormat(value());
+        else if (argument == "--sample")
+            options.profile.samplePeriod = parseNumber(value());
+        else if (argument == "--sample-random")
+            options.profile.randomized = true;
+        else if (argument == "--coverage")
+            options.coverageFile = value();
+        else if (argument == "--batch")
+            options.batch = value();
+        else if (argument == "--sweep")
+            options.sweep = value();
+        else if (argument == "--jobs")
+            options.jobs = (unsigned)parseNumber(value());
+        else if (argument == "--report")
+            options.reportFile = value();
+        else if (argument.compare(0, 2, "--") == 0 || !options.program.empty())
+            throw std::invalid_argument("unexpected argument " + argument);
+        else
+            options.program = argument;
+    }
+
+    if (options.batch.empty() == options.program.empty())
+        throw std::invalid_argument("expected either a program or --batch");
+
+    if ((!options.batch.empty() || !options.sweep.empty()) &&
+        (!options.dumpFile.empty() || !options.stateFile.empty() || !options.traceFile.empty() ||
+         !options.signalsFile.empty()))
+        throw std::invalid_argument("--dump, --save-state, --trace and --signals do not apply to a batch or sweep");
+
+    bool stops = !options.breakpoints.empty() || !options.watchpoints.empty();
+
+    if ((!options.batch.empty() || !options.sweep.empty()) && stops)
+        throw std::invalid_argument("--break and --watch do not apply to a batch or sweep");
+
+    if (!options.signalsFile.empty() && stops)
+        throw std::invalid_argument("--break and --watch do not apply to --signals, which runs impulse by impulse");
+
+    if (!options.sweep.empty() && (!options.profile.path.empty() || !options.coverageFile.empty()))
+        throw std::invalid_argument("--profile and --coverage do not apply to a sweep");
+
+    if (!options.program.empty() && !options.coverageFile.empty() && !isSource(options.program))
+        throw std::invalid_argument("--coverage needs a .s program");
+
+    if (options.profile.path.empty() && (options.profile.samplePeriod || options.profile.randomized))
+        throw std::invalid_argument("--sample and --sample-random need --profile");
+
+    if (options.profile.randomized && !options.profile.samplePeriod)
+        throw std::invalid_argument("--sample-random needs --sample");
+
+    return options;
+}
+
+void printState(CpuCore<NullCpuObserver> &core, const Options &options, SimulationStatus status, u64 instructions)
+{
+    CpuRegisters registers = core.getRegisters();
+
+    printf("status: %s\n", statusName(status));
+    if (core.isHalted())
+        printf("reason: %s\n", core.getReason().c_str());
+
+    if (status == SimulationStatus::watchpoint) {
+        WatchpointHit hit = core.getWatchpointHit();
+
+        if (hit.write)
+            printf("access: write 0x%04x, 0x%04x -> 0x%04x\n", hit.address, hit.oldValue, hit.newValue);
+        else
+            printf("access: read 0x%04x, 0x%04x\n", hit.address, hit.newValue);
+
+        if (hit.interrupt)
+            printf("by: interrupt entry, returning to 0x%04x\n", hit.instruction);
+        else
+            printf("by: instruction at 0x%04x\n", hit.instruction);
+
+        printf("at impulse: %llu\n", hit.impulse);
+    }
+    printf("instructions: %llu\n", instructions);
+    printf("impulses: %llu\n", core.getImpulseCount());
+
+    for (int index = 0; index < 16; index++)
+        printf("R%d: 0x%04x\n", index, registers.R[index]);
+
+    printf("PC: 0x%04x\n", registers.PC);
+    printf("SP: 0x%04x\n", registers.SP);
+    printf("FLAG: 0x%04x C=%d Z=%d S=%d V=%d\n", registers.FLAG, (registers.FLAG >> 3) & 1,
+           (registers.FLAG >> 2) & 1, (registers.FLAG >> 1) & 1, registers.FLAG & 1);
+    printf("T: 0x%04x\n", registers.T);
+    printf("IR: 0x%04x\n", registers.IR);
+    printf("MDR: 0x%04x\n", registers.MDR);
+    printf("ADR: 0x%04x\n", registers.ADR);
+    printf("IVR: 0x%04x\n", registers.IVR);
+
+    const PagedMemory &memory = core.getMemoryView();
+
+    for (const MemoryRange &range : options.ranges) {
+        for (u32 line = 0; line < range.length; line += 16) {
+            printf("0x%04x:", range.address + line);
+
+            for (u32 offset = line; offset < range.length && offset < line + 16; offset++)
+                printf(" %02x", memory.read(range.address + offset));
+
+            printf("\n");
+        }
+    }
+}
+
+// stdout unless --report names a file. Throws std::runtime_error
+std::ostream &openReport(const Options &options, std::ofstream &file)
+{
+    if (options.reportFile.empty())
+        return std::cout;
+
+    file.open(options.reportFile);
+    if (!file)
+        throw std::runtime_error("cannot write " + options.reportFile);
+
+    return file;
+}
+
+// Exit code as for a single program, once every program of the batch ran
+int runPrograms(const Options &options)
+{
+    try {
+        std::vector<std::string> programs = listPrograms(options.batch);
+        std::ofstream file;
+        std::ostream &report = openReport(options, file);
+
+        return runBatch(programs, options.simulation, options.ranges, options.profile, options.coverageFile,
+                        options.jobs, report) ? 0 : 2;
+    } catch (std::exception &e) {
+        fprintf(stderr, "xasm-run: %s\n", e.what());
+        return 1;
+    }
+}
+
+// Exit code as for a single program, once every input of the sweep ran
+int runInputs(const Options &options, const CpuCore<NullCpuObserver> &core)
+{
+    try {
+        std::ifstream inputFile;
+        if (options.sweep != "-") {
+            inputFile.open(options.sweep);
+
+            if (!inputFile)
+                throw std::runtime_error("cannot open " + options.sweep);
+        }
+
+        std::istream &inputs = options.sweep == "-" ? std::cin : inputFile;
+        std::ofstream file;
+        std::ostream &rows = openReport(options, file);
+
+        return runSweep(core, inputs, options.simulation, options.ranges, options.jobs, rows) ? 0 : 2;
+    } catch (std::exception &e) {
+        fprintf(stderr, "xasm-run: %s\n", e.what());
+        return 1;
+    }
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    CpuCore<NullCpuObserver> core;
+    Labels labels;
+    LineTable lines;
+
+    // Only malformed arguments get the usage, files that cannot be read
+    // and programs that do not assemble just their message
+    try {
+        options = parseArguments(argc, argv);
+    } catch (std::logic_error &e) {
+        fprintf(stderr, "xasm-run: %s\n\n%s", e.what(), usage);
+        return 1;
+    } catch (std::exception &e) {
+        fprintf(stderr, "xasm-run: %s\n", e.what());
+        return 1;
+    }
+
+    if (options.program.empty())
+        return runPrograms(options);
+
+    try {
+        loadProgram(core, options.program, &labels, &lines);
+
+        for (const std::string &breakpoint : options.breakpoints)
+            setBreakpoint(core, breakpoint, labels);
+
+        for (const std::string &watchpoint : options.watchpoints)
+            setWatchpoint(core, watchpoint, labels);
+    } catch (std::exception &e) {
+        fprintf(stderr, "xasm-run: %s\n", e.what());
+        return 1;
+    }
+
+    if (options.simulation.jit)
+        core.setJitMode(JitMode::on);
+
+    if (!options.sweep.empty())
+        return runInputs(options, core);
+
+    // Signals come from a core that runs impulse by impulse, which takes
+    // over the state and hands it back at the end
+    std::unique_ptr<SignalWriter> signals;
+    std::unique_ptr<CpuCore<SignalObserver>> recorder;
+
+    if (!options.signalsFile.empty()) {
+        try {
+            signals.reset(new SignalWriter(options.signalsFile));
+        } catch (std::runtime_error &e) {
+            fprintf(stderr, "xasm-run: %s\n", e.what());
+            return 1;
+        }
+
+        recorder.reset(new CpuCore<SignalObserver>(SignalObserver(signals.get())));
+        std::vector<u8> state = core.saveState();
+        recorder->restoreState(state.data(), state.size());
+    }
+
+    std::unique_ptr<TraceWriter> trace;
+
+    if (!options.traceFile.empty()) {
+        try {
+            trace.reset(new TraceWriter(options.traceFile, options.keyframeInterval));
+        } catch (std::runtime_error &e) {
+            fprintf(stderr, "xasm-run: %s\n", e.what());
+            return 1;
+        }
+
+        if (recorder)
+            recorder->setTrace(trace.get());
+        else
+            core.setTrace(trace.get());
+    }
+
+    std::unique_ptr<Profiler> profiler;
+
+    if (!options.profile.path.empty()) {
+        profiler.reset(new Profiler(core.getRegisters().PC, options.profile.samplePeriod, options.profile.randomized));
+
+        if (recorder)
+            recorder->setProfiler(profiler.get());
+        else
+            core.setProfiler(profiler.get());
+    }
+
+    // The program as loaded tells the branches apart, whatever the run
+    // writes over it
+    std::unique_ptr<Coverage> coverage;
+    PagedMemory program;
+
+    if (!options.coverageFile.empty()) {
+        coverage.reset(new Coverage());
+        program = core.getMemoryView();
+
+        if (recorder)
+            recorder->setCoverage(coverage.get());
+        else
+            core.setCoverage(coverage.get());
+    }
+
+    u64 instructions = 0;
+    SimulationStatus status = recorder ? simulateImpulses(*recorder, options.simulation, instructions)
+                                       : simulate(core, options.simulation, instructions);
+
+    if (trace) {
+        if (recorder)
+            recorder->setTrace(nullptr);
+        else
+            core.setTrace(nullptr);
+
+        try {
+            trace->close();
+        } catch (std::runtime_error &e) {
+            fprintf(stderr, "xasm-run: %s\n", e.what());
+            return 1;
+        }
+    }
+
+    if (recorder) {
+        try {
+            signals->close();
+        } catch (std::runtime_error &e) {
+            fprintf(stderr, "xasm-run: %s\n", e.what());
+            return 1;
+        }
+
+        std::vector<u8> state = recorder->saveState();
+        core.restoreState(state.data(), state.size());
+    }
+
+    if (profiler) {
+        try {
+            saveProfile(options.profile.path, *profiler, labels, options.profile.format);
+        } catch (std::runtime_error &e) {
+            fprintf(stderr, "xasm-run: %s\n", e.what());
+            return 1;
+        }
+    }
+
+    if (coverage) {
+        try {
+            saveCoverage(options.coverageFile, *coverage, options.program, lines, program);
+        } catch (std::runtime_error &e) {
+            fprintf(stderr, "xasm-run: %s\n", e.what());
+            return 1;
+        }
+    }
+
+    printState(core, options, status, instructions);
+
+    if (!options.dumpFile.empty()) {
+        std::vector<u8> memory = core.getMemory();
+        std::ofstream dump(options.dumpFile, std::ios::binary);
+
+        if (!dump.write(reinterpret_cast<const char *>(memory.data()), memory.size())) {
+            fprintf(stderr, "xasm-run: cannot write %s\n", options.dumpFile.c_str());
+            return 1;
+        }
+    }
+
+    if (!options.stateFile.empty()) {
+        std::vector<u8> state = core.saveState();
+        std::ofstream file(options.stateFile, std::ios::binary);
+
+        if (!file.write(reinterpret_cast<const char *>(state.data()), state.size())) {
+            fprintf(stderr, "xasm-run: cannot write %s\n", options.stateFile.c_str());
+            return 1;
+        }
+    }
+
+    return core.isHalted() ? 0 : 2;
+}
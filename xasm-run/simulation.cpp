@@ -0,0 +1,260 @@
+#include "simulation.h"
+
+#include "assembler/XASMGenerator.h"
+#include <cpu/statefile.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Read-only mapping of a whole file
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &path) : mapping(nullptr), length(0)
+    {
+        int descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0)
+            throw std::runtime_error("cannot open " + path);
+
+        struct stat status;
+        if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+            length = status.st_size;
+            mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        }
+
+        close(descriptor);
+
+        if (mapping == MAP_FAILED)
+            throw std::runtime_error("cannot read " + path);
+    }
+
+    ~MappedFile()
+    {
+        if (mapping)
+            munmap(mapping, length);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const u8 *data() const { return static_cast<const u8 *>(mapping); }
+    size_t size() const { return length; }
+
+private:
+    void *mapping;
+    size_t length;
+};
+
+}
+
+const char *statusName(SimulationStatus status)
+{
+    switch (status) {
+    case SimulationStatus::halted:
+        return "halted";
+    case SimulationStatus::waiting:
+        return "waiting";
+    case SimulationStatus::instructionLimit:
+        return "instruction limit";
+    case SimulationStatus::impulseLimit:
+        return "impulse limit";
+    case SimulationStatus::breakpoint:
+        return "breakpoint";
+    case SimulationStatus::watchpoint:
+        return "watchpoint";
+    }
+
+    return "";
+}
+
+u64 parseNumber(const std::string &text)
+{
+    size_t end = 0;
+    u64 value = 0;
+
+    try {
+        value = std::stoull(text, &end, 0);
+    } catch (std::logic_error &) {
+        throw std::invalid_argument("not a number: " + text);
+    }
+
+    if (end != text.size())
+        throw std::invalid_argument("not a number: " + text);
+
+    return value;
+}
+
+ProfileFormat parseProfileFormat(const std::string &text)
+{
+    if (text == "text")
+        return ProfileFormat::text;
+    if (text == "json")
+        return ProfileFormat::json;
+    if (text == "collapsed")
+        return ProfileFormat::collapsed;
+
+    throw std::invalid_argument("unknown profile format " + text);
+}
+
+const char *profileExtension(ProfileFormat format)
+{
+    switch (format) {
+    case ProfileFormat::text:
+        return ".txt";
+    case ProfileFormat::json:
+        return ".json";
+    case ProfileFormat::collapsed:
+        return ".folded";
+    }
+
+    return "";
+}
+
+bool isSource(const std::string &path)
+{
+    return path.size() >= 2 && path.compare(path.size() - 2, 2, ".s") == 0;
+}
+
+void loadProgram(CpuCore<NullCpuObserver> &core, const std::string &path, Labels *labels, LineTable *lines)
+{
+    MappedFile file(path);
+
+    if (file.size() >= sizeof(stateFileMagic) && memcmp(file.data(), stateFileMagic, sizeof(stateFileMagic)) == 0) {
+        if (!core.restoreState(file.data(), file.size()))
+            throw std::runtime_error(path + " is not a state file this version reads");
+
+        return;
+    }
+
+    if (!isSource(path)) {
+        core.setMachineCodeInMemory(const_cast<u8 *>(file.data()), file.size());
+        return;
+    }
+
+    std::string source(file.data(), file.data() + file.size());
+    Lexer lexer(source);
+    XASMParser parser(lexer);
+    parser.parse();
+
+    Labels parsed = parser.getLabels();
+    XASMGenerator generator(lexer, parsed);
+
+    std::vector<u8> image;
+    for (u16 word : generator.assemble()) {
+        image.push_back(word & 0xff);
+        image.push_back(word >> 8);
+    }
+
+    core.setMachineCodeInMemory(image.data(), image.size());
+
+    if (labels)
+        *labels = parsed;
+
+    if (lines)
+        *lines = generator.getLineTable();
+}
+
+void saveProfile(const std::string &path, const Profiler &profiler, const Labels &labels, ProfileFormat format)
+{
+    std::ofstream file(path);
+    writeProfile(file, profiler, labels, format);
+
+    if (!file.flush())
+        throw std::runtime_error("cannot write " + path);
+}
+
+void saveCoverage(const std::string &path, const Coverage &coverage, const std::string &source,
+                  const LineTable &lines, const PagedMemory &program)
+{
+    std::ofstream file(path);
+    writeLcov(file, coverage, source, lines, program);
+
+    if (!file.flush())
+        throw std::runtime_error("cannot write " + path);
+}
+
+SimulationStatus simulate(CpuCore<NullCpuObserver> &core, const SimulationOptions &options,
+                          u64 &instructions)
+{
+    u64 start = core.getImpulseCount();
+
+    if (!options.interrupts.empty())
+        core.replayInterrupts(options.interrupts);
+
+    while (!core.isHalted()) {
+        u64 impulses = core.getImpulseCount() - start;
+
+        if (instructions >= options.maxInstructions)
+            return SimulationStatus::instructionLimit;
+
+        if (impulses >= options.maxImpulses)
+            return SimulationStatus::impulseLimit;
+
+        u64 count = options.maxInstructions - instructions;
+        if (options.maxImpulses != ~0ull)
+            count = std::min(count, (options.maxImpulses - impulses) / core.maxInstructionImpulses);
+
+        if (!count) {
+            core.advance();
+            instructions += core.completedInstruction();
+            continue;
+        }
+
+        u64 executed = core.runInstructions(count);
+        instructions += executed;
+
+        if (core.atBreakpoint())
+            return SimulationStatus::breakpoint;
+
+        if (core.atWatchpoint())
+            return SimulationStatus::watchpoint;
+
+        if (!executed && !core.isHalted())
+            return SimulationStatus::waiting;
+    }
+
+    return SimulationStatus::halted;
+}
+
+SimulationStatus simulateImpulses(CpuCore<SignalObserver> &core, const SimulationOptions &options,
+                                  u64 &instructions)
+{
+    u64 start = core.getImpulseCount();
+
+    if (!options.interrupts.empty())
+        core.replayInterrupts(options.interrupts);
+
+    while (!core.isHalted()) {
+        u64 impulses = core.getImpulseCount() - start;
+
+        if (instructions >= options.maxInstructions)
+            return SimulationStatus::instructionLimit;
+
+        if (impulses >= options.maxImpulses)
+            return SimulationStatus::impulseLimit;
+
+        // Single impulses close to the impulse limit
+        if (options.maxImpulses - impulses < core.maxInstructionImpulses) {
+            core.advance();
+            instructions += core.completedInstruction();
+            continue;
+        }
+
+        u64 before = core.getImpulseCount();
+        instructions += core.stepInstruction();
+
+        if (core.getImpulseCount() == before && !core.isHalted())
+            return SimulationStatus::waiting;
+    }
+
+    return SimulationStatus::halted;
+}
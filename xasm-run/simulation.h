@@ -0,0 +1,88 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <cpu/coverage.h>
+#include <cpu/cpucore.h>
+#include <cpu/profiler.h>
+#include <cpu/signaltrace.h>
+
+#include <string>
+#include <vector>
+
+//// Limits and engine of a headless run, and the interrupts it replays
+struct SimulationOptions
+{
+    u64 maxInstructions = ~0ull;
+    u64 maxImpulses = ~0ull;
+    bool jit = false;
+    std::vector<u64> interrupts;
+};
+
+//// Where the profiles of headless runs go, none while path is empty, and
+//// the sample period of sampling profilers, 0 to count every instruction
+struct ProfileOptions
+{
+    std::string path;
+    ProfileFormat format = ProfileFormat::text;
+    u64 samplePeriod = 0;
+    bool randomized = false;
+};
+
+//// Why a headless run ended
+enum class SimulationStatus {
+    halted,
+    waiting,
+    instructionLimit,
+    impulseLimit,
+    breakpoint,
+    watchpoint
+};
+
+const char *statusName(SimulationStatus status);
+
+//// Decimal, 0x hexadecimal or 0 octal. Throws std::invalid_argument
+u64 parseNumber(const std::string &text);
+
+//// text, json or collapsed. Throws std::invalid_argument
+ProfileFormat parseProfileFormat(const std::string &text);
+
+//// File name extension of profiles in format
+const char *profileExtension(ProfileFormat format);
+
+//// Restores state files written by CpuCore::saveState(), assembles .s
+//// sources in memory, without writing output.out, and loads anything
+//// else as an image. Files are mapped, not read. The labels of sources
+//// go to labels and their line tables to lines, if given. Throws
+//// std::runtime_error
+void loadProgram(CpuCore<NullCpuObserver> &core, const std::string &path, Labels *labels = nullptr,
+                 LineTable *lines = nullptr);
+
+//// Whether path is a source that loadProgram() assembles
+bool isSource(const std::string &path);
+
+//// Throws std::runtime_error if path cannot be written
+void saveProfile(const std::string &path, const Profiler &profiler, const Labels &labels, ProfileFormat format);
+
+//// Writes the lcov record of the source at source to path, see
+//// writeLcov(). Throws std::runtime_error if path cannot be written
+void saveCoverage(const std::string &path, const Coverage &coverage, const std::string &source,
+                  const LineTable &lines, const PagedMemory &program);
+
+//// Runs whole instructions while far from the impulse limit and single
+//// impulses close to it. Both limits count from the state the core is
+//// in, interrupts are impulse counts like those of the core. A wait that
+//// skips ahead to a replayed interrupt may pass the impulse limit.
+//// instructions counts those completed, by runInstructions() and by single
+//// impulses alike. Stops at the breakpoints of the core, running again
+//// resumes from there, and after the instructions that reach its
+//// watchpoints
+SimulationStatus simulate(CpuCore<NullCpuObserver> &core, const SimulationOptions &options,
+                          u64 &instructions);
+
+//// Like simulate(), but every impulse runs through advance(), so that the
+//// observer sees it. A wait that skips ahead to a replayed interrupt
+//// leaves out the impulses in between
+SimulationStatus simulateImpulses(CpuCore<SignalObserver> &core, const SimulationOptions &options,
+                                  u64 &instructions);
+
+#endif // SIMULATION_H
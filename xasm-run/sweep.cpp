@@ -0,0 +1,256 @@
+#include "sweep.h"
+#include "workstealingpool.h"
+
+#include <cctype>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+
+const char *const registerNames[] = {
+    "R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7",
+    "R8", "R9", "R10", "R11", "R12", "R13", "R14", "R15",
+    "PC", "SP", "FLAG"
+};
+
+const u8 registerCount = sizeof(registerNames) / sizeof(registerNames[0]);
+
+// Inputs read and run at a time, per thread
+const size_t runsPerThread = 1024;
+
+struct SweepRun
+{
+    size_t line;
+    SweepInput input;
+
+    // Set when the line is malformed, which then does not run
+    std::string error;
+
+    SimulationStatus status;
+    std::string reason;
+    u64 instructions;
+    u64 impulses;
+    CpuRegisters registers;
+    std::vector<u8> memory;
+};
+
+std::vector<u8> parseBytes(const std::string &text)
+{
+    if (text.empty() || text.size() % 2 || text.size() > 2 << 16)
+        throw std::invalid_argument("expected up to 64 KiB of hex bytes, found " + text);
+
+    std::vector<u8> bytes;
+
+    for (size_t index = 0; index < text.size(); index += 2) {
+        std::string digits = text.substr(index, 2);
+
+        if (!isxdigit((unsigned char)digits[0]) || !isxdigit((unsigned char)digits[1]))
+            throw std::invalid_argument("not a hex byte: " + digits);
+
+        bytes.push_back((u8)std::stoul(digits, nullptr, 16));
+    }
+
+    return bytes;
+}
+
+void simulateRun(const CpuCore<NullCpuObserver> &base, const SimulationOptions &options,
+                 const std::vector<MemoryRange> &ranges, SweepRun &run)
+{
+    CpuCore<NullCpuObserver> core(base);
+    CpuRegisters registers = core.getRegisters();
+
+    for (const SweepInput::Register &assignment : run.input.registers) {
+        if (assignment.index < 16)
+            registers.R[assignment.index] = assignment.value;
+        else if (assignment.index == 16)
+            registers.PC = assignment.value;
+        else if (assignment.index == 17)
+            registers.SP = assignment.value;
+        else
+            registers.FLAG = assignment.value;
+    }
+
+    core.setRegisters(registers);
+
+    for (const SweepInput::Bytes &assignment : run.input.memory)
+        core.writeMemory(assignment.address, assignment.bytes.data(), assignment.bytes.size());
+
+    run.instructions = 0;
+    run.status = simulate(core, options, run.instructions);
+    if (core.isHalted())
+        run.reason = core.getReason();
+    run.impulses = core.getImpulseCount();
+    run.registers = core.getRegisters();
+
+    for (const MemoryRange &range : ranges) {
+        size_t offset = run.memory.size();
+
+        run.memory.resize(offset + range.length);
+        core.getMemoryView().read(range.address, range.length, run.memory.data() + offset);
+    }
+}
+
+std::string quote(const std::string &text)
+{
+    std::string quoted = "\"";
+
+    for (char c : text) {
+        if (c == '"')
+            quoted += '"';
+        quoted += c;
+    }
+
+    return quoted + "\"";
+}
+
+void writeHeader(std::ostream &rows, const std::vector<MemoryRange> &ranges)
+{
+    rows << "line,status,reason,instructions,impulses";
+
+    for (const char *name : registerNames)
+        rows << "," << name;
+
+    for (const MemoryRange &range : ranges) {
+        char name[32];
+        snprintf(name, sizeof(name), ",[0x%04x:%u]", range.address, range.length);
+        rows << name;
+    }
+
+    rows << "\n";
+}
+
+void writeRow(std::ostream &rows, const SweepRun &run, const std::vector<MemoryRange> &ranges)
+{
+    const CpuRegisters &registers = run.registers;
+
+    // The columns of the run stay empty
+    if (!run.error.empty()) {
+        rows << run.line << ",error," << quote(run.error) << ",,";
+        rows << std::string(registerCount + ranges.size(), ',') << "\n";
+        return;
+    }
+
+    rows << run.line << "," << statusName(run.status) << "," << quote(run.reason) << ","
+         << run.instructions << "," << run.impulses;
+
+    for (int index = 0; index < 16; index++)
+        rows << "," << registers.R[index];
+    rows << "," << registers.PC << "," << registers.SP << "," << registers.FLAG;
+
+    size_t offset = 0;
+    for (const MemoryRange &range : ranges) {
+        rows << ",";
+
+        for (u32 index = 0; index < range.length; index++) {
+            char hex[3];
+            snprintf(hex, sizeof(hex), "%02x", run.memory[offset + index]);
+            rows << hex;
+        }
+
+        offset += range.length;
+    }
+
+    rows << "\n";
+}
+
+}
+
+SweepInput parseSweepInput(const std::string &line)
+{
+    SweepInput input;
+    size_t position = 0;
+
+    while (true) {
+        position = line.find_first_not_of(" \t\r", position);
+        if (position == std::string::npos)
+            break;
+
+        size_t end = line.find_first_of(" \t\r", position);
+        std::string assignment = line.substr(position, end - position);
+        position = end;
+
+        size_t equals = assignment.find('=');
+        if (equals == std::string::npos)
+            throw std::invalid_argument("expected NAME=VALUE, found " + assignment);
+
+        std::string name = assignment.substr(0, equals);
+        std::string value = assignment.substr(equals + 1);
+
+        if (name.size() > 2 && name.front() == '[' && name.back() == ']') {
+            u64 address = parseNumber(name.substr(1, name.size() - 2));
+            if (address >= 1 << 16)
+                throw std::invalid_argument("address outside of memory: " + name);
+
+            input.memory.push_back({(u16)address, parseBytes(value)});
+            continue;
+        }
+
+        u8 index = 0;
+        while (index < registerCount && name != registerNames[index])
+            index++;
+
+        if (index == registerCount)
+            throw std::invalid_argument("unknown register " + name);
+
+        u64 number = parseNumber(value);
+        if (number >= 1 << 16)
+            throw std::invalid_argument("value does not fit 16 bits: " + assignment);
+
+        input.registers.push_back({index, (u16)number});
+    }
+
+    return input;
+}
+
+bool runSweep(const CpuCore<NullCpuObserver> &base, std::istream &inputs, const SimulationOptions &options,
+              const std::vector<MemoryRange> &ranges, unsigned threads, std::ostream &rows)
+{
+    WorkStealingPool pool(threads);
+    std::vector<SweepRun> runs;
+    std::string text;
+    size_t line = 0;
+    bool halted = true;
+
+    writeHeader(rows, ranges);
+
+    while (inputs) {
+        runs.clear();
+
+        while (runs.size() < runsPerThread * pool.threadCount() && std::getline(inputs, text)) {
+            line++;
+
+            size_t first = text.find_first_not_of(" \t\r");
+            if (first == std::string::npos || text[first] == '#')
+                continue;
+
+            SweepRun run;
+            run.line = line;
+
+            try {
+                run.input = parseSweepInput(text);
+            } catch (std::exception &e) {
+                run.error = e.what();
+            }
+
+            runs.push_back(std::move(run));
+        }
+
+        // Every task only writes its own run
+        std::vector<std::function<void()>> tasks;
+        for (SweepRun &run : runs) {
+            if (run.error.empty())
+                tasks.push_back([&]() { simulateRun(base, options, ranges, run); });
+        }
+
+        pool.run(std::move(tasks));
+
+        for (const SweepRun &run : runs) {
+            writeRow(rows, run, ranges);
+
+            if (!run.error.empty() || run.status != SimulationStatus::halted)
+                halted = false;
+        }
+    }
+
+    return halted;
+}
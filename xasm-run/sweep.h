@@ -0,0 +1,45 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "simulation.h"
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//// Initial state of one run of a sweep, set on a fork of the loaded
+//// program
+struct SweepInput
+{
+    struct Register
+    {
+        u8 index; // R0 to R15, then PC, SP and FLAG
+        u16 value;
+    };
+
+    struct Bytes
+    {
+        u16 address;
+        std::vector<u8> bytes;
+    };
+
+    std::vector<Register> registers;
+    std::vector<Bytes> memory;
+};
+
+//// Parses one line of sweep input, whitespace separated assignments to
+//// R0 to R15, PC, SP and FLAG, like R1=0x10, and to memory, like
+//// [0x200]=0a00ff01 with the bytes in hex. Throws std::invalid_argument
+SweepInput parseSweepInput(const std::string &line);
+
+//// Runs base once per line of inputs, each time on a fork with the line
+//// applied, on threads threads. Writes a CSV row per run in input order,
+//// with the bytes of ranges in hex. Empty lines and lines starting with #
+//// are skipped. A malformed line gets a row with the status error, the
+//// reason it is malformed and empty columns otherwise, and the sweep
+//// goes on. Returns whether every run halted
+bool runSweep(const CpuCore<NullCpuObserver> &base, std::istream &inputs, const SimulationOptions &options,
+              const std::vector<MemoryRange> &ranges, unsigned threads, std::ostream &rows);
+
+#endif // SWEEP_H
@@ -0,0 +1,80 @@
+#include "workstealingpool.h"
+
+#include <algorithm>
+#include <thread>
+
+WorkStealingPool::WorkStealingPool(unsigned threads)
+{
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned thread = 0; thread < threads; thread++)
+        queues.emplace_back(new Queue);
+}
+
+unsigned WorkStealingPool::threadCount() const
+{
+    return (unsigned)queues.size();
+}
+
+void WorkStealingPool::run(std::vector<std::function<void()>> tasks)
+{
+    size_t threads = queues.size();
+
+    for (size_t thread = 0; thread < threads; thread++) {
+        size_t begin = tasks.size() * thread / threads;
+        size_t end = tasks.size() * (thread + 1) / threads;
+
+        for (size_t index = begin; index < end; index++)
+            queues[thread]->tasks.push_back(std::move(tasks[index]));
+    }
+
+    // The calling thread is the first worker
+    std::vector<std::thread> workers;
+    for (unsigned thread = 1; thread < threads; thread++)
+        workers.emplace_back(&WorkStealingPool::work, this, thread);
+
+    work(0);
+
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+// No task adds new ones, so a thread is done once every queue is empty
+void WorkStealingPool::work(unsigned thread)
+{
+    std::function<void()> task;
+
+    while (take(thread, task) || steal(thread, task))
+        task();
+}
+
+bool WorkStealingPool::take(unsigned thread, std::function<void()> &task)
+{
+    Queue &queue = *queues[thread];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if (queue.tasks.empty())
+        return false;
+
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    return true;
+}
+
+bool WorkStealingPool::steal(unsigned thread, std::function<void()> &task)
+{
+    for (size_t offset = 1; offset < queues.size(); offset++) {
+        Queue &queue = *queues[(thread + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.tasks.empty())
+            continue;
+
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    return false;
+}
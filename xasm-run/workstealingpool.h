@@ -0,0 +1,39 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//// Runs independent tasks on a fixed number of threads. Each thread starts
+//// with a contiguous share of the tasks, takes them from the front of its
+//// own queue and steals from the back of the others' once it runs dry, so
+//// a few long tasks do not leave the other threads idle
+class WorkStealingPool
+{
+public:
+    //// 0 threads means one per hardware thread
+    explicit WorkStealingPool(unsigned threads = 0);
+
+    unsigned threadCount() const;
+
+    //// Runs every task once, returns when all of them are done
+    void run(std::vector<std::function<void()>> tasks);
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void work(unsigned thread);
+    bool take(unsigned thread, std::function<void()> &task);
+    bool steal(unsigned thread, std::function<void()> &task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+};
+
+#endif // WORKSTEALINGPOOL_H
@@ -2,7 +2,7 @@ QT       += core gui
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
-CONFIG += c++11
+CONFIG += c++14
 
 # The following define makes your compiler emit warnings if you use
 # any Qt feature that has been marked deprecated (the exact warnings
@@ -22,7 +22,17 @@ SOURCES += \
     assembler/parser.cpp \
     assembler/verifier.cpp \
     cgb/cgb.cpp \
+    cpu/breakpoint.cpp \
+    cpu/coverage.cpp \
     cpu/cpu.cpp \
+    cpu/cpucore.cpp \
+    cpu/cpuworker.cpp \
+    cpu/interruptlog.cpp \
+    cpu/jit.cpp \
+    cpu/pagedmemory.cpp \
+    cpu/profiler.cpp \
+    cpu/trace.cpp \
+    cpu/traceseek.cpp \
     editor/codeeditor.cpp \
     editor/linenumberarea.cpp \
     editor/xasmhighlighter.cpp \
@@ -41,7 +51,20 @@ HEADERS += \
     assembler/token.h \
     assembler/verifier.h \
     cgb/cgb.h \
+    cpu/breakpoint.h \
+    cpu/coverage.h \
     cpu/cpu.h \
+    cpu/cpucore.h \
+    cpu/cpucoreimpl.h \
+    cpu/cpuworker.h \
+    cpu/interruptlog.h \
+    cpu/jit.h \
+    cpu/pagedmemory.h \
+    cpu/profiler.h \
+    cpu/spscring.h \
+    cpu/statefile.h \
+    cpu/trace.h \
+    cpu/traceseek.h \
     editor/codeeditor.h \
     editor/linenumberarea.h \
     editor/xasmhighlighter.h \
@@ -0,0 +1,53 @@
+# Checks of the simulator core, builds without Qt. Run xasm-test, it
+# exits with 1 if a check fails
+
+TEMPLATE = app
+TARGET = xasm-test
+
+CONFIG += console c++14 thread
+CONFIG -= qt app_bundle
+
+SOURCES += \
+    assembler/XASMGenerator.cpp \
+    assembler/lexer.cpp \
+    assembler/parser.cpp \
+    assembler/verifier.cpp \
+    cgb/cgb.cpp \
+    cpu/breakpoint.cpp \
+    cpu/coverage.cpp \
+    cpu/cpucore.cpp \
+    cpu/jit.cpp \
+    cpu/pagedmemory.cpp \
+    cpu/profiler.cpp \
+    cpu/signaltrace.cpp \
+    cpu/trace.cpp \
+    tests/breakpoint.cpp \
+    tests/flags.cpp \
+    tests/main.cpp \
+    tests/profiler.cpp \
+    tests/signals.cpp \
+    tests/simulation.cpp \
+    xasm-run/simulation.cpp
+
+HEADERS += \
+    assembler/XASMGenerator.h \
+    assembler/defs.h \
+    assembler/encoding.h \
+    assembler/lexer.h \
+    assembler/parser.h \
+    assembler/token.h \
+    assembler/verifier.h \
+    cgb/cgb.h \
+    cpu/breakpoint.h \
+    cpu/coverage.h \
+    cpu/cpucore.h \
+    cpu/cpucoreimpl.h \
+    cpu/jit.h \
+    cpu/pagedmemory.h \
+    cpu/profiler.h \
+    cpu/signaltrace.h \
+    cpu/spscring.h \
+    cpu/statefile.h \
+    cpu/trace.h \
+    tests/tests.h \
+    xasm-run/simulation.h
@@ -0,0 +1,42 @@
+# Prints the traces of xasm-run --trace and turns its signal captures into
+# waveforms, builds without Qt
+
+TEMPLATE = app
+TARGET = xasm-trace
+
+CONFIG += console c++14 thread
+CONFIG -= qt app_bundle
+
+SOURCES += \
+    cgb/cgb.cpp \
+    cpu/breakpoint.cpp \
+    cpu/coverage.cpp \
+    cpu/cpucore.cpp \
+    cpu/jit.cpp \
+    cpu/pagedmemory.cpp \
+    cpu/profiler.cpp \
+    cpu/signaltrace.cpp \
+    cpu/trace.cpp \
+    cpu/traceseek.cpp \
+    xasm-trace/main.cpp
+
+HEADERS += \
+    assembler/defs.h \
+    assembler/encoding.h \
+    cgb/cgb.h \
+    cpu/breakpoint.h \
+    cpu/coverage.h \
+    cpu/cpucore.h \
+    cpu/cpucoreimpl.h \
+    cpu/jit.h \
+    cpu/pagedmemory.h \
+    cpu/profiler.h \
+    cpu/signaltrace.h \
+    cpu/spscring.h \
+    cpu/statefile.h \
+    cpu/trace.h \
+    cpu/traceseek.h
+
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,193 @@
+// Prints the binary traces xasm-run --trace writes, one line per
+// instruction or interrupt entry with the registers it changed and the
+// words it stored. Starts anywhere in the trace from the keyframe before,
+// and writes the machine state there for xasm-run or the GUI to go on from.
+// Turns the signal captures of xasm-run --signals into VCD waveforms
+
+#include <cpu/signaltrace.h>
+#include <cpu/trace.h>
+#include <cpu/traceseek.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+const char usage[] =
+    "usage: xasm-trace [options] trace\n"
+    "       xasm-trace --vcd FILE signals\n"
+    "\n"
+    "  --count N            print the first N records only\n"
+    "  --summary            print the number of records and impulses instead\n"
+    "                       of the records\n"
+    "  --instruction N      start after instruction N of the trace\n"
+    "  --impulse N          start at impulse count N\n"
+    "  --save-state FILE    write the machine state where the trace starts to\n"
+    "                       FILE instead, which runs the trace from the\n"
+    "                       keyframe before\n"
+    "  --vcd FILE           write the signal capture of xasm-run --signals\n"
+    "                       to FILE as a VCD waveform\n";
+
+const char *const registerNames[traceRegisterCount] = {
+    "R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7", "R8", "R9", "R10", "R11", "R12", "R13", "R14", "R15",
+    "SP", "FLAG"
+};
+
+void printRecord(const TraceRecord &record)
+{
+    if (record.interrupt)
+        printf("%12llu  INT     0x%04x", record.impulseCount, record.PC);
+    else
+        printf("%12llu  0x%04x  0x%04x", record.impulseCount, record.PC, record.IR);
+
+    for (int r = 0; r < traceRegisterCount; r++) {
+        if (record.changed >> r & 1)
+            printf("  %s=0x%04x", registerNames[r], record.registers[r]);
+    }
+
+    for (int write = 0; write < record.writeCount; write++)
+        printf("  [0x%04x]=0x%04x", record.writes[write].address, record.writes[write].value);
+
+    printf("\n");
+}
+
+// Whether record comes after position
+bool follows(const TraceRecord &record, TracePosition unit, u64 position)
+{
+    if (unit == TracePosition::impulse)
+        return record.impulseCount > position;
+
+    return record.instructions > position || (record.interrupt && record.instructions == position);
+}
+
+// Reads on from the keyframe before position
+void seekRecords(TraceReader &reader, TracePosition unit, u64 position)
+{
+    const std::vector<TraceKeyframe> &keyframes = reader.getIndex().keyframes;
+
+    if (keyframes.empty())
+        throw std::runtime_error("the trace has no keyframes");
+
+    auto before = [&](const TraceKeyframe &keyframe) {
+        if (unit == TracePosition::impulse)
+            return keyframe.impulseCount <= position;
+
+        return keyframe.instructions < position;
+    };
+
+    auto keyframe = std::partition_point(keyframes.begin() + 1, keyframes.end(), before) - 1;
+
+    reader.seek(*keyframe);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    std::string path;
+    std::string stateFile;
+    std::string vcdFile;
+    unsigned long long count = ~0ull;
+    bool summary = false;
+    bool seeking = false;
+    TracePosition unit = TracePosition::instruction;
+    u64 position = 0;
+
+    try {
+        for (int index = 1; index < argc; index++) {
+            std::string argument = argv[index];
+
+            if (argument == "--count" && index + 1 < argc)
+                count = std::stoull(argv[++index], nullptr, 0);
+            else if (argument == "--summary")
+                summary = true;
+            else if ((argument == "--instruction" || argument == "--impulse") && index + 1 < argc) {
+                seeking = true;
+                unit = argument == "--impulse" ? TracePosition::impulse : TracePosition::instruction;
+                position = std::stoull(argv[++index], nullptr, 0);
+            }
+            else if (argument == "--save-state" && index + 1 < argc)
+                stateFile = argv[++index];
+            else if (argument == "--vcd" && index + 1 < argc)
+                vcdFile = argv[++index];
+            else if (argument.compare(0, 2, "--") == 0 || !path.empty())
+                throw std::invalid_argument("unexpected argument " + argument);
+            else
+                path = argument;
+        }
+
+        if (path.empty())
+            throw std::invalid_argument("expected a trace");
+    } catch (std::exception &e) {
+        fprintf(stderr, "xasm-trace: %s\n\n%s", e.what(), usage);
+        return 1;
+    }
+
+    if (!vcdFile.empty()) {
+        try {
+            SignalReader reader(path);
+            std::ofstream file(vcdFile);
+
+            writeVcd(file, reader);
+
+            if (!file.flush())
+                throw std::runtime_error("cannot write " + vcdFile);
+        } catch (std::runtime_error &e) {
+            fprintf(stderr, "xasm-trace: %s\n", e.what());
+            return 1;
+        }
+
+        return 0;
+    }
+
+    u64 instructions = 0;
+    u64 interrupts = 0;
+    u64 impulses = 0;
+
+    try {
+        TraceReader reader(path);
+        TraceRecord record;
+
+        if (!stateFile.empty()) {
+            std::vector<u8> state = seekTrace(reader, unit, position);
+            std::ofstream file(stateFile, std::ios::binary);
+
+            if (!file.write(reinterpret_cast<const char *>(state.data()), state.size()))
+                throw std::runtime_error("cannot write " + stateFile);
+
+            return 0;
+        }
+
+        if (seeking)
+            seekRecords(reader, unit, position);
+
+        while (instructions + interrupts < count && reader.next(record)) {
+            if (seeking && !follows(record, unit, position))
+                continue;
+
+            if (record.interrupt)
+                interrupts++;
+            else
+                instructions++;
+
+            impulses = record.impulseCount;
+
+            if (!summary)
+                printRecord(record);
+        }
+    } catch (std::runtime_error &e) {
+        fprintf(stderr, "xasm-trace: %s\n", e.what());
+        return 1;
+    }
+
+    if (summary) {
+        printf("instructions: %llu\n", instructions);
+        printf("interrupts: %llu\n", interrupts);
+        printf("impulses: %llu\n", impulses);
+    }
+
+    return 0;
+}